@@ -0,0 +1,408 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+// Microbenchmarks for the DSP kernels and the key routing paths.
+// All ranks are synthetic, no stops directory or audio device is
+// needed. Run with --benchmark_repetitions=N for stable figures.
+
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "audio_backend.h"
+#include "addsynth.h"
+#include "asection.h"
+#include "division.h"
+#include "midi_processor.h"
+#include "rankwave.h"
+#include "reverb.h"
+#include "rngen.h"
+#include "scales.h"
+
+extern float exp2ap(float);
+
+namespace {
+
+constexpr float FSAMP = 48000.0f;
+constexpr float FBASE = 440.0f;
+
+float *equal_temperament() { return scales[5]._data; }
+
+// A flue-like stop with eight harmonics. Attack and release times
+// are parameters so the benchmarks can stay in the phase they time.
+void make_synth(Addsynth *D, int n0, int n1, float attack, float release)
+{
+    D->reset();
+    D->_n0 = n0;
+    D->_n1 = n1;
+    D->_n_att.reset(attack);
+    D->_n_dct.reset(release);
+    D->_n_ins.reset(2.0f);
+    for (int h = 0; h < 8; h++) {
+        for (int i = 0; i < N_NOTE; i++) D->_h_lev.setv(h, i, -6.0f * h);
+    }
+}
+
+// A single pipe, played through a one-note Rankwave. Pipewave itself
+// is private to Rankwave, the list walk around it is negligible.
+class Pipe
+{
+public:
+    Pipe(float attack, float release) : rank(NOTE, NOTE)
+    {
+        make_synth(&synth, NOTE, NOTE, attack, release);
+        rank.gen_waves(&synth, FSAMP, FBASE, equal_temperament());
+        rank.set_param(buff, 0, 'C');
+    }
+
+    void play(int n)
+    {
+        while (n--) rank.play(1);
+    }
+
+    static constexpr int NOTE = 60;
+    Addsynth  synth;
+    Rankwave  rank;
+    float     buff[NCHANN * PERIOD] = {};
+};
+
+// A full 61-note rank.
+std::unique_ptr<Rankwave> make_rank(float *out)
+{
+    Addsynth D;
+    make_synth(&D, 36, 96, 0.01f, 0.01f);
+    auto R = std::make_unique<Rankwave>(36, 96);
+    R->gen_waves(&D, FSAMP, FBASE, equal_temperament());
+    R->set_param(out, 0, 'C');
+    return R;
+}
+
+void fill_noise(float *p, int n, Rngen *G)
+{
+    while (n--) *p++ = 0.1f * G->grandf();
+}
+
+}  // namespace
+
+
+// Pipewave::play during the attack. The attack is 0.5 s long,
+// the pipe is restarted before it reaches the loop.
+static void BM_Pipewave_play_attack(benchmark::State& state)
+{
+    Pipe P(0.5f, 0.01f);
+    int  n = 0;
+
+    P.rank.note_on(Pipe::NOTE);
+    for (auto _ : state) {
+        P.rank.play(1);
+        if (++n == 300) {
+            state.PauseTiming();
+            P.rank.note_off(Pipe::NOTE);
+            P.play(100);
+            P.rank.note_on(Pipe::NOTE);
+            n = 0;
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * PERIOD);
+}
+BENCHMARK(BM_Pipewave_play_attack);
+
+
+// Pipewave::play in the steady state loop.
+static void BM_Pipewave_play_loop(benchmark::State& state)
+{
+    Pipe P(0.01f, 0.01f);
+
+    P.rank.note_on(Pipe::NOTE);
+    P.play(100);
+    for (auto _ : state) {
+        P.rank.play(1);
+    }
+    state.SetItemsProcessed(state.iterations() * PERIOD);
+}
+BENCHMARK(BM_Pipewave_play_loop);
+
+
+// Pipewave::play during the release, which is 0.5 s long.
+static void BM_Pipewave_play_release(benchmark::State& state)
+{
+    Pipe P(0.01f, 0.5f);
+    int  n = 0;
+
+    P.rank.note_on(Pipe::NOTE);
+    P.play(100);
+    P.rank.note_off(Pipe::NOTE);
+    P.play(2);
+    for (auto _ : state) {
+        P.rank.play(1);
+        if (++n == 300) {
+            state.PauseTiming();
+            P.play(200);
+            P.rank.note_on(Pipe::NOTE);
+            P.play(100);
+            P.rank.note_off(Pipe::NOTE);
+            P.play(2);
+            n = 0;
+            state.ResumeTiming();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * PERIOD);
+}
+BENCHMARK(BM_Pipewave_play_release);
+
+
+// Rankwave::play with N notes held.
+static void BM_Rankwave_play(benchmark::State& state)
+{
+    float buff[NCHANN * PERIOD] = {};
+    auto  R = make_rank(buff);
+    int   n = state.range(0);
+
+    for (int i = 0; i < n; i++) R->note_on(36 + i);
+    for (int i = 0; i < 100; i++) R->play(1);
+    for (auto _ : state) {
+        R->play(1);
+    }
+    state.SetItemsProcessed(state.iterations() * PERIOD * n);
+}
+BENCHMARK(BM_Rankwave_play)->Arg(1)->Arg(4)->Arg(16)->Arg(61);
+
+
+// Pipewave::genwave, through Rankwave::gen_waves on a single note.
+// A Rankwave makes its waves once, so each iteration uses a new one.
+static void BM_Pipewave_genwave(benchmark::State& state)
+{
+    Addsynth D;
+    int      n = state.range(0);
+
+    make_synth(&D, n, n, 0.05f, 0.01f);
+    for (auto _ : state) {
+        Rankwave R(n, n);
+        R.gen_waves(&D, FSAMP, FBASE, equal_temperament());
+    }
+}
+BENCHMARK(BM_Pipewave_genwave)->Arg(36)->Arg(60)->Arg(96)->Unit(benchmark::kMicrosecond);
+
+
+// Division::process with R ranks and 10 notes held in each.
+static void BM_Division_process(benchmark::State& state)
+{
+    Asection A(FSAMP);
+    Division D(&A, FSAMP);
+    int      r = state.range(0);
+    std::vector<std::unique_ptr<Rankwave>> ranks;
+
+    for (int i = 0; i < r; i++) {
+        ranks.push_back(make_rank(nullptr));
+        D.set_rank(i, ranks.back().get(), 'C', 0);
+        for (int n = 0; n < 10; n++) ranks.back()->note_on(48 + 3 * n);
+    }
+    for (int i = 0; i < 100; i++) D.process();
+    for (auto _ : state) {
+        D.process();
+    }
+    state.SetItemsProcessed(state.iterations() * PERIOD);
+}
+BENCHMARK(BM_Division_process)->Arg(1)->Arg(4)->Arg(16);
+
+
+static void BM_Asection_process(benchmark::State& state)
+{
+    Asection A(FSAMP);
+    Rngen    G;
+    float    W[PERIOD], X[PERIOD], Y[PERIOD], R[PERIOD];
+    float    in[PERIOD];
+
+    A.set_size(0.075f);
+    fill_noise(in, PERIOD, &G);
+    for (auto _ : state) {
+        float *q = A.get_wptr();
+        for (int c = 0; c < NCHANN; c++) memcpy(q + c * PERIOD * MIXLEN, in, sizeof(in));
+        A.process(0.32f, W, X, Y, R);
+        benchmark::DoNotOptimize(W);
+    }
+    state.SetItemsProcessed(state.iterations() * PERIOD);
+}
+BENCHMARK(BM_Asection_process);
+
+
+static void BM_Reverb_process(benchmark::State& state)
+{
+    Reverb V;
+    Rngen  G;
+    float  W[PERIOD], X[PERIOD], Y[PERIOD], Z[PERIOD];
+    float  R[16 * PERIOD];
+    int    k = 0;
+
+    // The output buffers are cleared per period as in proc_synth().
+    fill_noise(R, 16 * PERIOD, &G);
+    V.init(FSAMP);
+    V.set_delay(0.075f);
+    V.set_t60mf(4.0f);
+    V.set_t60lo(6.0f, 250.0f);
+    V.set_t60hi(2.0f, 3e3f);
+    for (auto _ : state) {
+        memset(W, 0, sizeof(W));
+        memset(X, 0, sizeof(X));
+        memset(Y, 0, sizeof(Y));
+        memset(Z, 0, sizeof(Z));
+        V.process(PERIOD, 0.32f, R + k * PERIOD, W, X, Y, Z);
+        benchmark::DoNotOptimize(W);
+        k = (k + 1) & 15;
+    }
+    V.fini();
+    state.SetItemsProcessed(state.iterations() * PERIOD);
+}
+BENCHMARK(BM_Reverb_process);
+
+
+static void BM_exp2ap(benchmark::State& state)
+{
+    float x[1024];
+    float s;
+
+    for (int i = 0; i < 1024; i++) x[i] = -16.0f + i / 32.0f;
+    for (auto _ : state) {
+        s = 0;
+        for (int i = 0; i < 1024; i++) s += exp2ap(x[i]);
+        benchmark::DoNotOptimize(s);
+    }
+    state.SetItemsProcessed(state.iterations() * 1024);
+}
+BENCHMARK(BM_exp2ap);
+
+
+// MIDI note and controller events, routed into the note queue as
+// the MIDI thread does it. The queue is drained after each event.
+static void BM_MidiProcessor_note(benchmark::State& state)
+{
+    Lfq_u32  qnote(256);
+    Lfq_u8   qmidi(1024);
+    uint16_t midimap[16];
+    int      n = 0;
+
+    for (int i = 0; i < 16; i++) midimap[i] = (1 << 12) | i;
+    for (auto _ : state) {
+        MidiProcessor::process_midi_event(0x90, 36 + n, (n & 1) ? 0 : 64, 0,
+                                          midimap, nullptr, &qnote, &qmidi);
+        qnote.read_commit(qnote.read_avail());
+        n = (n + 1) % 61;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MidiProcessor_note);
+
+
+static void BM_MidiProcessor_controller(benchmark::State& state)
+{
+    Lfq_u32  qnote(256);
+    Lfq_u8   qmidi(1024);
+    uint16_t midimap[16];
+    int      n = 0;
+
+    for (int i = 0; i < 16; i++) midimap[i] = (7 << 12) | i;
+    for (auto _ : state) {
+        MidiProcessor::process_midi_event(0xB0, MIDICTL_SWELL, n, 0,
+                                          midimap, nullptr, &qnote, &qmidi);
+        qmidi.read_commit(qmidi.read_avail());
+        n = (n + 1) & 127;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MidiProcessor_controller);
+
+
+// An audio backend without a device, with D divisions of R ranks
+// each, to time the key routing from the keymap to the ranks.
+class BenchBackend : public AudioBackend
+{
+public:
+    BenchBackend(int ndivis, int nranks) : AudioBackend("bench", &qnote, &qcomm)
+    {
+        init_audio();
+        for (int d = 0; d < ndivis; d++) {
+            _divisp[d] = new Division(_asectp[d % NASECT], (float) _fsamp);
+            for (int r = 0; r < nranks; r++) {
+                ranks.push_back(make_rank(nullptr));
+                _divisp[d]->set_rank(r, ranks.back().get(), 'C', 0);
+                _divisp[d]->set_rank_mask(r, d % NKEYBD);
+            }
+        }
+        _ndivis = ndivis;
+    }
+
+    ~BenchBackend() override
+    {
+        for (int d = 0; d < _ndivis; d++) delete _divisp[d];
+    }
+
+    void start() override {}
+    int relpri() const override { return 0; }
+    void thr_main() override {}
+
+    void keys1() { proc_keys1(); }
+    void keys2() { proc_keys2(); }
+    void mark(int r)
+    {
+        for (int d = 0; d < _ndivis; d++) _divisp[d]->set_rank_mask(r, d % NKEYBD);
+    }
+
+    Lfq_u32 qnote{256};
+    Lfq_u32 qcomm{256};
+    std::vector<std::unique_ptr<Rankwave>> ranks;
+};
+
+
+// proc_keys1: one key changes per cycle on every keyboard.
+static void BM_AudioBackend_proc_keys1(benchmark::State& state)
+{
+    BenchBackend B(state.range(0), state.range(1));
+    int          n = 0;
+
+    for (auto _ : state) {
+        for (int k = 0; k < NKEYBD; k++) {
+            if (n & 1) B.key_off(n >> 1, k);
+            else       B.key_on(n >> 1, k);
+        }
+        B.keys1();
+        n = (n + 1) % (2 * NNOTES);
+    }
+}
+BENCHMARK(BM_AudioBackend_proc_keys1)->Args({1, 4})->Args({4, 8})->Args({8, 16});
+
+
+// proc_keys2: every rank has its mask changed, so all keys
+// are rescanned, as after a stop change. Setting the masks is
+// included, it is small compared to the rescan.
+static void BM_AudioBackend_proc_keys2(benchmark::State& state)
+{
+    BenchBackend B(state.range(0), state.range(1));
+
+    for (int n = 0; n < NNOTES; n += 5) B.key_on(n, 0);
+    B.keys1();
+    for (auto _ : state) {
+        for (int r = 0; r < state.range(1); r++) B.mark(r);
+        B.keys2();
+    }
+}
+BENCHMARK(BM_AudioBackend_proc_keys2)->Args({1, 4})->Args({4, 8})->Args({8, 16});
+
+
+BENCHMARK_MAIN();
@@ -19,6 +19,7 @@
 
 
 #include <string.h>
+#include <math.h>
 #include "global.h"
 #include "addsynth.h"
 
@@ -338,3 +339,121 @@ int Addsynth::load (const char *sdir)
 }
 
 
+static int gcd (int a, int b)
+{
+    int t;
+
+    while (b)
+    {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+
+static float nval (const N_func *F, int k)
+{
+    return F->vi ((k > 6 * M) ? 6 * M : k);
+}
+
+
+static float hval (const HN_func *F, int h, int k)
+{
+    return F->vi (h, (k > 6 * M) ? 6 * M : k);
+}
+
+
+// Combines the ranks of a mixture into a single one, each key then
+// plays one pipe instead of n. The pitch is the largest common divisor
+// of those of the ranks, which add their harmonics at multiples of it.
+// Harmonics beyond N_HARM are lost. Pipe parameters (attack, release,
+// instability) are those of the first rank. Returns non-zero if the
+// ranks have no common note range or pitch.
+
+int Addsynth::mix (Addsynth *const *S, int n)
+{
+    int    i, j, h, k, d, fd, fn, mj;
+    int    m [N_MIXT];
+    float  a [N_HARM][N_NOTE];
+    float  b [N_HARM][N_NOTE];
+    float  v, g;
+    const  Addsynth *A;
+
+    if ((n < 1) || (n > N_MIXT)) return 1;
+    reset ();
+    for (j = 0; j < n; j++)
+    {
+        if (S [j]->_n0 > _n0) _n0 = S [j]->_n0;
+        if (S [j]->_n1 < _n1) _n1 = S [j]->_n1;
+    }
+    if (_n0 > _n1) return 1;
+
+    // Common pitch fn / fd.
+    for (j = 0, fd = 1; j < n; j++) fd = fd / gcd (fd, S [j]->_fd) * S [j]->_fd;
+    for (j = 0, fn = 0; j < n; j++) fn = gcd (fn, S [j]->_fn * (fd / S [j]->_fd));
+    if (fn <= 0) return 1;
+    k = gcd (fn, fd);
+    _fn = fn / k;
+    _fd = fd / k;
+    for (j = 0; j < n; j++)
+    {
+        m [j] = S [j]->_fn * _fd / (S [j]->_fd * _fn);
+        if (m [j] > N_HARM) return 1;
+    }
+
+    A = S [0];
+    d = _n0 - A->_n0;
+    for (i = 0; i <= M; i++)
+    {
+        k = 6 * i + d;
+        _n_vol.setv (i, 0.0f);
+        _n_off.setv (i, nval (&A->_n_off, k) / m [0]);
+        _n_ran.setv (i, nval (&A->_n_ran, k) / m [0]);
+        _n_ins.setv (i, nval (&A->_n_ins, k));
+        _n_att.setv (i, nval (&A->_n_att, k));
+        _n_atd.setv (i, nval (&A->_n_atd, k));
+        _n_dct.setv (i, nval (&A->_n_dct, k));
+        _n_dcd.setv (i, nval (&A->_n_dcd, k));
+    }
+
+    // Add the amplitudes of the harmonics that coincide, the other
+    // parameters are taken from the strongest one.
+    memset (a, 0, sizeof (a));
+    memset (b, 0, sizeof (b));
+    for (j = 0; j < n; j++)
+    {
+        A = S [j];
+        mj = m [j];
+        d = _n0 - A->_n0;
+        for (h = 0; (h + 1) * mj <= N_HARM; h++)
+        {
+            for (i = 0; i <= M; i++)
+            {
+                k = 6 * i + d;
+                v = hval (&A->_h_lev, h, k);
+                if (v < -80.0f) continue;
+                g = exp2f (0.1661f * (nval (&A->_n_vol, k) + v));
+                a [(h + 1) * mj - 1][i] += g;
+                if (g > b [(h + 1) * mj - 1][i])
+                {
+                    b [(h + 1) * mj - 1][i] = g;
+                    _h_ran.setv ((h + 1) * mj - 1, i, hval (&A->_h_ran, h, k));
+                    _h_att.setv ((h + 1) * mj - 1, i, hval (&A->_h_att, h, k));
+                    _h_atp.setv ((h + 1) * mj - 1, i, hval (&A->_h_atp, h, k));
+                }
+            }
+        }
+    }
+    for (h = 0; h < N_HARM; h++)
+    {
+        for (i = 0; (i <= M) && (a [h][i] == 0); i++);
+        if (i > M) continue;
+        for (i = 0; i <= M; i++)
+        {
+            _h_lev.setv (h, i, (a [h][i] > 0) ? log2f (a [h][i]) / 0.1661f : -100.0f);
+        }
+    }
+    return 0;
+}
@@ -28,6 +28,7 @@
 
 #define N_NOTE 11
 #define N_HARM 64
+#define N_MIXT 8
 #define NOTE_MIN 36
 #define NOTE_MAX 96
 
@@ -95,6 +96,7 @@ public:
     void reset (void);
     int save (const char *sdir);
     int load (const char *sdir);
+    int mix (Addsynth *const *S, int n);
 
     char       _filename [64];
     char       _stopname [32];
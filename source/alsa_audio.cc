@@ -20,6 +20,7 @@
 
 #include "alsa_audio.h"
 #include "messages.h"
+#include "tracer.h"
 
 
 AlsaAudio::AlsaAudio (const char *appname, Lfq_u32 *qnote, Lfq_u32 *qcomm) :
@@ -76,6 +77,9 @@ void AlsaAudio::start (void)
     M->_fsize  = _fsize;
     M->_instrpar = _audiopar;
     for (i = 0; i < _nasect; i++) M->_asectpar [i] = _asectp [i]->get_apar ();
+    M->_perfstats = &_perfstats;
+    M->_capture = &_capture;
+    M->_qdead = &_qdead;
     send_event(TO_MODEL, M);
 }
 
@@ -94,11 +98,19 @@ void AlsaAudio::thr_main (void)
 {
     unsigned long k;
 
+    Tracer::thread ("audio");
     _alsa_handle->pcm_start ();
 
     while (_running)
     {
         k = _alsa_handle->pcm_wait ();
+        if (_alsa_handle->state ())
+        {
+            _perfstats.xrun ();
+            Tracer::trigger ();
+        }
+        _perfstats.cycle_begin ();
+        Tracer::begin ("cycle");
         proc_queue (_qnote);
         proc_queue (_qcomm);
         proc_keys1 ();
@@ -112,6 +124,8 @@ void AlsaAudio::thr_main (void)
             k -= _fsize;
         }
         proc_mesg ();
+        Tracer::end ("cycle");
+        _perfstats.cycle_end ();
     }
 
     _alsa_handle->pcm_stop ();
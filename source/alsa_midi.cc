@@ -20,11 +20,13 @@
 
 #include "alsa_midi.h"
 #include "midi_processor.h"
+#include "tracer.h"
 
 
 AlsaMidi::AlsaMidi (Lfq_u32 *qnote, Lfq_u8 *qmidi, uint16_t *midimap, const char *appname) :
     MidiBackend ("AlsaMidi", qnote, qmidi, midimap, appname),
-    _handle (0)
+    _handle (0),
+    _qlocal (1024)
 {
 }
 
@@ -106,47 +108,93 @@ void AlsaMidi::close_midi (void)
 void AlsaMidi::proc_midi (void) 
 {
     snd_seq_event_t  *E;
-    int              c, n, p, t, v;
+    int              c, k, n, t;
+    bool             stop;
 
-    // Read and process MIDI commands from the ALSA port using MidiProcessor
+    // Wait for an event, then take all that are pending as one
+    // batch. A read from the sequencer fills its input buffer
+    // with all events available, so a batch normally costs one
+    // read. The batch is converted to raw MIDI before any of it
+    // is processed.
 
-    while (true)
+    stop = false;
+    while (! stop)
     {
-	snd_seq_event_input(_handle, &E);
-        c = E->data.note.channel;               
-        t = E->type;
-
-	switch (t)
-	{ 
-	case SND_SEQ_EVENT_NOTEON:
-	case SND_SEQ_EVENT_NOTEOFF:
-	    n = E->data.note.note;
-	    v = E->data.note.velocity;
-            
-            // Convert ALSA event to raw MIDI format for MidiProcessor
-            uint8_t status = ((t == SND_SEQ_EVENT_NOTEON) ? 0x90 : 0x80) | c;
-            MidiProcessor::process_midi_event(status, n, v, c, _midimap, this, _qnote, _qmidi);
-	    break;
-
-	case SND_SEQ_EVENT_CONTROLLER:
-	    p = E->data.control.param;
-	    v = E->data.control.value;
-            
-            // Convert to controller MIDI message
-            uint8_t ctrl_status = 0xB0 | c;
-            MidiProcessor::process_midi_event(ctrl_status, p, v, c, _midimap, this, _qnote, _qmidi);
-	    break;
-
-	case SND_SEQ_EVENT_PGMCHANGE:
-            // Program change - convert to MIDI format  
-            uint8_t pgm_status = 0xC0 | c;
-            MidiProcessor::process_midi_event(pgm_status, E->data.control.value, 0, c, _midimap, this, _qnote, _qmidi);
-	    break;
-
-	case SND_SEQ_EVENT_USR0:
-	    // User event, terminates this thread if we sent it.
-	    if (E->source.client == _client) return;
-            break;
-	}
+        n = 0;
+        k = 0;
+        do
+        {
+            if (snd_seq_event_input_pending (_handle, 0) == 0) k++;
+            if (snd_seq_event_input (_handle, &E) < 0) continue;
+            c = E->data.note.channel & 15;
+            t = E->type;
+            switch (t)
+            {
+            case SND_SEQ_EVENT_NOTEON:
+            case SND_SEQ_EVENT_NOTEOFF:
+                _batch [n][0] = ((t == SND_SEQ_EVENT_NOTEON) ? 0x90 : 0x80) | c;
+                _batch [n][1] = E->data.note.note;
+                _batch [n][2] = E->data.note.velocity;
+                n++;
+                break;
+
+            case SND_SEQ_EVENT_CONTROLLER:
+                _batch [n][0] = 0xB0 | c;
+                _batch [n][1] = E->data.control.param;
+                _batch [n][2] = E->data.control.value;
+                n++;
+                break;
+
+            case SND_SEQ_EVENT_PGMCHANGE:
+                _batch [n][0] = 0xC0 | c;
+                _batch [n][1] = E->data.control.value;
+                _batch [n][2] = 0;
+                n++;
+                break;
+
+            case SND_SEQ_EVENT_USR0:
+                // User event, terminates this thread if we sent it.
+                if (E->source.client == _client) stop = true;
+                break;
+            }
+        }
+        while (   (n < NBATCH) && ! stop
+               && (snd_seq_event_input_pending (_handle, 0) > 0));
+
+        Tracer::begin ("midi_batch", n);
+        publish (n, k);
+        Tracer::end ("midi_batch", n);
     }
-}
\ No newline at end of file
+}
+
+
+void AlsaMidi::publish (int nev, int nread)
+{
+    int  i, n;
+
+    // Process a batch. Swell and tremulant controllers are merged,
+    // and everything for the model is written to the local queue
+    // first, then moved to qmidi with a single commit. The model
+    // is woken once per batch, and only if it has work.
+
+    for (i = 0; i < nev; i++)
+    {
+        MidiProcessor::process_midi_event (_batch [i][0], _batch [i][1], _batch [i][2], _batch [i][0] & 15,
+                                           _midimap, this, _qnote, &_qlocal, &_merge);
+    }
+    _merge.flush (&_qlocal);
+
+    n = _qlocal.read_avail ();
+    i = _qmidi->write_avail ();
+    if (n > i) n = i - i % 3;
+    for (i = 0; i < n; i++) _qmidi->write (i, _qlocal.read (i));
+    if (n) _qmidi->write_commit (n);
+    _qlocal.read_commit (_qlocal.read_avail ());
+    if (n) send_event (EV_QMIDI, 1);
+
+    if (_perfstats)
+    {
+        _perfstats->add_ctl_merge (_merge.merged ());
+        _perfstats->add_midi (nev, nread, n > 0, Perfstats::tnow ());
+    }
+}
@@ -45,7 +45,14 @@ protected:
 
 private:
 
+    enum { NBATCH = 64 };
+
+    void publish (int nev, int nread);
+
     snd_seq_t      *_handle;
+    uint8_t         _batch [NBATCH][3];  // input events as raw MIDI
+    Lfq_u8          _qlocal;             // qmidi entries of a batch
+    MidiProcessor::Coalescer  _merge;
 };
 
 
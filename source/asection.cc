@@ -46,6 +46,12 @@ void Diffuser::fini (void)
 }
 
 
+void Diffuser::clear (void)
+{
+    memset (_data, 0, _size * sizeof (float));
+}
+
+
 float Asection::_refl [16] =
 {
     0.250f, 0.440f, 0.615f, 0.940f,
@@ -62,6 +68,8 @@ Asection::Asection (float fsam) : _fsam (fsam)
 
     _offs0 = 0;
     _sw = _sx = _sy = 0.0f;
+    _m = _mt = 1.0f;
+    _dfull = true;
     _dif0.init ((int)(fsam * 0.017f), 0.5f);
     _dif1.init ((int)(fsam * 0.029f), 0.5f);
     _dif2.init ((int)(fsam * 0.023f), 0.5f);
@@ -95,6 +103,21 @@ Asection::~Asection (void)
 }
 
 
+void Asection::set_fsam (float fsam)
+{
+    // Not realtime safe. Call set_size() afterwards.
+    _fsam = fsam;
+    _dif0.fini ();
+    _dif1.fini ();
+    _dif2.fini ();
+    _dif3.fini ();
+    _dif0.init ((int)(fsam * 0.017f), 0.5f);
+    _dif1.init ((int)(fsam * 0.029f), 0.5f);
+    _dif2.init ((int)(fsam * 0.023f), 0.5f);
+    _dif3.init ((int)(fsam * 0.013f), 0.5f);
+}
+
+
 void Asection::set_size (float time)
 {
     int   i, d;
@@ -148,7 +171,11 @@ void Asection::process (float vol, float *W, float *X, float *Y, float *R)
 
     gr = vol * _apar [REFLECT]._val;
     p = _base;
-    for (i = 0; i < PERIOD; i++)
+    if ((_m < 1) || (_mt < 1))
+    {
+        reflect_light (gr, W, x, y);
+    }
+    else for (i = 0; i < PERIOD; i++)
     {
         t0 = _dif0.process (p [_offs [1]] + p [_offs  [5]] + p [_offs [11]] + p [_offs [15]] + 1e-20f);
         t1 = _dif1.process (p [_offs [0]] + p [_offs  [4]] + p [_offs [10]] + p [_offs [14]] + 1e-20f);
@@ -182,3 +209,61 @@ void Asection::process (float vol, float *W, float *X, float *Y, float *R)
     memset (p + 3 * N, 0, PERIOD * sizeof (float));
 }
 
+
+
+void Asection::reflect_light (float gr, float *W, float *x, float *y)
+{
+    int     i;
+    float   m, d, s;
+    float   *p, t0, t1, t2, t3;
+
+    // Crossfade between the diffused and the plain reflections,
+    // once faded out the diffusers are not run at all. When they
+    // start again from empty, their input is faded in instead of
+    // their output, so the delayed signal does not appear with a
+    // step.
+    d = 20.0f / _fsam;
+    m = _m;
+    if ((m == 0) && (_mt > 0))
+    {
+        _dif0.clear ();
+        _dif1.clear ();
+        _dif2.clear ();
+        _dif3.clear ();
+    }
+    p = _base;
+    for (i = 0; i < PERIOD; i++)
+    {
+        if      (m < _mt) { m += d; if (m > _mt) m = _mt; }
+        else if (m > _mt) { m -= d; if (m < _mt) m = _mt; }
+        t0 = p [_offs [1]] + p [_offs  [5]] + p [_offs [11]] + p [_offs [15]] + 1e-20f;
+        t1 = p [_offs [0]] + p [_offs  [4]] + p [_offs [10]] + p [_offs [14]] + 1e-20f;
+        t2 = p [_offs [2]] + p [_offs  [6]] + p [_offs  [8]] + p [_offs [12]] + 2e-20f;
+        t3 = p [_offs [3]] + p [_offs  [7]] + p [_offs  [9]] + p [_offs [13]] + 2e-20f;
+        p++;
+        if (m == 1) _dfull = true;
+        if (_dfull)
+        {
+            t0 += m * (_dif0.process (t0) - t0);
+            t1 += m * (_dif1.process (t1) - t1);
+            t2 += m * (_dif2.process (t2) - t2);
+            t3 += m * (_dif3.process (t3) - t3);
+        }
+        else if (m > 0)
+        {
+            t0 += _dif0.process (m * t0) - m * t0;
+            t1 += _dif1.process (m * t1) - m * t1;
+            t2 += _dif2.process (m * t2) - m * t2;
+            t3 += _dif3.process (m * t3) - m * t3;
+        }
+        if (m == 0) _dfull = false;
+        s = t0 + t1 + t2 + t3;
+        _sw += 0.5f * (s - _sw);
+        _sx += 0.5f * (0.4f * (t0 + t3) + 0.6f * (t2 + t1) - _sx);
+        _sy += 0.5f * (0.9f * (t0 - t3) + 0.8f * (t2 - t1) - _sy);
+        W [i] += gr * _sw;
+        x [i] += gr * _sx;
+        y [i] += gr * _sy;
+    }
+    _m = m;
+}
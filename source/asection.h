@@ -36,6 +36,7 @@ public:
 
     void init (int size, float c);
     void fini (void);
+    void clear (void);
     int  size (void) { return _size; }
     float process (float x)
     {
@@ -68,14 +69,21 @@ public:
     Fparm *get_apar (void) { return _apar; }
 
     void set_size (float size);
+    void set_fsam (float fsam);
     void process (float vol, float *W, float *X, float *Y, float *R);
 
+    // In light mode the reflections bypass the diffusers.
+    void set_light (bool light) { _mt = light ? 0.0f : 1.0f; }
+    bool light (void) const { return _mt < 1.0f; }
+
     static float _refl [16];
 
 private:
 
     enum { AZIMUTH, STWIDTH, DIRECT, REFLECT, REVERB };
 
+    void reflect_light (float gr, float *W, float *x, float *y);
+
     int      _offs0;
     int      _offs [16];
     float    _fsam;
@@ -83,6 +91,9 @@ private:
     float    _sw;
     float    _sx;
     float    _sy;
+    float    _m;
+    float    _mt;
+    bool     _dfull;  // diffusers have seen the full input
     Diffuser _dif0;
     Diffuser _dif1;
     Diffuser _dif2;
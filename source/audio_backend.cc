@@ -22,6 +22,7 @@
 #include <cstring>
 #include "audio_backend.h"
 #include "messages.h"
+#include "tracer.h"
 
 
 // Static members from original Audio class
@@ -45,7 +46,10 @@ AudioBackend::AudioBackend (const char *appname, Lfq_u32 *qnote, Lfq_u32 *qcomm)
     _nasect (0),
     _ndivis (0),
     _revsize (0.075f),
-    _revtime (4.0f)
+    _revtime (4.0f),
+    _qdead (1024),
+    _nsync (0),
+    _nflush (0)
 {
     // Initialize MIDI map and key map
     for (int i = 0; i < 16; i++) _midimap [i] = 0;
@@ -59,6 +63,11 @@ AudioBackend::AudioBackend (const char *appname, Lfq_u32 *qnote, Lfq_u32 *qcomm)
 AudioBackend::~AudioBackend (void)
 {
     for (int i = 0; i < _nasect; i++) delete _asectp [i];
+    while (_qdead.read_avail ())
+    {
+        delete (Rankwave *) _qdead.read (0);
+        _qdead.read_commit (1);
+    }
     // Note: _outbuf cleanup is handled by derived classes since allocation varies
 }
 
@@ -92,12 +101,16 @@ void AudioBackend::init_audio (void)
         _asectp [i]->set_size (_revsize);
     }
     _hold = KMAP_ALL;
+    _perfstats.init (_fsamp, _fsize);
+    _quality.init (_fsamp, _fsize);
+    _capture.init (_fsamp, _nplay, _nasect);
 }
 
 
 void AudioBackend::proc_queue (Lfq_u32 *Q)
 {
     int       c, i, j, k, n;
+    int64_t   t;
     uint32_t  q;
     uint16_t  m;
     union     { uint32_t i; float f; } u;
@@ -105,6 +118,8 @@ void AudioBackend::proc_queue (Lfq_u32 *Q)
     // Execute commands from the model thread (qcomm),
     // or from the midi thread (qnote).
 
+    t = Perfstats::tnow ();
+    Tracer::begin ("proc_queue");
     n = Q->read_avail ();
     while (n > 0)
     {
@@ -184,7 +199,13 @@ void AudioBackend::proc_queue (Lfq_u32 *Q)
 
         case 17:
             // Per-division performance controllers.
-            if (n < 2) return;
+            if (n < 2)
+            {
+                // Second word not yet available.
+                _perfstats.stage_add (Perfstats::QUEUE, Perfstats::tnow () - t);
+                Tracer::end ("proc_queue");
+                return;
+            }
             u.i = Q->read (1);
             Q->read_commit (2);
             switch (i)
@@ -200,14 +221,19 @@ void AudioBackend::proc_queue (Lfq_u32 *Q)
         }
         n = Q->read_avail ();
     }
+    _perfstats.stage_add (Perfstats::QUEUE, Perfstats::tnow () - t);
+    Tracer::end ("proc_queue");
 }
 
 
 void AudioBackend::proc_keys1 (void)
 {
     int       d, n;
+    int64_t   t;
     uint16_t  m;
 
+    t = Perfstats::tnow ();
+    Tracer::begin ("proc_keys1");
     for (n = 0; n < NNOTES; n++)
     {
         m = _keymap [n];
@@ -221,29 +247,55 @@ void AudioBackend::proc_keys1 (void)
             }
         }
     }
+    _perfstats.stage_add (Perfstats::KEYS, Perfstats::tnow () - t);
+    Tracer::end ("proc_keys1");
 }
 
 
 void AudioBackend::proc_keys2 (void)
 {
-    int d;
+    int      d;
+    int64_t  t;
 
+    t = Perfstats::tnow ();
+    Tracer::begin ("proc_keys2");
     for (d = 0; d < _ndivis; d++)
     {
         _divisp [d]->update (_keymap);
     }
+    _perfstats.stage_add (Perfstats::KEYS, Perfstats::tnow () - t);
+    Tracer::end ("proc_keys2");
+}
+
+
+void AudioBackend::adapt_quality (void)
+{
+    int  j, q;
+
+    // Changes are crossfaded by the reverb and sections.
+    q = _quality.update (_perfstats.load ());
+    if (q == (int) _perfstats.quality ()) return;
+    _reverb.set_light (q >= Quality::LIGHT_REVERB);
+    for (j = 0; j < _nasect; j++) _asectp [j]->set_light (q >= Quality::LIGHT_ALL);
+    _perfstats.set_quality (q);
 }
 
 
 void AudioBackend::proc_synth (int nframes)
 {
-    int           j, k;
+    int           i, j, k, n, m;
+    int64_t       t0, t1;
     float         W [PERIOD];
     float         X [PERIOD];
     float         Y [PERIOD];
     float         Z [PERIOD];
     float         R [PERIOD];
+    float         T [3][PERIOD];
+    float         S [2 * NASECT][PERIOD];
     float        *out [8];
+    float        *stp [2 * NASECT];
+    bool          cap, stems;
+    float         st;
 
     if (fabsf (_revsize - _audiopar [REVSIZE]._val) > 0.001f)
     {
@@ -258,6 +310,12 @@ void AudioBackend::proc_synth (int nframes)
          _reverb.set_t60lo (_revtime * 1.50f, 250.0f);
          _reverb.set_t60hi (_revtime * 0.50f, 3e3f);
     }
+    adapt_quality ();
+
+    // Read once, the model may start or stop the capture at any time.
+    cap = _capture.active ();
+    stems = cap && _capture.stems ();
+    for (j = 0; j < 2 * _nasect; j++) stp [j] = S [j];
 
     for (j = 0; j < _nplay; j++) out [j] = _outbuf [j];
     for (k = 0; k < nframes; k += PERIOD)
@@ -271,9 +329,51 @@ void AudioBackend::proc_synth (int nframes)
         memset (Z, 0, PERIOD * sizeof (float));
         memset (R, 0, PERIOD * sizeof (float));
 
-        for (j = 0; j < _ndivis; j++) _divisp [j]->process ();
-        for (j = 0; j < _nasect; j++) _asectp [j]->process (_audiopar [VOLUME]._val, W, X, Y, R);
+        t0 = Perfstats::tnow ();
+        for (j = n = 0; j < _ndivis; j++)
+        {
+            Tracer::begin ("division", j);
+            n += _divisp [j]->process ();
+            Tracer::end ("division", j);
+        }
+        _perfstats.set_voices (n);
+        m = _budget.limit ();
+        if (m && (n > m))
+        {
+            // Fade out the least audible pipes, starting next period.
+            _budget.begin (n - m);
+            for (j = 0; j < _ndivis; j++) _divisp [j]->offer (&_budget);
+            _perfstats.add_culls (_budget.cull ());
+        }
+        t1 = Perfstats::tnow ();
+        _perfstats.stage_add (Perfstats::DIVIS, t1 - t0);
+        for (j = 0; j < _nasect; j++)
+        {
+            Tracer::begin ("asection", j);
+            if (stems)
+            {
+                // Keep the dry output of each section apart.
+                memset (T, 0, 3 * PERIOD * sizeof (float));
+                _asectp [j]->process (_audiopar [VOLUME]._val, T [0], T [1], T [2], R);
+                st = _audiopar [STPOSIT]._val;
+                for (i = 0; i < PERIOD; i++)
+                {
+                    W [i] += T [0][i];
+                    X [i] += T [1][i];
+                    Y [i] += T [2][i];
+                    S [2 * j][i]     = T [0][i] + st * T [1][i] + T [2][i];
+                    S [2 * j + 1][i] = T [0][i] + st * T [1][i] - T [2][i];
+                }
+            }
+            else _asectp [j]->process (_audiopar [VOLUME]._val, W, X, Y, R);
+            Tracer::end ("asection", j);
+        }
+        t0 = Perfstats::tnow ();
+        _perfstats.stage_add (Perfstats::ASECT, t0 - t1);
+        Tracer::begin ("reverb");
         _reverb.process (PERIOD, _audiopar [VOLUME]._val, R, W, X, Y, Z);
+        Tracer::end ("reverb");
+        _perfstats.stage_add (Perfstats::REVERB, Perfstats::tnow () - t0);
 
         if (_bform)
         {
@@ -293,6 +393,7 @@ void AudioBackend::proc_synth (int nframes)
                 out [1][j] = W [j] + _audiopar [STPOSIT]._val * X [j] - Y [j];
                }
         }
+        if (cap) _capture.write (stems ? stp : out, stems ? 2 * _nasect : _nplay, PERIOD);
         for (j = 0; j < _nplay; j++) out [j] += PERIOD;
     }
 }
@@ -314,6 +415,7 @@ void AudioBackend::proc_mesg (void)
                 M_new_divis  *X = (M_new_divis *) M;
                 Division     *D = new Division (_asectp [X->_asect], (float) _fsamp);
                 D->set_div_mask (X->_keybd);
+                D->set_dead (&_qdead);
                 D->set_swell (X->_swell);
                 D->set_tfreq (X->_tfreq);
                 D->set_tmodd (X->_tmodd);
@@ -323,23 +425,99 @@ void AudioBackend::proc_mesg (void)
             }
             case MT_CALC_RANK:
             case MT_LOAD_RANK:
+            case MT_DROP_RANK:
             {
                 M_def_rank *X = (M_def_rank *) M;
-                _divisp [X->_divis]->set_rank (X->_rank, X->_rwave,  X->_synth->_pan, X->_synth->_del);
+                if (X->_unit >= 0) _divisp [X->_divis]->set_unit (X->_rank, X->_rwave, X->_unit, X->_offs);
+                else _divisp [X->_divis]->set_rank (X->_rank, X->_rwave,  X->_synth->_pan, X->_synth->_del);
+                send_event (TO_MODEL, M);
+                M = 0;
+                break;
+            }
+            case MT_NEW_INSTR:
+            {
+                // A new instrument, all its ranks are in place.
+                // The old divisions go back to the model.
+                M_new_instr  *X = (M_new_instr *) M;
+                Division     *D;
+                int           i, n;
+
+                for (i = 0; i < NDIVIS; i++)
+                {
+                    D = X->_divisp [i];
+                    if (D)
+                    {
+                        D->set_asect (_asectp [X->_asect [i]]);
+                        D->set_dead (&_qdead);
+                    }
+                    if (_divisp [i]) _divisp [i]->set_dead (0);
+                    X->_divisp [i] = _divisp [i];
+                    _divisp [i] = D;
+                }
+                n = _ndivis;
+                _ndivis = X->_ndivis;
+                X->_ndivis = n;
                 send_event (TO_MODEL, M);
                 M = 0;
                 break;
             }
             case MT_AUDIO_SYNC:
+                _nsync++;
                 send_event (TO_MODEL, M);
                 M = 0;
                 break;
+
+            case MT_AUDIO_FLUSH:
+                // The model has executed all pending qmidi commands.
+                _nflush++;
+                break;
         }
         if (M) M->recover ();
     }
 }
 
 
+void AudioBackend::flush_model (void)
+{
+    int n;
+
+    // The model returns the message after it has run proc_qmidi().
+    // Any resulting commands are then in qcomm.
+    n = _nflush;
+    send_event (TO_MODEL, new M_pooled (MT_AUDIO_FLUSH));
+    while (_running && (_nflush == n))
+    {
+        get_event (1 << FM_MODEL | 1 << FM_SLAVE);
+        proc_mesg ();
+    }
+}
+
+
+void AudioBackend::set_fsamp (unsigned int fsamp)
+{
+    int i;
+
+    _fsamp = fsamp;
+    _reverb.fini ();
+    _reverb.init (_fsamp);
+    _reverb.set_delay (_revsize);
+    _reverb.set_t60mf (_revtime);
+    _reverb.set_t60lo (_revtime * 1.50f, 250.0f);
+    _reverb.set_t60hi (_revtime * 0.50f, 3e3f);
+    for (i = 0; i < _nasect; i++)
+    {
+        _asectp [i]->set_fsam ((float) _fsamp);
+        _asectp [i]->set_size (_revsize);
+    }
+    for (i = 0; i < _ndivis; i++) _divisp [i]->set_fsam ((float) _fsamp);
+    _perfstats.set_period (_fsamp, _fsize);
+    _quality.init (_fsamp, _fsize);
+    // A file has a single sample rate.
+    _capture.stop ();
+    _capture.set_fsamp (_fsamp);
+}
+
+
 // MidiProcessor::Handler implementation
 void AudioBackend::key_on(int note, int keyboard)
 {
@@ -28,6 +28,8 @@
 #include "division.h"
 #include "lfqueue.h"
 #include "reverb.h"
+#include "perfstats.h"
+#include "capture.h"
 #include "global.h"
 #include "midi_processor.h"
 
@@ -48,6 +50,10 @@ public:
     uint16_t    *midimap (void) const { return (uint16_t *) _midimap; }
     int  policy (void) const { return _policy; }
     int  abspri (void) const { return _abspri; }
+    Perfstats   *perfstats (void) { return &_perfstats; }
+    Capture     *capture (void) { return &_capture; }
+    Voicebudget *voicebudget (void) { return &_budget; }
+    Quality     *quality (void) { return &_quality; }
 
     // MidiProcessor::Handler implementation
     void key_on(int note, int keyboard) override;
@@ -69,6 +75,15 @@ protected:
     void proc_keys1 (void);
     void proc_keys2 (void);
     void proc_mesg (void);
+    void adapt_quality (void);
+
+    // Have the model execute pending qmidi commands now, and wait
+    // for it. Only for backends that are allowed to block.
+    void flush_model (void);
+
+    // Change the sample rate. Not realtime safe, the caller must
+    // ensure no cycle is running.
+    void set_fsamp (unsigned int fsamp);
 
     // Virtual method for backend-specific MIDI processing during synthesis
     virtual void proc_midi_during_synth (int frame_time) {}
@@ -96,6 +111,13 @@ protected:
     Fparm           _audiopar [4];
     float           _revsize;
     float           _revtime;
+    Perfstats       _perfstats;
+    Capture         _capture;
+    Lfq_ptr         _qdead;
+    Voicebudget     _budget;
+    Quality         _quality;
+    int             _nsync;
+    int             _nflush;
 
     static const char *_ports_stereo [2];
     static const char *_ports_ambis1 [4];
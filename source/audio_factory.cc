@@ -28,6 +28,9 @@
 #include "jack_audio.h"
 #endif
 
+#include "dummy_audio.h"
+#include "offline_audio.h"
+
 
 AudioBackend* AudioFactory::create(AudioType type, const char* appname, 
                                    Lfq_u32* note_queue, Lfq_u32* comm_queue)
@@ -44,6 +47,12 @@ AudioBackend* AudioFactory::create(AudioType type, const char* appname,
         return new JackAudio(appname, note_queue, comm_queue);
 #endif
 
+    case AudioType::DUMMY:
+        return new DummyAudio(appname, note_queue, comm_queue);
+
+    case AudioType::OFFLINE:
+        return new OfflineAudio(appname, note_queue, comm_queue);
+
     default:
         return nullptr;
     }
@@ -71,6 +80,25 @@ AudioBackend* AudioFactory::create_jack(const char* appname,
 }
 #endif
 
+AudioBackend* AudioFactory::create_dummy(const char* appname, 
+                                         Lfq_u32* note_queue, Lfq_u32* comm_queue,
+                                         const DummyConfig& config)
+{
+    DummyAudio* audio = new DummyAudio(appname, note_queue, comm_queue);
+    audio->init_dummy(config.fsamp, config.fsize, config.bform, config.midi);
+    return audio;
+}
+
+AudioBackend* AudioFactory::create_offline(const char* appname, 
+                                           Lfq_u32* note_queue, Lfq_u32* comm_queue,
+                                           const OfflineConfig& config)
+{
+    OfflineAudio* audio = new OfflineAudio(appname, note_queue, comm_queue);
+    audio->init_offline(config.midifile, config.outfile, config.fsamp, config.fsize,
+                        config.bform, config.form, config.qmidi);
+    return audio;
+}
+
 
 bool AudioFactory::is_available(AudioType type)
 {
@@ -86,6 +114,10 @@ bool AudioFactory::is_available(AudioType type)
         return true;
 #endif
 
+    case AudioType::DUMMY:
+    case AudioType::OFFLINE:
+        return true;
+
     default:
         return false;
     }
@@ -29,7 +29,9 @@
 enum class AudioType
 {
     ALSA,
-    JACK
+    JACK,
+    DUMMY,
+    OFFLINE
 };
 
 
@@ -48,6 +50,25 @@ struct JackConfig
     Lfq_u8* qmidi;
 };
 
+struct DummyConfig
+{
+    int fsamp;
+    int fsize;
+    bool bform;
+    bool midi;
+};
+
+struct OfflineConfig
+{
+    const char* midifile;
+    const char* outfile;
+    int fsamp;
+    int fsize;
+    bool bform;
+    int form;
+    Lfq_u8* qmidi;
+};
+
 class AudioFactory
 {
 public:
@@ -66,6 +87,16 @@ public:
                                     Lfq_u32* note_queue, Lfq_u32* comm_queue,
                                     const JackConfig& config);
 
+    // Create and initialize clock paced backend without a device
+    static AudioBackend* create_dummy(const char* appname, 
+                                     Lfq_u32* note_queue, Lfq_u32* comm_queue,
+                                     const DummyConfig& config);
+
+    // Create and initialize offline (MIDI file to audio file) backend
+    static AudioBackend* create_offline(const char* appname, 
+                                       Lfq_u32* note_queue, Lfq_u32* comm_queue,
+                                       const OfflineConfig& config);
+
     // Helper to determine available backend types
     static bool is_available(AudioType type);
 };
@@ -0,0 +1,318 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "audiofile.h"
+
+
+static void put_le16 (FILE *F, uint32_t v)
+{
+    fputc (v & 0xFF, F);
+    fputc ((v >> 8) & 0xFF, F);
+}
+
+
+static void put_le32 (FILE *F, uint32_t v)
+{
+    put_le16 (F, v & 0xFFFF);
+    put_le16 (F, v >> 16);
+}
+
+
+static void put_le64 (FILE *F, uint64_t v)
+{
+    put_le32 (F, (uint32_t) v);
+    put_le32 (F, (uint32_t)(v >> 32));
+}
+
+
+static void put_be32 (FILE *F, uint32_t v)
+{
+    fputc ((v >> 24) & 0xFF, F);
+    fputc ((v >> 16) & 0xFF, F);
+    fputc ((v >> 8) & 0xFF, F);
+    fputc (v & 0xFF, F);
+}
+
+
+static void put_be64 (FILE *F, uint64_t v)
+{
+    put_be32 (F, (uint32_t)(v >> 32));
+    put_be32 (F, (uint32_t) v);
+}
+
+
+Audiofile::Audiofile (void) :
+    _file (0),
+    _type (TYPE_NONE),
+    _form (FORM_NONE),
+    _chan (0),
+    _rate (0),
+    _bytes (0),
+    _nframes (0),
+    _dpos (0),
+    _buff (0)
+{
+}
+
+
+Audiofile::~Audiofile (void)
+{
+    close ();
+}
+
+
+int Audiofile::type_from_name (const char *path)
+{
+    const char *p;
+
+    p = strrchr (path, '.');
+    if (p && ! strcasecmp (p, ".wav")) return TYPE_WAV;
+    if (p && ! strcasecmp (p, ".w64")) return TYPE_W64;
+    if (p && ! strcasecmp (p, ".caf")) return TYPE_CAF;
+    return TYPE_NONE;
+}
+
+
+int Audiofile::form_from_name (const char *name)
+{
+    if (! strcmp (name, "16")) return FORM_16;
+    if (! strcmp (name, "24")) return FORM_24;
+    if (! strcmp (name, "32")) return FORM_32;
+    if (! strcmp (name, "float")) return FORM_FLOAT;
+    return FORM_NONE;
+}
+
+
+int Audiofile::open_write (const char *path, int type, int form, int chan, int rate)
+{
+    close ();
+    if ((type == TYPE_NONE) || (form == FORM_NONE) || (chan < 1) || (rate < 1)) return 1;
+    if (! (_file = fopen (path, "w"))) return 1;
+    setvbuf (_file, 0, _IOFBF, 1 << 20);
+    _type = type;
+    _form = form;
+    _chan = chan;
+    _rate = rate;
+    switch (form)
+    {
+    case FORM_16: _bytes = 2; break;
+    case FORM_24: _bytes = 3; break;
+    default:      _bytes = 4;
+    }
+    _nframes = 0;
+    _buff = new uint8_t [BUFFR * _chan * _bytes];
+    switch (type)
+    {
+    case TYPE_WAV: write_wav_header (); break;
+    case TYPE_W64: write_w64_header (); break;
+    default:       write_caf_header ();
+    }
+    _dpos = ftell (_file);
+    return 0;
+}
+
+
+void Audiofile::write_fmt_chunk (void)
+{
+    static const uint8_t guid [14] =
+        { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+    int  tag, ext;
+
+    // More than two channels requires WAVE_FORMAT_EXTENSIBLE. The
+    // channel mask is left zero, B-format has no speaker positions.
+    tag = (_form == FORM_FLOAT) ? 3 : 1;
+    ext = (_chan > 2);
+    put_le16 (_file, ext ? 0xFFFE : tag);
+    put_le16 (_file, _chan);
+    put_le32 (_file, _rate);
+    put_le32 (_file, _rate * _chan * _bytes);
+    put_le16 (_file, _chan * _bytes);
+    put_le16 (_file, 8 * _bytes);
+    if (ext)
+    {
+        put_le16 (_file, 22);
+        put_le16 (_file, 8 * _bytes);
+        put_le32 (_file, 0);
+        put_le16 (_file, tag);
+        fwrite (guid, 1, 14, _file);
+    }
+}
+
+
+void Audiofile::write_wav_header (void)
+{
+    fwrite ("RIFF", 1, 4, _file);
+    put_le32 (_file, 0);
+    fwrite ("WAVE", 1, 4, _file);
+    fwrite ("fmt ", 1, 4, _file);
+    put_le32 (_file, (_chan > 2) ? 40 : 16);
+    write_fmt_chunk ();
+    fwrite ("data", 1, 4, _file);
+    put_le32 (_file, 0);
+}
+
+
+// Sony Wave64 is WAV with 64-bit sizes and GUIDs for chunk ids.
+// Chunk sizes include the 24 byte header, chunks are 8-byte aligned.
+
+static const uint8_t w64_riff [16] =
+    { 'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00 };
+static const uint8_t w64_wave [16] =
+    { 'w', 'a', 'v', 'e', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+static const uint8_t w64_fmt [16] =
+    { 'f', 'm', 't', ' ', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+static const uint8_t w64_data [16] =
+    { 'd', 'a', 't', 'a', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+
+
+void Audiofile::write_w64_header (void)
+{
+    fwrite (w64_riff, 1, 16, _file);
+    put_le64 (_file, 0);
+    fwrite (w64_wave, 1, 16, _file);
+    fwrite (w64_fmt, 1, 16, _file);
+    put_le64 (_file, (_chan > 2) ? 64 : 40);
+    write_fmt_chunk ();
+    fwrite (w64_data, 1, 16, _file);
+    put_le64 (_file, 0);
+}
+
+
+void Audiofile::write_caf_header (void)
+{
+    union { double d; uint64_t u; } r;
+
+    fwrite ("caff", 1, 4, _file);
+    put_be32 (_file, 0x00010000);
+    fwrite ("desc", 1, 4, _file);
+    put_be64 (_file, 32);
+    r.d = _rate;
+    put_be64 (_file, r.u);
+    fwrite ("lpcm", 1, 4, _file);
+    // Flags: 1 = float, 2 = little-endian.
+    put_be32 (_file, (_form == FORM_FLOAT) ? 3 : 2);
+    put_be32 (_file, _chan * _bytes);
+    put_be32 (_file, 1);
+    put_be32 (_file, _chan);
+    put_be32 (_file, 8 * _bytes);
+    fwrite ("data", 1, 4, _file);
+    put_be64 (_file, (uint64_t) -1);
+    put_be32 (_file, 0);
+}
+
+
+int Audiofile::write (const float * const *data, int nframes)
+{
+    int       i, c, k, n;
+    int32_t   v;
+    float     x;
+    uint8_t  *q;
+    union { float f; uint32_t u; } u;
+
+    if (! _file) return 1;
+    for (k = 0; k < nframes; k += n)
+    {
+        n = nframes - k;
+        if (n > BUFFR) n = BUFFR;
+        q = _buff;
+        for (i = k; i < k + n; i++)
+        {
+            for (c = 0; c < _chan; c++)
+            {
+                x = data [c][i];
+                if (_form == FORM_FLOAT)
+                {
+                    u.f = x;
+                    v = u.u;
+                }
+                else
+                {
+                    if (x > 1.0f) x = 1.0f;
+                    if (x < -1.0f) x = -1.0f;
+                    switch (_form)
+                    {
+                    case FORM_16: v = (int32_t)(x * 32767.0f); break;
+                    case FORM_24: v = (int32_t)(x * 8388607.0f); break;
+                    default:      v = (int32_t)(x * 2147483647.0);
+                    }
+                }
+                *q++ = v;
+                *q++ = v >> 8;
+                if (_bytes > 2) *q++ = v >> 16;
+                if (_bytes > 3) *q++ = v >> 24;
+            }
+        }
+        if (fwrite (_buff, _chan * _bytes, n, _file) != (size_t) n) return 1;
+        _nframes += n;
+    }
+    return 0;
+}
+
+
+int Audiofile::close (void)
+{
+    int64_t  size;
+    int      r;
+
+    if (! _file) return 0;
+    r = 0;
+    size = _nframes * _chan * _bytes;
+    if (_type == TYPE_WAV)
+    {
+        if (size > 0xFFFFFFFFLL - _dpos)
+        {
+            fprintf (stderr, "WAV file exceeds 4 GB, header sizes are truncated\n");
+            size = 0xFFFFFFFFLL - _dpos;
+        }
+        // Chunks have an even size.
+        if (size & 1) fputc (0, _file);
+        fseek (_file, 4, SEEK_SET);
+        put_le32 (_file, (uint32_t)(_dpos - 8 + size + (size & 1)));
+        fseek (_file, _dpos - 4, SEEK_SET);
+        put_le32 (_file, (uint32_t) size);
+    }
+    else if (_type == TYPE_W64)
+    {
+        while (size & 7)
+        {
+            fputc (0, _file);
+            size++;
+        }
+        fseek (_file, 16, SEEK_SET);
+        put_le64 (_file, _dpos + size);
+        fseek (_file, _dpos - 8, SEEK_SET);
+        put_le64 (_file, 24 + _nframes * _chan * _bytes);
+    }
+    else
+    {
+        fseek (_file, _dpos - 12, SEEK_SET);
+        put_be64 (_file, size + 4);
+    }
+    if (ferror (_file)) r = 1;
+    if (fclose (_file)) r = 1;
+    _file = 0;
+    delete[] _buff;
+    _buff = 0;
+    return r;
+}
+
@@ -0,0 +1,79 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __AUDIOFILE_H
+#define __AUDIOFILE_H
+
+
+#include <stdio.h>
+#include <stdint.h>
+
+
+// Minimal writer for WAV, W64 and CAF files. Samples are taken as
+// non-interleaved floats and written as float or integer PCM.
+// Sizes in the header are filled in by close().
+
+class Audiofile
+{
+public:
+
+    enum { TYPE_NONE, TYPE_WAV, TYPE_W64, TYPE_CAF };
+    enum { FORM_NONE, FORM_16, FORM_24, FORM_32, FORM_FLOAT };
+
+    Audiofile (void);
+    ~Audiofile (void);
+
+    int  open_write (const char *path, int type, int form, int chan, int rate);
+    int  write (const float * const *data, int nframes);
+    int  close (void);
+
+    int      type (void) const { return _type; }
+    int      form (void) const { return _form; }
+    int      chan (void) const { return _chan; }
+    int64_t  nframes (void) const { return _nframes; }
+
+    static int type_from_name (const char *path);
+    static int form_from_name (const char *name);
+
+private:
+
+    Audiofile (const Audiofile&);
+    Audiofile& operator=(const Audiofile&);
+
+    enum { BUFFR = 1024 };
+
+    void  write_wav_header (void);
+    void  write_fmt_chunk (void);
+    void  write_w64_header (void);
+    void  write_caf_header (void);
+
+    FILE     *_file;
+    int       _type;
+    int       _form;
+    int       _chan;
+    int       _rate;
+    int       _bytes;
+    int64_t   _nframes;
+    long      _dpos;
+    uint8_t  *_buff;
+};
+
+
+#endif
@@ -30,7 +30,10 @@ Audiowin::Audiowin (X_window *parent, X_callback *callb, int xp, int yp, X_resma
     _callb (callb),
     _xresm (xresm),
     _xp (xp),
-    _yp (yp)
+    _yp (yp),
+    _perfstats (0),
+    _load (0),
+    _tick (0)
 {
     _atom = XInternAtom (dpy (), "WM_DELETE_WINDOW", True);
     XSetWMProtocols (dpy (), win (), &_atom, 1);
@@ -138,6 +141,13 @@ void Audiowin::setup (M_ifc_init *M)
     add_text (355, 305, 80, 20, "Position", &text0);
     add_text (570, 305, 60, 20, "Volume",   &text0);
 
+    _perfstats = M->_perfstats;
+    if (_perfstats)
+    {
+        _load = new X_textln (this, &text0, 305, 235, 200, 20, "", -1);
+        _load->x_map ();
+    }
+
     sprintf (s, "%s   Aeolus-%s   Audio settings", M->_appid, VERSION);
     x_set_title (s);
 
@@ -170,6 +180,22 @@ void Audiowin::set_aupar (M_ifc_aupar *M)
 }
 
 
+void Audiowin::handle_time (void)
+{
+    char      s [64];
+    float     t;
+    Perfinfo  I;
+
+    // Update the DSP load indicator twice per second.
+    if (! _load || (++_tick & 3)) return;
+    t = _perfstats->period ();
+    _perfstats->get_info (Perfstats::CYCLE, &I);
+    sprintf (s, "DSP %3.0f%%  max %3.0f%%  xruns %u",
+             100 * _perfstats->load (), 100 * I._max / t, _perfstats->xruns ());
+    _load->set_text (s);
+}
+
+
 void Audiowin::add_text (int xp, int yp, int xs, int ys, const char *text, X_textln_style *style)
 {
     (new X_textln (this, style, xp, yp, xs, ys, text, -1))->x_map ();
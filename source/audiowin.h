@@ -46,6 +46,7 @@ public:
 
     void setup (M_ifc_init *);
     void set_aupar (M_ifc_aupar *M);
+    void handle_time (void);
 
     int   asect (void) const { return _asect; }
     int   parid (void) const { return _parid; }
@@ -75,6 +76,9 @@ private:
     int             _parid;
     float           _value;
     bool            _final;
+    Perfstats      *_perfstats;
+    X_textln       *_load;
+    int             _tick;
 };
 
 } // namespace aeolus_x11
@@ -0,0 +1,195 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "capture.h"
+#include "tracer.h"
+
+
+Capture::Capture (void) :
+    _fsamp (48000),
+    _nplay (2),
+    _nasect (0),
+    _nchan (0),
+    _stems (false),
+    _thread (false),
+    _state (IDLE),
+    _wr (0),
+    _rd (0),
+    _overr (0),
+    _nfile (0),
+    _exit (false),
+    _done (false)
+{
+    for (int i = 0; i < NCHAN; i++) _data [i] = 0;
+    _path [0] = 0;
+}
+
+
+Capture::~Capture (void)
+{
+    if (_thread)
+    {
+        // Let the writer finish the file first.
+        stop ();
+        while (_state.load () != IDLE) usleep (10000);
+        _exit.store (true);
+        while (! _done.load ()) usleep (10000);
+    }
+    _afile.close ();
+    for (int i = 0; i < NCHAN; i++) delete[] _data [i];
+}
+
+
+void Capture::init (int fsamp, int nplay, int nasect)
+{
+    _fsamp = fsamp;
+    _nplay = nplay;
+    _nasect = nasect;
+}
+
+
+int Capture::start (const char *path, bool stems)
+{
+    int  i, n, type;
+
+    if (_state.load (std::memory_order_acquire) != IDLE) return 1;
+    type = Audiofile::type_from_name (path);
+    if (type == Audiofile::TYPE_NONE) return 1;
+    n = stems ? 2 * _nasect : _nplay;
+    if (n > NCHAN) n = NCHAN;
+    if (_afile.open_write (path, type, Audiofile::FORM_FLOAT, n, _fsamp)) return 1;
+
+    // The ring is allocated on first use and then kept. The audio
+    // thread does not touch it until the state is set to RUN.
+    for (i = 0; i < n; i++)
+    {
+        if (! _data [i]) _data [i] = new float [NFRAME];
+    }
+    snprintf (_path, 1024, "%s", path);
+    _nchan = n;
+    _stems = stems;
+    _wr.store (0, std::memory_order_relaxed);
+    _rd.store (0, std::memory_order_relaxed);
+    _overr.store (0, std::memory_order_relaxed);
+    _nfile.store (0, std::memory_order_relaxed);
+    if (! _thread)
+    {
+        if (thr_start (SCHED_OTHER, 0, 0))
+        {
+            _afile.close ();
+            return 1;
+        }
+        _thread = true;
+    }
+    _state.store (RUN, std::memory_order_release);
+    return 0;
+}
+
+
+void Capture::stop (void)
+{
+    int s = RUN;
+
+    // The writer thread empties the ring and closes the file.
+    _state.compare_exchange_strong (s, STOP);
+}
+
+
+void Capture::write (float * const *data, int nchan, int nframes)
+{
+    int       c, n;
+    uint32_t  i, w;
+
+    if (_state.load (std::memory_order_acquire) != RUN) return;
+    w = _wr.load (std::memory_order_relaxed);
+    if (NFRAME - (w - _rd.load (std::memory_order_acquire)) < (uint32_t) nframes)
+    {
+        _overr.fetch_add (1, std::memory_order_relaxed);
+        return;
+    }
+    i = w & (NFRAME - 1);
+    n = NFRAME - i;
+    if (n > nframes) n = nframes;
+    for (c = 0; c < _nchan; c++)
+    {
+        if (c < nchan)
+        {
+            memcpy (_data [c] + i, data [c], n * sizeof (float));
+            memcpy (_data [c], data [c] + n, (nframes - n) * sizeof (float));
+        }
+        else
+        {
+            memset (_data [c] + i, 0, n * sizeof (float));
+            memset (_data [c], 0, (nframes - n) * sizeof (float));
+        }
+    }
+    _wr.store (w + nframes, std::memory_order_release);
+}
+
+
+void Capture::thr_main (void)
+{
+    int        c, s;
+    uint32_t   i, n, r;
+    float     *p [NCHAN];
+
+    Tracer::thread ("capture");
+    while (! _exit.load ())
+    {
+        s = _state.load (std::memory_order_acquire);
+        if (s == IDLE)
+        {
+            usleep (10000);
+            continue;
+        }
+        r = _rd.load (std::memory_order_relaxed);
+        n = _wr.load (std::memory_order_acquire) - r;
+        if (n == 0 && s == STOP)
+        {
+            if (_afile.close ()) fprintf (stderr, "Capture: error writing '%s'\n", _path);
+            _state.store (IDLE, std::memory_order_release);
+            continue;
+        }
+        // Write in large blocks, except when draining the ring.
+        if ((n < CHUNK) && (s == RUN))
+        {
+            usleep (10000);
+            continue;
+        }
+        i = r & (NFRAME - 1);
+        if (n > NFRAME - i) n = NFRAME - i;
+        for (c = 0; c < _nchan; c++) p [c] = _data [c] + i;
+        Tracer::begin ("capture_write", n);
+        c = _afile.write (p, n);
+        Tracer::end ("capture_write", n);
+        _rd.store (r + n, std::memory_order_release);
+        _nfile.fetch_add (n, std::memory_order_relaxed);
+        if (c)
+        {
+            fprintf (stderr, "Capture: error writing '%s', stopped\n", _path);
+            _afile.close ();
+            _state.store (IDLE, std::memory_order_release);
+        }
+    }
+    _done.store (true);
+}
@@ -0,0 +1,91 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __CAPTURE_H
+#define __CAPTURE_H
+
+
+#include <stdint.h>
+#include <atomic>
+#include <clthreads.h>
+#include "audiofile.h"
+
+
+// Records the audio output to a file. The audio thread copies each
+// period into a lock-free ring buffer, a writer thread empties it
+// into the file. If the ring is full the period is dropped and
+// counted as an overrun, the audio thread never waits.
+//
+// Instead of the output, the dry stereo signal of each Asection
+// can be recorded ('stems'), two channels per section.
+
+class Capture : public P_thread
+{
+public:
+
+    enum { IDLE, RUN, STOP };
+    enum { NCHAN = 8, NFRAME = 1 << 17, CHUNK = 8192 };
+
+    Capture (void);
+    virtual ~Capture (void);
+
+    // Before the audio thread starts.
+    void init (int fsamp, int nplay, int nasect);
+    void set_fsamp (int fsamp) { _fsamp = fsamp; }
+
+    // Model thread. Starting fails if a file is still being closed.
+    int  start (const char *path, bool stems);
+    void stop (void);
+
+    // Audio thread.
+    bool active (void) const { return _state.load (std::memory_order_acquire) == RUN; }
+    bool stems (void) const { return _stems; }
+    void write (float * const *data, int nchan, int nframes);
+
+    // Any thread.
+    int         state (void) const { return _state.load (std::memory_order_acquire); }
+    uint32_t    overruns (void) const { return _overr.load (std::memory_order_relaxed); }
+    double      seconds (void) const { return (double) _nfile.load (std::memory_order_relaxed) / _fsamp; }
+    const char *path (void) const { return _path; }
+
+private:
+
+    virtual void thr_main (void);
+
+    Audiofile              _afile;
+    float                 *_data [NCHAN];
+    int                    _fsamp;
+    int                    _nplay;
+    int                    _nasect;
+    int                    _nchan;
+    bool                   _stems;
+    bool                   _thread;
+    char                   _path [1024];
+    std::atomic<int>       _state;
+    std::atomic<uint32_t>  _wr;
+    std::atomic<uint32_t>  _rd;
+    std::atomic<uint32_t>  _overr;
+    std::atomic<int64_t>   _nfile;
+    std::atomic<bool>      _exit;
+    std::atomic<bool>      _done;
+};
+
+
+#endif
@@ -25,6 +25,7 @@
 
 Division::Division (Asection *asect, float fsam) :
     _asect (asect),
+    _dead (0),
     _nrank (0),
     _dmask (0),
     _trem (0),
@@ -37,22 +38,34 @@ Division::Division (Asection *asect, float fsam) :
     _m (0.0f)
 {
     for (int i = 0; i < NRANKS; i++) _ranks [i] = 0;
+    for (int i = 0; i < NRETIRE; i++) _retire [i] = 0;
 }
 
 
 Division::~Division (void)
 {
+    for (int i = 0; i < NRETIRE; i++) delete _retire [i];
 }
 
 
-void Division::process (void)
+int Division::process (void)
 {
-    int    i;
+    int    i, n;
     float  d, g, t;
     float  *p, *q;
 
     memset (_buff, 0, NCHANN * PERIOD * sizeof (float));
-    for (i = 0; i < _nrank; i++) _ranks [i]->play (1);
+    for (i = n = 0; i < _nrank; i++) n += _ranks [i]->play (1);
+    for (i = 0; i < NRETIRE; i++)
+    {
+        if (! _retire [i]) continue;
+        n += _retire [i]->play (1);
+        if (! _retire [i]->sounding ())
+        {
+            discard (_retire [i]);
+            _retire [i] = 0;
+        }
+    }
 
     g = _swel;
     if (_trem)
@@ -92,6 +105,71 @@ void Division::process (void)
         q++;
     }
     _gain = g;
+    return n;
+}
+
+
+void Division::offer (Voicebudget *B)
+{
+    for (int i = 0; i < _nrank; i++) _ranks [i]->offer (B, _gain);
+    for (int i = 0; i < NRETIRE; i++) if (_retire [i]) _retire [i]->offer (B, _gain);
+}
+
+
+// Delete all ranks, when the division is no longer used.
+//
+void Division::clear (void)
+{
+    int i;
+
+    for (i = 0; i < _nrank; i++)
+    {
+        delete _ranks [i];
+        _ranks [i] = 0;
+    }
+    for (i = 0; i < NRETIRE; i++)
+    {
+        delete _retire [i];
+        _retire [i] = 0;
+    }
+    _nrank = 0;
+}
+
+
+// Keep a replaced rank until its sounding pipes have
+// released. Returns false if it can be deleted now.
+//
+bool Division::retire (Rankwave *W)
+{
+    int i;
+
+    if (! W->sounding ()) return false;
+    for (i = 0; i < NRETIRE; i++)
+    {
+        if (! _retire [i])
+        {
+            W->release ();
+            _retire [i] = W;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// Delete a rank that is no longer used. Deleting the last user
+// of the waves may unmap shared memory, so in the audio thread the
+// rank is passed to the model instead. The queue can only fill up
+// if the model stops reading it.
+//
+void Division::discard (Rankwave *W)
+{
+    if (_dead && _dead->write_avail ())
+    {
+        _dead->write (0, W);
+        _dead->write_commit (1);
+    }
+    else delete W;
 }
 
 
@@ -99,16 +177,30 @@ void Division::process (void)
 //
 void Division::set_rank (int ind, Rankwave *W, int pan, int del)
 {
-    Rankwave *C;
+    int       r;
+    Rankwave *C, *U;
 
     C = _ranks [ind];
     if (C)
     {
         W->_nmask = C->_nmask | KMAP_SET;
-        delete C;
+        // Extensions of C now play the pipes of W.
+        for (r = 0; r < _nrank; r++)
+        {
+            U = _ranks [r];
+            if (U && (U->unit () == C))
+            {
+                U->set_unit (W, U->offs ());
+                U->_nmask |= KMAP_SET;
+            }
+        }
+        // Held keys start again in W, the pipes of C
+        // that were sounding fade out with their release.
+        if (! retire (C)) discard (C);
     }
     else W->_nmask = KMAP_SET;
     _ranks [ind] = W;
+    W->set_user (ind);
     del = (int)(1e-3f * del * _fsam / PERIOD);
     if (del > 31) del = 31;
     W->set_param (_buff, del, pan);
@@ -116,6 +208,29 @@ void Division::set_rank (int ind, Rankwave *W, int pan, int del)
 }
 
 
+// Set or replace a unit extension of rank 'unit',
+// which must have been set before.
+//
+void Division::set_unit (int ind, Rankwave *W, int unit, int offs)
+{
+    Rankwave *C;
+
+    C = _ranks [ind];
+    if (C)
+    {
+        W->_nmask = C->_nmask | KMAP_SET;
+        // Release the pipes it was holding.
+        C->all_off ();
+        discard (C);
+    }
+    else W->_nmask = KMAP_SET;
+    _ranks [ind] = W;
+    W->set_user (ind);
+    W->set_unit (_ranks [unit], offs);
+    if (_nrank < ++ind) _nrank = ind;
+}
+
+
 // Handle key up down events.
 //
 void Division::update (int note, int16_t mask)
@@ -24,6 +24,7 @@
 
 #include "asection.h"
 #include "rankwave.h"
+#include "lfqueue.h"
 
 
 class Division
@@ -34,9 +35,14 @@ public:
     ~Division (void);
 
     void set_rank (int ind, Rankwave *W, int pan, int del);
+    void set_unit (int ind, Rankwave *W, int unit, int offs);
     void set_swell (float stat) { _swel = 0.2 + 0.8 * stat * stat; }
     void set_tfreq (float freq) { _w = 6.283184f * PERIOD * freq / _fsam; }
     void set_tmodd (float modd) { _m = modd; }
+    void set_fsam (float fsam) { _w *= _fsam / fsam; _fsam = fsam; }
+    void set_asect (Asection *asect) { _asect = asect; }
+    Asection *asect (void) const { return _asect; }
+    void set_dead (Lfq_ptr *dead) { _dead = dead; }
     void set_div_mask (int bits);
     void clr_div_mask (int bits);
     void set_rank_mask (int ind, int bits);
@@ -44,14 +50,24 @@ public:
     void trem_on (void)  { _trem = 1; }
     void trem_off (void) { _trem = 2; }
 
-    void process (void);
+    void clear (void);
+
+    int  process (void);
+    void offer (Voicebudget *B);
     void update (int note, int16_t mask);
     void update (uint16_t *keys);
 
 private:
 
+    enum { NRETIRE = 4 };
+
+    bool retire (Rankwave *W);
+    void discard (Rankwave *W);
+
     Asection  *_asect;
     Rankwave  *_ranks [NRANKS];
+    Rankwave  *_retire [NRETIRE];  // replaced ranks, playing their release
+    Lfq_ptr   *_dead;              // ranks to be deleted by the model, or 0
     int        _nrank;
     int        _dmask;
     int        _trem;
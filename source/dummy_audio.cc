@@ -0,0 +1,161 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "dummy_audio.h"
+#include "messages.h"
+#include "tracer.h"
+
+
+DummyAudio::DummyAudio (const char *appname, Lfq_u32 *qnote, Lfq_u32 *qcomm) :
+    AudioBackend (appname, qnote, qcomm),
+    _relpri (0),
+    _midi (false)
+{
+}
+
+
+DummyAudio::~DummyAudio (void)
+{
+    if (_running) close_dummy ();
+    for (int i = 0; i < _nplay; i++) delete[] _outbuf [i];
+}
+
+
+void DummyAudio::init_dummy (int fsamp, int fsize, bool bform, bool midi)
+{
+    if (fsamp < 8000)
+    {
+        fprintf (stderr, "Error: invalid sample rate %d.\n", fsamp);
+        exit (1);
+    }
+    if ((fsize < PERIOD) || (fsize & (PERIOD - 1)))
+    {
+        fprintf (stderr, "Error: period size must be a multiple of %d.\n", PERIOD);
+        exit (1);
+    }
+    _fsamp = fsamp;
+    _fsize = fsize;
+    _bform = bform;
+    _nplay = bform ? 4 : 2;
+    _midi = midi;
+    init_audio ();
+    for (int i = 0; i < _nplay; i++) _outbuf [i] = new float [fsize];
+    _running = true;
+    if (thr_start (_policy = SCHED_FIFO, _relpri = -20, 0))
+    {
+        fprintf (stderr, "Warning: can't run audio thread in RT mode.\n");
+        if (thr_start (_policy = SCHED_OTHER, _relpri = 0, 0))
+        {
+            fprintf (stderr, "Error: can't create audio thread.\n");
+            exit (1);
+        }
+    }
+}
+
+
+void DummyAudio::start (void)
+{
+    M_audio_info  *M;
+    M_midi_info   *MI;
+    int           i;
+
+    M = new M_audio_info ();
+    M->_nasect = _nasect;
+    M->_fsamp  = _fsamp;
+    M->_fsize  = _fsize;
+    M->_instrpar = _audiopar;
+    for (i = 0; i < _nasect; i++) M->_asectpar [i] = _asectp [i]->get_apar ();
+    M->_perfstats = &_perfstats;
+    M->_capture = &_capture;
+    M->_qdead = &_qdead;
+    send_event (TO_MODEL, M);
+
+    // Without a midi thread the model still needs its MIDI info.
+    if (_midi)
+    {
+        MI = new M_midi_info ();
+        MI->_client = 0;
+        MI->_ipport = 0;
+        memcpy (MI->_chbits, _midimap, 16 * sizeof (uint16_t));
+        send_event (TO_MODEL, MI);
+    }
+}
+
+
+void DummyAudio::close_dummy (void)
+{
+    _running = false;
+    get_event (1 << EV_EXIT);
+}
+
+
+void DummyAudio::thr_main (void)
+{
+    int64_t          tper, tnext, t;
+    struct timespec  ts;
+
+    Tracer::thread ("audio");
+    tper = (int64_t) 1000000000 * _fsize / _fsamp;
+    tnext = Perfstats::tnow ();
+
+    while (_running)
+    {
+        // Wait for the time the next buffer would be due.
+        tnext += tper;
+#ifdef __linux__
+        ts.tv_sec  = tnext / 1000000000;
+        ts.tv_nsec = tnext % 1000000000;
+        while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR) ;
+#else
+        t = tnext - Perfstats::tnow ();
+        if (t > 0)
+        {
+            ts.tv_sec  = t / 1000000000;
+            ts.tv_nsec = t % 1000000000;
+            nanosleep (&ts, 0);
+        }
+#endif
+        _perfstats.cycle_begin ();
+        Tracer::begin ("cycle");
+        proc_queue (_qnote);
+        proc_queue (_qcomm);
+        proc_keys1 ();
+        proc_keys2 ();
+        proc_synth (_fsize);
+        proc_mesg ();
+        Tracer::end ("cycle");
+        _perfstats.cycle_end ();
+
+        // Missed the deadline: a device would have run out of data.
+        // Restart the schedule from now instead of trying to catch up.
+        t = Perfstats::tnow ();
+        if (t > tnext + tper)
+        {
+            _perfstats.xrun ();
+            Tracer::trigger ();
+            tnext = t;
+        }
+    }
+
+    put_event (EV_EXIT);
+}
@@ -0,0 +1,55 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __DUMMY_AUDIO_H
+#define __DUMMY_AUDIO_H
+
+
+#include "audio_backend.h"
+
+
+// Runs the audio pipeline without a device, paced by the system
+// clock. The output is discarded. A cycle that ends after the time
+// the next one should have started is counted as an xrun.
+
+class DummyAudio : public AudioBackend
+{
+public:
+
+    DummyAudio (const char *appname, Lfq_u32 *qnote, Lfq_u32 *qcomm);
+    virtual ~DummyAudio (void);
+
+    void init_dummy (int fsamp, int fsize, bool bform, bool midi);
+
+    // AudioBackend interface implementation
+    void start (void) override;
+    int  relpri (void) const override { return _relpri; }
+
+private:
+
+    void close_dummy (void);
+    virtual void thr_main (void) override;
+
+    int             _relpri;
+    bool            _midi;
+};
+
+
+#endif
@@ -82,6 +82,7 @@ enum // GLOBAL LIMITS
 #define MIDICTL_BANK   32
 #define MIDICTL_HOLD   64
 #define MIDICTL_IFELM  98
+#define MIDICTL_CAPTURE 102
 #define MIDICTL_ASOFF 120
 #define MIDICTL_ANOFF 123
 
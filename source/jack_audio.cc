@@ -18,10 +18,13 @@
 // ----------------------------------------------------------------------------
 
 
+#include <string.h>
+#include <unistd.h>
 #include <pthread.h>
 #include <jack/midiport.h>
 #include "jack_audio.h"
 #include "messages.h"
+#include "tracer.h"
 #include "midi_processor.h"
 
 
@@ -33,7 +36,10 @@ JackAudio::JackAudio (const char *appname, Lfq_u32 *qnote, Lfq_u32 *qcomm) :
     _relpri (0),
     _jmidi_count (0),
     _jmidi_index (0),
-    _jmidi_pdata (0)
+    _jmidi_pdata (0),
+    _freewheel (false),
+    _inproc (false),
+    _mute (false)
 {
     for (int i = 0; i < 8; i++) _jack_opport [i] = 0;
 }
@@ -67,6 +73,7 @@ void JackAudio::init_jack (const char *server, bool bform, Lfq_u8 *qmidi)
     _appname = jack_get_client_name (_jack_handle);
 
     jack_set_process_callback (_jack_handle, jack_static_callback, (void *)this);
+    jack_set_xrun_callback (_jack_handle, jack_static_xrun, (void *)this);
     jack_on_shutdown (_jack_handle, jack_static_shutdown, (void *)this);
 
     if (_bform)
@@ -104,6 +111,12 @@ void JackAudio::init_jack (const char *server, bool bform, Lfq_u8 *qmidi)
     _fsize = jack_get_buffer_size (_jack_handle);
     init_audio ();
 
+    // Registered after init_audio(), JACK may call these right away.
+    jack_set_buffer_size_callback (_jack_handle, jack_static_bufsize, (void *)this);
+    jack_set_sample_rate_callback (_jack_handle, jack_static_srate, (void *)this);
+    jack_set_freewheel_callback (_jack_handle, jack_static_freewheel, (void *)this);
+    _running = true;
+
     if (jack_activate (_jack_handle))
     {
         fprintf(stderr, "Error: can't activate JACK.");
@@ -127,6 +140,9 @@ void JackAudio::start (void)
     M->_fsize  = _fsize;
     M->_instrpar = _audiopar;
     for (i = 0; i < _nasect; i++) M->_asectpar [i] = _asectp [i]->get_apar ();
+    M->_perfstats = &_perfstats;
+    M->_capture = &_capture;
+    M->_qdead = &_qdead;
     send_event(TO_MODEL, M);
 
     // Send MIDI info to model thread since JACK handles MIDI in audio thread
@@ -161,10 +177,35 @@ void JackAudio::jack_shutdown (void)
 }
 
 
+void JackAudio::silence (jack_nframes_t nframes)
+{
+    for (int i = 0; i < _nplay; i++)
+    {
+        memset (jack_port_get_buffer (_jack_opport [i], nframes), 0, nframes * sizeof (float));
+    }
+}
+
+
 int JackAudio::jack_callback (jack_nframes_t nframes)
 {
-    int i;
+    int  i;
+    bool fw;
+
+    // The synthesis works in whole periods. A sample rate change
+    // mutes the output while the DSP state is rebuilt.
+    _inproc.store (true);
+    if (_mute.load () || (nframes % PERIOD))
+    {
+        silence (nframes);
+        _inproc.store (false);
+        return 0;
+    }
 
+    // When freewheeling the timing statistics are meaningless.
+    fw = _freewheel.load (std::memory_order_relaxed);
+    if (! fw) _perfstats.cycle_begin ();
+    Tracer::thread ("audio");
+    Tracer::begin ("cycle");
     proc_queue (_qnote);
     proc_queue (_qcomm);
     proc_keys1 ();
@@ -185,10 +226,80 @@ int JackAudio::jack_callback (jack_nframes_t nframes)
     proc_synth (nframes);
     
     proc_mesg ();
+
+    // Freewheeling runs much faster than the model's timer, so have
+    // it execute MIDI commands now. They take effect in the next
+    // cycle. Blocking is allowed, the process thread is not RT.
+    if (fw && _qmidi && _qmidi->read_avail ()) flush_model ();
+
+    Tracer::end ("cycle");
+    if (! fw) _perfstats.cycle_end ();
+    _inproc.store (false);
+    return 0;
+}
+
+
+int JackAudio::jack_xrun (void)
+{
+    _perfstats.xrun ();
+    Tracer::trigger ();
+    return 0;
+}
+
+
+int JackAudio::jack_bufsize (jack_nframes_t nframes)
+{
+    // Nothing is allocated per buffer, the new size takes effect in
+    // the next cycle.
+    if (nframes % PERIOD)
+    {
+        fprintf (stderr, "Warning: JACK period size %d is not a multiple of %d, output muted.\n",
+                 (int) nframes, PERIOD);
+    }
+    _fsize = nframes;
+    _perfstats.set_period (_fsamp, _fsize);
+    // Its load windows are counted in cycles.
+    _quality.init (_fsamp, _fsize);
+    return 0;
+}
+
+
+int JackAudio::jack_srate (jack_nframes_t fsamp)
+{
+    M_audio_info  *M;
+    int           i;
+
+    // Also called once on activation, with the current rate.
+    if (fsamp == _fsamp) return 0;
+
+    // Wait for a running cycle to finish, later ones are muted.
+    _mute.store (true);
+    while (_inproc.load ()) usleep (1000);
+    set_fsamp (fsamp);
+    _mute.store (false);
+
+    // Have the model regenerate all ranks for the new rate. The old
+    // ones are played until they are replaced.
+    M = new M_audio_info ();
+    M->_nasect = _nasect;
+    M->_fsamp  = _fsamp;
+    M->_fsize  = _fsize;
+    M->_instrpar = _audiopar;
+    for (i = 0; i < _nasect; i++) M->_asectpar [i] = _asectp [i]->get_apar ();
+    M->_perfstats = &_perfstats;
+    M->_capture = &_capture;
+    M->_qdead = &_qdead;
+    send_event (TO_MODEL, M);
     return 0;
 }
 
 
+void JackAudio::jack_freewheel (int starting)
+{
+    _freewheel.store (starting != 0);
+}
+
+
 void JackAudio::proc_midi_during_synth (int frame_time)
 {
     if (_jmidi_pdata)
@@ -216,10 +327,16 @@ void JackAudio::proc_jmidi (int tmax)
 
             // Use MidiProcessor for common MIDI logic
             MidiProcessor::process_midi_event(status, data1, data2, channel,
-                                            _midimap, this, _qnote, _qmidi);
+                                            _midimap, this, _qnote, _qmidi, &_jmidi_ctl);
         }
         _jmidi_index++;
     }
+    // Swell and tremulant controllers, latest value only.
+    if (_jmidi_ctl.pending ())
+    {
+        _jmidi_ctl.flush (_qmidi);
+        _perfstats.add_ctl_merge (_jmidi_ctl.merged ());
+    }
 }
 
 
@@ -235,6 +352,30 @@ int JackAudio::jack_static_callback (jack_nframes_t nframes, void *arg)
 }
 
 
+int JackAudio::jack_static_xrun (void *arg)
+{
+    return ((JackAudio *) arg)->jack_xrun ();
+}
+
+
+int JackAudio::jack_static_bufsize (jack_nframes_t nframes, void *arg)
+{
+    return ((JackAudio *) arg)->jack_bufsize (nframes);
+}
+
+
+int JackAudio::jack_static_srate (jack_nframes_t fsamp, void *arg)
+{
+    return ((JackAudio *) arg)->jack_srate (fsamp);
+}
+
+
+void JackAudio::jack_static_freewheel (int starting, void *arg)
+{
+    ((JackAudio *) arg)->jack_freewheel (starting);
+}
+
+
 void JackAudio::thr_main (void)
 {
     // JACK uses callback-based processing, no thread main needed
@@ -22,9 +22,11 @@
 #define __JACK_AUDIO_H
 
 
+#include <atomic>
 #include <jack/jack.h>
 #include "audio_backend.h"
 #include "lfqueue.h"
+#include "midi_processor.h"
 
 
 class JackAudio : public AudioBackend
@@ -51,11 +53,20 @@ private:
     void close_jack (void);
     void jack_shutdown (void);
     int  jack_callback (jack_nframes_t);
+    int  jack_xrun (void);
+    int  jack_bufsize (jack_nframes_t);
+    int  jack_srate (jack_nframes_t);
+    void jack_freewheel (int);
+    void silence (jack_nframes_t);
     void proc_jmidi (int);
     virtual void thr_main (void) override;
 
     static void jack_static_shutdown (void *);
     static int  jack_static_callback (jack_nframes_t, void *);
+    static int  jack_static_xrun (void *);
+    static int  jack_static_bufsize (jack_nframes_t, void *);
+    static int  jack_static_srate (jack_nframes_t, void *);
+    static void jack_static_freewheel (int, void *);
 
     jack_client_t  *_jack_handle;
     jack_port_t    *_jack_opport [8];
@@ -65,6 +76,10 @@ private:
     int             _jmidi_count;
     int             _jmidi_index;
     void           *_jmidi_pdata;
+    MidiProcessor::Coalescer  _jmidi_ctl;
+    std::atomic<bool>  _freewheel;
+    std::atomic<bool>  _inproc;
+    std::atomic<bool>  _mute;
 };
 
 
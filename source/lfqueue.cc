@@ -58,3 +58,13 @@ Lfq_u32::~Lfq_u32 (void)
 }
 
 
+Lfq_ptr::Lfq_ptr (int size) : _size (size), _mask (_size - 1), _nwr (0), _nrd (0)
+{
+    assert (!(_size & _mask));
+    _data = new void * [_size];
+}
+
+Lfq_ptr::~Lfq_ptr (void)
+{
+    delete[] _data;
+}
@@ -100,5 +100,30 @@ private:
 };
 
 
+class Lfq_ptr
+{
+public:
+
+    Lfq_ptr (int size);
+    ~Lfq_ptr (void);
+
+    int       write_avail (void) const { return _size - _nwr + _nrd; }
+    void      write_commit (int n) { _nwr += n; }
+    void      write (int i, void *v) { _data [(_nwr + i) & _mask] = v; }
+
+    int       read_avail (void) const { return _nwr - _nrd; }
+    void      read_commit (int n) { _nrd += n; }
+    void     *read (int i) { return _data [(_nrd + i) & _mask]; }
+
+private:
+
+    void    **_data;
+    int       _size;
+    int       _mask;
+    int       _nwr;
+    int       _nrd;
+};
+
+
 #endif
 
@@ -27,6 +27,7 @@
 #include <signal.h>
 #include <clthreads.h>
 #include <dlfcn.h>
+#include <getopt.h>
 #if defined(STATIC_UI) && defined(HAVE_TIFACE)
 #include "tiface.h"
 #endif
@@ -45,28 +46,47 @@
 #include "slave.h"
 #include "iface.h"
 #include "messages.h"
+#include "tracer.h"
+#include "audiofile.h"
+#include "wavestore.h"
+#include "startup.h"
 
 
 #ifdef __linux__
-static const char *options = "htuAJBcM:N:S:I:W:d:r:p:n:s:";
+static const char *options = "htuAJDBcTHM:N:S:I:W:d:r:p:n:s:F:O:e:V:Qm:R:";
 #else
-static const char *options = "htuJBcM:N:S:I:W:s:";
+static const char *options = "htuJDBcTHM:N:S:I:W:s:r:p:F:O:e:V:Qm:R:";
 #endif
+static const struct option longopts [] =
+{
+    { "startup-report", required_argument, 0, 'R' },
+    { 0, 0, 0, 0 }
+};
 static char  optline [1024];
 static bool  t_opt = false;
 static bool  u_opt = false;
 static bool  c_opt = false;
 static bool  A_opt = false;
+static bool  D_opt = false;
 static bool  B_opt = false;
+static bool  T_opt = false;
+static bool  H_opt = false;
 static int   r_val = 48000;
 static int   p_val = 1024;
 static int   n_val = 2;
+static bool  Q_opt = false;
+static int   V_val = 0;
+static int   m_val = 0;
 static const char *N_val = "aeolus";
 static const char *S_val = "stops";
 static const char *I_val = "Aeolus";
 static const char *W_val = "waves";
 static const char *d_val = "default";
 static const char *s_val = 0;
+static const char *F_val = 0;
+static const char *O_val = "aeolus.wav";
+static const char *e_val = "float";
+static const char *R_val = 0;
 static Lfq_u32  note_queue (256);
 static Lfq_u32  comm_queue (256);
 static Lfq_u8   midi_queue (1024);
@@ -86,6 +106,13 @@ static void help (void)
     fprintf (stderr, "  -S <stops>         Name of stops directory [stops]\n");
     fprintf (stderr, "  -I <instr>         Name of instrument directory [Aeolus]\n");
     fprintf (stderr, "  -W <waves>         Name of waves directory [waves]\n");
+    fprintf (stderr, "  -T                 Trace events, dump trace on xrun\n");
+    fprintf (stderr, "  -H                 Share wavetables with other Aeolus processes\n");
+    fprintf (stderr, "  -V <voices>        Maximum number of sounding pipes [no limit]\n");
+    fprintf (stderr, "  -Q                 Lower reverb quality when the DSP load is high\n");
+    fprintf (stderr, "  -m <megabytes>     Memory for wave data, evict unused ranks [no limit]\n");
+    fprintf (stderr, "  -R <file>          Startup report, '-' for a summary on stdout, *.json for JSON\n");
+    fprintf (stderr, "                     (also --startup-report <file>)\n");
     fprintf (stderr, "  -J                 Use JACK (default), with options:\n");
     fprintf (stderr, "    -s               Select JACK server\n");
     fprintf (stderr, "    -B               Ambisonics B format output\n");
@@ -94,8 +121,17 @@ static void help (void)
     fprintf (stderr, "    -d <device>        Alsa device [default]\n");
     fprintf (stderr, "    -r <rate>          Sample frequency [48000]\n");
     fprintf (stderr, "    -p <period>        Period size [1024]\n");
-    fprintf (stderr, "    -n <nfrags>        Number of fragments [2]\n\n");
+    fprintf (stderr, "    -n <nfrags>        Number of fragments [2]\n");
 #endif
+    fprintf (stderr, "  -D                 Use no audio device, paced by the system clock, with options:\n");
+    fprintf (stderr, "    -r <rate>          Sample frequency [48000]\n");
+    fprintf (stderr, "    -p <period>        Period size [1024]\n");
+    fprintf (stderr, "  -F <midifile>      Render MIDI file offline, with options:\n");
+    fprintf (stderr, "    -O <file>          Output file, .wav, .w64 or .caf [aeolus.wav]\n");
+    fprintf (stderr, "    -e <format>        Sample format, 16, 24, 32 or float [float]\n");
+    fprintf (stderr, "    -r <rate>          Sample frequency [48000]\n");
+    fprintf (stderr, "    -p <period>        Block size [1024]\n");
+    fprintf (stderr, "    -B                 Ambisonics B format output\n\n");
     exit (1);
 }
 
@@ -106,9 +142,10 @@ static void procoptions (int ac, char *av [], const char *where)
 
     optind = 1;
     opterr = 0;
-    while ((k = getopt (ac, av, options)) != -1)
+    while ((k = getopt_long (ac, av, options, longopts, 0)) != -1)
     {
-        if (optarg && (*optarg == '-'))
+        // A single '-' is a valid report file name.
+        if (optarg && (*optarg == '-') && ((k != 'R') || optarg [1]))
         {
             fprintf (stderr, "\n%s\n", where);
             fprintf (stderr, "  Missing argument for '-%c' option.\n", k);
@@ -121,18 +158,28 @@ static void procoptions (int ac, char *av [], const char *where)
          case 't' : t_opt = true;  break;
          case 'c' : c_opt = true;  break;
          case 'u' : u_opt = true;  break;
-         case 'A' : A_opt = true;  break;
-        case 'J' : A_opt = false; break;
+         case 'A' : A_opt = true;  D_opt = false; break;
+        case 'J' : A_opt = false; D_opt = false; break;
+        case 'D' : D_opt = true;  A_opt = false; break;
         case 'B' : B_opt = true; break;
+        case 'T' : T_opt = true; break;
+        case 'H' : H_opt = true; break;
         case 'r' : r_val = atoi (optarg); break;
         case 'p' : p_val = atoi (optarg); break;
         case 'n' : n_val = atoi (optarg); break;
+        case 'V' : V_val = atoi (optarg); break;
+        case 'Q' : Q_opt = true; break;
+        case 'm' : m_val = atoi (optarg); break;
         case 'N' : N_val = optarg; break;
         case 'S' : S_val = optarg; break;
         case 'I' : I_val = optarg; break;
         case 'W' : W_val = optarg; break;
         case 'd' : d_val = optarg; break;
         case 's' : s_val = optarg; break;
+        case 'F' : F_val = optarg; break;
+        case 'O' : O_val = optarg; break;
+        case 'e' : e_val = optarg; break;
+        case 'R' : R_val = optarg; break;
         case '?':
             fprintf (stderr, "\n%s\n", where);
             if (optopt != ':' && strchr (options, optopt)) fprintf (stderr, "  Missing argument for '-%c' option.\n", optopt);
@@ -200,14 +247,20 @@ int main (int ac, char *av [])
     char          *p;
     int            n;
 
+    Startup::begin ("config");
     p = getenv ("HOME");
     if (p) sprintf (s, "%s/.aeolusrc", p);
     else strcpy (s, ".aeolusrc");
     if (readconfig (s)) readconfig ("/etc/aeolus.conf");
     procoptions (ac, av, "On command line:");
+    Startup::enable (R_val);
+    Startup::end ("config");
 
+    if (T_opt) Tracer::enable (true, true);
     if (mlockall (MCL_CURRENT | MCL_FUTURE)) fprintf (stderr, "Warning: memory lock failed.\n");
+    Wavestore::enable (H_opt);
 
+    Startup::begin ("interface");
 #ifdef STATIC_UI
     if (t_opt)
     {
@@ -255,42 +308,70 @@ int main (int ac, char *av [])
     }
     iface = so_create (ac, av);
 #endif
+    Startup::end ("interface");
 
     // Create audio backend using factory
+    Startup::begin ("audio");
+    if (F_val)
+    {
+        OfflineConfig config = {F_val, O_val, r_val, p_val, B_opt, Audiofile::form_from_name (e_val), &midi_queue};
+        if (config.form == Audiofile::FORM_NONE)
+        {
+            fprintf (stderr, "Error: unknown sample format '%s'.\n", e_val);
+            exit (1);
+        }
+        audio = AudioFactory::create_offline(N_val, &note_queue, &comm_queue, config);
+    }
+    else if (D_opt)
+    {
+#ifdef __linux__
+        DummyConfig config = {r_val, p_val, B_opt, false};
+#else
+        DummyConfig config = {r_val, p_val, B_opt, true};
+#endif
+        audio = AudioFactory::create_dummy(N_val, &note_queue, &comm_queue, config);
+    }
 #ifdef __linux__
-    if (A_opt)
+    else if (A_opt)
     {
         AlsaConfig config = {d_val, r_val, p_val, n_val};
         audio = AudioFactory::create_alsa(N_val, &note_queue, &comm_queue, config);
     }
+#endif
     else
     {
         JackConfig config = {s_val, B_opt, &midi_queue};
         audio = AudioFactory::create_jack(N_val, &note_queue, &comm_queue, config);
     }
-#else
-    JackConfig config = {s_val, B_opt, &midi_queue};
-    audio = AudioFactory::create_jack(N_val, &note_queue, &comm_queue, config);
-#endif
 
     if (!audio)
     {
         fprintf(stderr, "Error: Failed to create audio backend\n");
         exit(1);
     }
+    Startup::end ("audio");
+    audio->voicebudget ()->set_limit (V_val);
+    audio->quality ()->enable (Q_opt);
     model = new Model (&comm_queue, &midi_queue, audio->midimap (), audio->appname (), S_val, I_val, W_val, u_opt);
+    if (m_val > 0) model->set_wavemem ((size_t) m_val << 20);
 #ifdef __linux__
-    imidi = new AlsaMidi (&note_queue, &midi_queue, audio->midimap (), audio->appname ());
+    // When rendering offline the MIDI file replaces the midi thread.
+    imidi = F_val ? 0 : new AlsaMidi (&note_queue, &midi_queue, audio->midimap (), audio->appname ());
+    if (imidi) imidi->set_perfstats (audio->perfstats ());
 #endif
-    slave = new Slave ();
+    slave = new Slave (audio->perfstats ());
 
     ITC_ctrl::connect (audio, EV_EXIT,  &itcc, EV_EXIT);
+    ITC_ctrl::connect (audio, EV_SYNC,  &itcc, EV_SYNC);
     ITC_ctrl::connect (audio, EV_QMIDI, model, EV_QMIDI);
     ITC_ctrl::connect (audio, TO_MODEL, model, FM_AUDIO);
 #ifdef __linux__
-    ITC_ctrl::connect (imidi, EV_EXIT,  &itcc, EV_EXIT);
-    ITC_ctrl::connect (imidi, EV_QMIDI, model, EV_QMIDI);
-    ITC_ctrl::connect (imidi, TO_MODEL, model, FM_IMIDI);
+    if (imidi)
+    {
+        ITC_ctrl::connect (imidi, EV_EXIT,  &itcc, EV_EXIT);
+        ITC_ctrl::connect (imidi, EV_QMIDI, model, EV_QMIDI);
+        ITC_ctrl::connect (imidi, TO_MODEL, model, FM_IMIDI);
+    }
 #endif
     ITC_ctrl::connect (model, EV_EXIT,  &itcc, EV_EXIT);
     ITC_ctrl::connect (model, TO_AUDIO, audio, FM_MODEL);
@@ -302,44 +383,62 @@ int main (int ac, char *av [])
     ITC_ctrl::connect (iface, EV_EXIT,  &itcc, EV_EXIT);
     ITC_ctrl::connect (iface, TO_MODEL, model, FM_IFACE);
 
+    Startup::begin ("start");
     audio->start ();
 #ifdef __linux__
-    if (imidi->thr_start (SCHED_FIFO, audio->relpri () - 20, 0))
+    if (imidi && imidi->thr_start (SCHED_FIFO, audio->relpri () - 20, 0))
     {
         fprintf (stderr, "Warning: can't run midi thread in RT mode.\n");
         imidi->thr_start (SCHED_OTHER, 0, 0);
     }
 #endif
-    if (model->thr_start (SCHED_FIFO, audio->relpri () - 30, 0))
+    if (F_val) model->thr_start (SCHED_OTHER, 0, 0);
+    else if (model->thr_start (SCHED_FIFO, audio->relpri () - 30, 0))
     {
         fprintf (stderr, "Warning: can't run model thread in RT mode.\n");
         model->thr_start (SCHED_OTHER, 0, 0);
     }
     slave->thr_start (SCHED_OTHER, 0, 0);
     iface->thr_start (SCHED_OTHER, 0, 0);
+    Startup::end ("start");
 
-    signal (SIGINT, sigint_handler);
+    if (F_val)
+    {
+        // Exit when the render is complete. An early exit from the
+        // interface, e.g. at end of input in text mode, is counted
+        // but does not stop the render.
+        itcc.get_event (1 << EV_SYNC);
+        model->terminate ();
+        slave->terminate ();
+        iface->terminate ();
+        n = 3;
+        while (n--) itcc.get_event (1 << EV_EXIT);
+    }
+    else
+    {
+        signal (SIGINT, sigint_handler);
 #ifdef __linux__
-    n = 4;  // Linux: imidi, model, slave, iface threads
+        n = 4;  // Linux: imidi, model, slave, iface threads
 #else
-    n = 3;  // macOS: model, slave, iface threads (no separate imidi thread)
+        n = 3;  // macOS: model, slave, iface threads (no separate imidi thread)
 #endif
-    while (n)
-    {
-        itcc.get_event (1 << EV_EXIT);
+        while (n)
         {
+            itcc.get_event (1 << EV_EXIT);
+            {
 #ifdef __linux__
-            if (n-- == 4)
+                if (n-- == 4)
 #else
-            if (n-- == 3)
+                if (n-- == 3)
 #endif
-            {
+                {
 #ifdef __linux__
-                imidi->terminate ();
+                    imidi->terminate ();
 #endif
-                model->terminate ();
-                slave->terminate ();
-                iface->terminate ();
+                    model->terminate ();
+                    slave->terminate ();
+                    iface->terminate ();
+                }
             }
         }
     }
@@ -199,12 +199,12 @@ void Mainwin::handle_callb (int k, X_window *W, XEvent *E)
                 break;
 
             case B_PREV:
-                _mesg = new ITC_mesg (MT_IFC_PRDEC);
+                _mesg = new M_pooled (MT_IFC_PRDEC);
                 _callb->handle_callb (CB_MAIN_MSG, this, 0);
                 break;
 
             case B_NEXT:
-                _mesg = new ITC_mesg (MT_IFC_PRINC);
+                _mesg = new M_pooled (MT_IFC_PRINC);
                 _callb->handle_callb (CB_MAIN_MSG, this, 0);
                 break;
 
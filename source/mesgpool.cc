@@ -0,0 +1,125 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <new>
+#include "mesgpool.h"
+
+
+// Sizes for the interface notifications, the rank messages,
+// and those with a path.
+
+Mesgpool  Mesgpool::_pools [Mesgpool::NPOOL] = { { 64, 1024 }, { 160, 1024 }, { 1088, 16 } };
+std::atomic<unsigned int>  Mesgpool::_misses (0);
+
+
+Mesgpool::Mesgpool (size_t size, int count) :
+    _size (size),
+    _step (sizeof (Block) + size),
+    _count (count),
+    _head (0),
+    _inuse (0)
+{
+    int i;
+
+    _step = (_step + 15) & ~(size_t) 15;
+    _data = new char [_step * count];
+    for (i = count - 1; i >= 0; i--)
+    {
+        new (block (i)) Block;
+        block (i)->_pool = this;
+        block (i)->_index = i;
+        give (block (i));
+    }
+    _inuse = 0;
+}
+
+
+void *Mesgpool::take (void)
+{
+    uint64_t  h, n;
+    Block     *B;
+
+    // A version count in the head makes a block that was taken and
+    // given back meanwhile fail the exchange.
+    h = _head.load (std::memory_order_acquire);
+    do
+    {
+        if (! (uint32_t) h) return 0;
+        B = block ((int)(uint32_t) h - 1);
+        n = (((h >> 32) + 1) << 32) | (uint32_t) B->_next.load (std::memory_order_relaxed);
+    }
+    while (! _head.compare_exchange_weak (h, n, std::memory_order_acquire, std::memory_order_acquire));
+    _inuse.fetch_add (1, std::memory_order_relaxed);
+    return B + 1;
+}
+
+
+void Mesgpool::give (Block *B)
+{
+    uint64_t  h, n;
+
+    h = _head.load (std::memory_order_relaxed);
+    do
+    {
+        B->_next.store ((int32_t)(uint32_t) h, std::memory_order_relaxed);
+        n = (((h >> 32) + 1) << 32) | (uint32_t)(B->_index + 1);
+    }
+    while (! _head.compare_exchange_weak (h, n, std::memory_order_release, std::memory_order_relaxed));
+    _inuse.fetch_sub (1, std::memory_order_relaxed);
+}
+
+
+void *Mesgpool::alloc (size_t n)
+{
+    int    i;
+    void   *p;
+    Block  *B;
+
+    for (i = 0; i < NPOOL; i++)
+    {
+        if (n > _pools [i]._size) continue;
+        if ((p = _pools [i].take ())) return p;
+    }
+    _misses.fetch_add (1, std::memory_order_relaxed);
+    B = (Block *) ::operator new (sizeof (Block) + n);
+    B->_pool = 0;
+    return B + 1;
+}
+
+
+void Mesgpool::release (void *p)
+{
+    Block *B;
+
+    if (! p) return;
+    B = (Block *) p - 1;
+    if (B->_pool) B->_pool->give (B);
+    else ::operator delete (B);
+}
+
+
+unsigned int Mesgpool::inuse (void)
+{
+    int  i, n;
+
+    for (i = n = 0; i < NPOOL; i++) n += _pools [i]._inuse.load (std::memory_order_relaxed);
+    return n;
+}
+
@@ -0,0 +1,81 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __MESGPOOL_H
+#define __MESGPOOL_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+
+// Memory for the messages passed between threads, see M_pooled in
+// messages.h. Blocks of a few sizes are allocated at startup, and
+// any thread can take or return one without locking or calling the
+// heap, so the audio thread may do either. Larger messages, and any
+// when a pool is empty, come from the heap.
+
+
+class Mesgpool
+{
+public:
+
+    // A block of at least n bytes.
+    static void *alloc (size_t n);
+    // Returns a block to where it came from.
+    static void  release (void *p);
+
+    // Blocks taken from the pools, and allocated on the heap.
+    static unsigned int inuse (void);
+    static unsigned int misses (void) { return _misses.load (std::memory_order_relaxed); }
+
+private:
+
+    enum { NPOOL = 3 };
+
+    struct Block
+    {
+        Mesgpool              *_pool;   // or 0 if on the heap
+        std::atomic<int32_t>   _next;   // index + 1 of the next free block
+        int32_t                _index;
+    };
+
+    // Never deleted, messages may be returned until the end.
+    Mesgpool (size_t size, int count);
+
+    void *take (void);
+    void  give (Block *B);
+    Block *block (int i) { return (Block *)(_data + (size_t) i * _step); }
+
+    size_t                  _size;
+    size_t                  _step;
+    int                     _count;
+    char                   *_data;
+    std::atomic<uint64_t>   _head;    // version << 32 | index + 1
+    std::atomic<int>        _inuse;
+
+    static Mesgpool                    _pools [NPOOL];
+    static std::atomic<unsigned int>   _misses;
+};
+
+
+#endif
+
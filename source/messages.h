@@ -21,13 +21,20 @@
 #ifndef __MESSAGES_H
 #define __MESSAGES_H
 
+#include <stdio.h>
 #include <string.h>
 #include "rankwave.h"
 #include "asection.h"
+#include "division.h"
 #include "addsynth.h"
+#include "perfstats.h"
+#include "mesgpool.h"
 #include "global.h"
 
 
+class Capture;
+
+
 enum
 {
     FM_SLAVE =  8,
@@ -60,6 +67,10 @@ enum
     MT_CALC_RANK,
     MT_LOAD_RANK,
     MT_SAVE_RANK,
+    MT_DROP_RANK,
+    MT_WARM_RANK,
+    MT_AUDIO_FLUSH,
+    MT_NEW_INSTR,
 
     MT_IFC_INIT,
     MT_IFC_READY,
@@ -84,7 +95,23 @@ enum
     MT_IFC_EDIT,
     MT_IFC_APPLY,
     MT_IFC_SAVE,
-    MT_IFC_TXTIP
+    MT_IFC_TXTIP,
+    MT_IFC_CAPTURE,
+    MT_IFC_RELOAD
+};
+
+
+// Base of the messages, their memory is taken from Mesgpool so
+// that passing them between threads does not use the heap.
+
+class M_pooled : public ITC_mesg
+{
+public:
+
+    M_pooled (unsigned long type) : ITC_mesg (type) {}
+
+    static void *operator new (size_t n) { return Mesgpool::alloc (n); }
+    static void operator delete (void *p) { Mesgpool::release (p); }
 };
 
 
@@ -93,25 +120,28 @@ enum
 #define SRC_MIDI_PAR  200
 
 
-class M_audio_info : public ITC_mesg
+class M_audio_info : public M_pooled
 {
 public:
 
-    M_audio_info (void) : ITC_mesg (MT_AUDIO_INFO) {}
+    M_audio_info (void) : M_pooled (MT_AUDIO_INFO) {}
 
     float           _fsamp;
     int             _fsize;
     int             _nasect;
     Fparm          *_instrpar;
     Fparm          *_asectpar [NASECT];
+    Perfstats      *_perfstats;
+    Capture        *_capture;
+    Lfq_ptr        *_qdead;     // ranks the audio thread no longer uses
 };
 
 
-class M_midi_info : public ITC_mesg
+class M_midi_info : public M_pooled
 {
 public:
 
-    M_midi_info (void) : ITC_mesg (MT_MIDI_INFO) {}
+    M_midi_info (void) : M_pooled (MT_MIDI_INFO) {}
 
     int       _client;
     int       _ipport;
@@ -119,11 +149,11 @@ public:
 };
 
 
-class M_new_divis : public ITC_mesg
+class M_new_divis : public M_pooled
 {
 public:
 
-    M_new_divis (void) : ITC_mesg (MT_NEW_DIVIS) {}
+    M_new_divis (void) : M_pooled (MT_NEW_DIVIS) {}
 
     int             _flags;
     int             _keybd;
@@ -134,14 +164,19 @@ public:
 };
 
 
-class M_def_rank : public ITC_mesg
+class M_def_rank : public M_pooled
 {
 public:
 
-    M_def_rank (int type) : ITC_mesg (type) {}
+    M_def_rank (int type) :
+        M_pooled (type), _gen (0), _time (Perfstats::tnow ()), _unit (-1), _offs (0), _target (0), _share (0) {}
 
+    int             _gen;     // Model::_count when sent
+    int64_t         _time;    // when sent
     int             _divis;
     int             _rank;
+    int             _unit;    // extended rank, or -1
+    int             _offs;
     int             _group;
     int             _ifelm;
     float           _fsamp;
@@ -150,14 +185,33 @@ public:
     Addsynth       *_synth;
     Rankwave       *_rwave;
     const char     *_path;
+    Division       *_target;  // not yet in use, filled by the Slave, or 0
+    Rankwave       *_share;   // rank with the same waves, or 0
+};
+
+
+class M_new_instr : public M_pooled
+{
+public:
+
+    // The divisions of a new instrument, swapped with those of
+    // the audio thread, which returns the old ones.
+    M_new_instr (void) : M_pooled (MT_NEW_INSTR), _ndivis (0)
+    {
+        for (int i = 0; i < NDIVIS; i++) _divisp [i] = 0;
+    }
+
+    int             _ndivis;
+    int             _asect [NDIVIS];
+    Division       *_divisp [NDIVIS];
 };
 
 
-class M_ifc_init : public ITC_mesg
+class M_ifc_init : public M_pooled
 {
 public:
 
-    M_ifc_init (void) : ITC_mesg (MT_IFC_INIT) {}
+    M_ifc_init (void) : M_pooled (MT_IFC_INIT) {}
 
     const char         *_stopsdir;
     const char         *_wavesdir;
@@ -170,6 +224,8 @@ public:
     int                 _ndivis;
     int                 _ngroup;
     int                 _ntempe;
+    Perfstats          *_perfstats;
+    Capture            *_capture;
     struct
     {
         const char     *_label;
@@ -200,12 +256,12 @@ public:
 };
 
 
-class M_ifc_ifelm : public ITC_mesg
+class M_ifc_ifelm : public M_pooled
 {
 public:
 
     M_ifc_ifelm (int type, int g, int i) :
-        ITC_mesg (type),
+        M_pooled (type),
         _group (g),
         _ifelm (i)
     {}
@@ -215,12 +271,12 @@ public:
 };
 
 
-class M_ifc_aupar : public ITC_mesg
+class M_ifc_aupar : public M_pooled
 {
 public:
 
     M_ifc_aupar (int s, int a, int p, float v) :
-        ITC_mesg (MT_IFC_AUPAR),
+        M_pooled (MT_IFC_AUPAR),
         _srcid (s),
         _asect (a),
         _parid (p),
@@ -234,12 +290,12 @@ public:
 };
 
 
-class M_ifc_dipar : public ITC_mesg
+class M_ifc_dipar : public M_pooled
 {
 public:
 
     M_ifc_dipar (int s, int d, int p, float v) :
-        ITC_mesg (MT_IFC_DIPAR),
+        M_pooled (MT_IFC_DIPAR),
         _srcid (s),
         _divis (d),
         _parid (p),
@@ -253,12 +309,12 @@ public:
 };
 
 
-class M_ifc_retune : public ITC_mesg
+class M_ifc_retune : public M_pooled
 {
 public:
 
     M_ifc_retune (float f, int t) :
-        ITC_mesg (MT_IFC_RETUNE),
+        M_pooled (MT_IFC_RETUNE),
         _freq (f),
         _temp (t)
     {}
@@ -268,12 +324,12 @@ public:
 };
 
 
-class M_ifc_chconf : public ITC_mesg
+class M_ifc_chconf : public M_pooled
 {
 public:
 
     M_ifc_chconf (int type, int index, uint16_t *bits) :
-        ITC_mesg (type),
+        M_pooled (type),
         _index (index)
     {
         if (bits) memcpy (_bits, bits, 16 * sizeof (uint16_t));
@@ -285,12 +341,12 @@ public:
 };
 
 
-class M_ifc_preset : public ITC_mesg
+class M_ifc_preset : public M_pooled
 {
 public:
 
     M_ifc_preset (int type, int bank, int pres, int stat, uint32_t *bits) :
-        ITC_mesg (type),
+        M_pooled (type),
         _bank (bank),
         _pres (pres),
         _stat (stat)
@@ -306,12 +362,12 @@ public:
 };
 
 
-class M_ifc_edit : public ITC_mesg
+class M_ifc_edit : public M_pooled
 {
 public:
 
     M_ifc_edit (int type, int group, int ifelm, Addsynth *synth) :
-        ITC_mesg (type),
+        M_pooled (type),
         _group (group),
         _ifelm (ifelm),
         _synth (synth)
@@ -323,12 +379,12 @@ public:
 };
 
 
-class M_ifc_txtip : public ITC_mesg
+class M_ifc_txtip : public M_pooled
 {
 public:
 
     M_ifc_txtip (void) :
-        ITC_mesg (MT_IFC_TXTIP),
+        M_pooled (MT_IFC_TXTIP),
         _line (0)
     {}
 
@@ -336,5 +392,44 @@ public:
 };
 
 
+class M_ifc_capture : public M_pooled
+{
+public:
+
+    // To the model: _stat is 1 to start, 0 to stop, an empty path
+    // selects a default file name. From the model: _stat is 1 when
+    // recording, 0 when stopped, -1 if the capture failed to start.
+    M_ifc_capture (int stat, bool stems, const char *path) :
+        M_pooled (MT_IFC_CAPTURE),
+        _stat (stat),
+        _stems (stems)
+    {
+        if (path) snprintf (_path, 1024, "%s", path);
+        else      _path [0] = 0;
+    }
+
+    int   _stat;
+    bool  _stems;
+    char  _path [1024];
+};
+
+
+class M_ifc_reload : public M_pooled
+{
+public:
+
+    // Instrument directory, relative to the stops directory.
+    // An empty name reloads the current one.
+    M_ifc_reload (const char *instr) :
+        M_pooled (MT_IFC_RELOAD)
+    {
+        if (instr) snprintf (_instr, 1024, "%s", instr);
+        else       _instr [0] = 0;
+    }
+
+    char  _instr [1024];
+};
+
+
 #endif
 
@@ -19,6 +19,7 @@
 
 
 #include "midi_backend.h"
+#include "tracer.h"
 
 
 MidiBackend::MidiBackend (const char *name, Lfq_u32 *qnote, Lfq_u8 *qmidi, uint16_t *midimap, const char *appname) :
@@ -29,7 +30,8 @@ MidiBackend::MidiBackend (const char *name, Lfq_u32 *qnote, Lfq_u8 *qmidi, uint1
     _appname (appname),
     _client (0),
     _ipport (0),
-    _opport (0)
+    _opport (0),
+    _perfstats (0)
 {
 }
 
@@ -41,6 +43,7 @@ MidiBackend::~MidiBackend (void)
 
 void MidiBackend::thr_main (void)
 {
+    Tracer::thread ("midi");
     open_midi ();
     proc_midi ();
     close_midi ();
@@ -26,6 +26,7 @@
 #include "lfqueue.h"
 #include "midi_processor.h"
 #include "messages.h"
+#include "perfstats.h"
 
 
 class MidiBackend : public A_thread, public MidiProcessor::Handler
@@ -38,6 +39,8 @@ public:
     // Pure virtual interface - must be implemented by subclasses
     virtual void terminate (void) = 0;
 
+    void set_perfstats (Perfstats *P) { _perfstats = P; }
+
     // MidiProcessor::Handler implementation (base class provides no-op)
     void key_on(int note, int keyboard) override;
     void key_off(int note, int keyboard) override;
@@ -63,6 +66,7 @@ protected:
     int             _client;
     int             _ipport;
     int             _opport;
+    Perfstats      *_perfstats;
 
 private:
 
@@ -24,7 +24,7 @@
 void MidiProcessor::process_midi_event(
     uint8_t status, uint8_t data1, uint8_t data2, uint8_t channel,
     uint16_t* midimap, Handler* handler,
-    Lfq_u32* qnote, Lfq_u8* qmidi)
+    Lfq_u32* qnote, Lfq_u8* qmidi, Coalescer* merge)
 {
     uint8_t msg_type = status & 0xF0;
 
@@ -37,7 +37,7 @@ void MidiProcessor::process_midi_event(
         break;
 
     case 0xB0:  // Controller
-        process_controller_event(data1, data2, channel, midimap, handler, qnote, qmidi);
+        process_controller_event(data1, data2, channel, midimap, handler, qnote, qmidi, merge);
         break;
 
     case 0xC0:  // Program change
@@ -97,7 +97,8 @@ void MidiProcessor::process_note_event(
 
 void MidiProcessor::process_controller_event(
     uint8_t controller, uint8_t value, uint8_t channel,
-    uint16_t* midimap, Handler* handler, Lfq_u32* qnote, Lfq_u8* qmidi)
+    uint16_t* midimap, Handler* handler, Lfq_u32* qnote, Lfq_u8* qmidi,
+    Coalescer* merge)
 {
     uint16_t k = midimap[channel] & 15;
     uint16_t f = midimap[channel] >> 12;
@@ -135,7 +136,8 @@ void MidiProcessor::process_controller_event(
 
     case MIDICTL_BANK:
     case MIDICTL_IFELM:
-        // Bank select or interface element control - control channels only
+    case MIDICTL_CAPTURE:
+        // Bank select, interface element or capture control - control channels only
         if (f & 4)
         {
             write_midi_queue(qmidi, 0xB0 | channel, controller, value);
@@ -148,13 +150,63 @@ void MidiProcessor::process_controller_event(
         // Division performance controls - division channels only
         if (f & 2)
         {
-            write_midi_queue(qmidi, 0xB0 | channel, controller, value);
+            if (merge) merge->store(channel, controller, value);
+            else write_midi_queue(qmidi, 0xB0 | channel, controller, value);
         }
         break;
     }
 }
 
 
+int MidiProcessor::Coalescer::index(uint8_t controller)
+{
+    switch (controller)
+    {
+    case MIDICTL_SWELL: return 0;
+    case MIDICTL_TFREQ: return 1;
+    case MIDICTL_TMODD: return 2;
+    }
+    return -1;
+}
+
+
+void MidiProcessor::Coalescer::store(uint8_t channel, uint8_t controller, uint8_t value)
+{
+    int i = index(controller);
+    if (i < 0) return;
+
+    uint8_t e = (channel & 15) * NCTL + i;
+    for (int j = 0; j < _nlist; j++)
+    {
+        if (_list[j] == e)
+        {
+            // Already pending, the new value replaces it.
+            _value[channel & 15][i] = value;
+            _nmerg++;
+            return;
+        }
+    }
+    _value[channel & 15][i] = value;
+    _list[_nlist++] = e;
+}
+
+
+int MidiProcessor::Coalescer::flush(Lfq_u8* qmidi)
+{
+    static const uint8_t ctl[NCTL] = { MIDICTL_SWELL, MIDICTL_TFREQ, MIDICTL_TMODD };
+    int n = 0;
+
+    for (int j = 0; j < _nlist; j++)
+    {
+        uint8_t c = _list[j] / NCTL;
+        uint8_t i = _list[j] % NCTL;
+        if (write_midi_queue(qmidi, 0xB0 | c, ctl[i], _value[c][i])) n++;
+    }
+    _nlist = 0;
+    return n;
+}
+
+
 bool MidiProcessor::is_note_on(uint8_t status, uint8_t velocity)
 {
     return ((status & 0xF0) == 0x90) && (velocity > 0);
@@ -42,11 +42,31 @@ public:
         virtual void hold_pedal(int keyboard, bool on) = 0;
     };
 
+    // Collects swell and tremulant controllers so that only the
+    // latest value for each channel and controller is sent on.
+    // A flood from a moving pedal then costs one queue entry per
+    // batch instead of one per event.
+    class Coalescer {
+    public:
+        Coalescer() : _nlist(0), _nmerg(0) {}
+        void store(uint8_t channel, uint8_t controller, uint8_t value);
+        int  flush(Lfq_u8* qmidi);
+        int  pending() const { return _nlist; }
+        int  merged() { int n = _nmerg; _nmerg = 0; return n; }
+    private:
+        enum { NCTL = 3 };
+        static int index(uint8_t controller);
+        uint8_t  _value[16][NCTL];
+        uint8_t  _list[16 * NCTL];  // pending entries, in arrival order
+        int      _nlist;
+        int      _nmerg;            // events replaced by a later one
+    };
+
     // Process raw MIDI events - common logic extracted from both backends
     static void process_midi_event(
         uint8_t status, uint8_t data1, uint8_t data2, uint8_t channel,
         uint16_t* midimap, Handler* handler, 
-        Lfq_u32* qnote, Lfq_u8* qmidi);
+        Lfq_u32* qnote, Lfq_u8* qmidi, Coalescer* merge = nullptr);
 
     // Helper functions for MIDI event classification
     static bool is_note_on(uint8_t status, uint8_t velocity);
@@ -67,7 +87,8 @@ private:
     // Common controller processing logic  
     static void process_controller_event(
         uint8_t controller, uint8_t value, uint8_t channel,
-        uint16_t* midimap, Handler* handler, Lfq_u32* qnote, Lfq_u8* qmidi);
+        uint16_t* midimap, Handler* handler, Lfq_u32* qnote, Lfq_u8* qmidi,
+        Coalescer* merge);
 };
 
 
@@ -0,0 +1,259 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "midifile.h"
+
+
+static uint32_t get_u32 (const uint8_t *p)
+{
+    return (p [0] << 24) | (p [1] << 16) | (p [2] << 8) | p [3];
+}
+
+
+static uint32_t get_u16 (const uint8_t *p)
+{
+    return (p [0] << 8) | p [1];
+}
+
+
+static int get_var (const uint8_t **p, const uint8_t *e, uint32_t *v)
+{
+    int      i;
+    uint8_t  b;
+
+    *v = 0;
+    for (i = 0; i < 4; i++)
+    {
+        if (*p >= e) return 1;
+        b = *(*p)++;
+        *v = (*v << 7) | (b & 0x7F);
+        if (! (b & 0x80)) return 0;
+    }
+    return 1;
+}
+
+
+Midifile::Midifile (void) :
+    _division (0),
+    _nitem (0),
+    _mitem (0),
+    _item (0),
+    _nevent (0),
+    _event (0)
+{
+}
+
+
+Midifile::~Midifile (void)
+{
+    delete[] _item;
+    delete[] _event;
+}
+
+
+void Midifile::add_item (uint32_t tick, uint32_t seq, uint32_t tempo, const uint8_t *d)
+{
+    Item  *p;
+
+    if (_nitem == _mitem)
+    {
+        _mitem = _mitem ? 2 * _mitem : 1024;
+        p = new Item [_mitem];
+        if (_nitem) memcpy (p, _item, _nitem * sizeof (Item));
+        delete[] _item;
+        _item = p;
+    }
+    p = _item + _nitem++;
+    p->_tick = tick;
+    p->_seq = seq;
+    p->_tempo = tempo;
+    p->_data [0] = d ? d [0] : 0;
+    p->_data [1] = d ? d [1] : 0;
+    p->_data [2] = d ? d [2] : 0;
+}
+
+
+int Midifile::read_track (const uint8_t *p, int n, uint32_t *seq)
+{
+    const uint8_t  *e = p + n;
+    uint32_t        tick, dt, len;
+    uint8_t         d [3], st, type;
+
+    tick = 0;
+    st = 0;
+    while (p < e)
+    {
+        if (get_var (&p, e, &dt) || (p >= e)) return 1;
+        tick += dt;
+        if (*p & 0x80) d [0] = *p++;
+        else if (st) d [0] = st;   // Running status.
+        else return 1;
+
+        if (d [0] < 0xF0)
+        {
+            st = d [0];
+            n = ((d [0] & 0xE0) == 0xC0) ? 1 : 2;
+            if (p + n > e) return 1;
+            d [1] = p [0];
+            d [2] = (n == 2) ? p [1] : 0;
+            p += n;
+            add_item (tick, (*seq)++, 0, d);
+        }
+        else if ((d [0] == 0xF0) || (d [0] == 0xF7))
+        {
+            st = 0;
+            if (get_var (&p, e, &len) || (len > (uint32_t)(e - p))) return 1;
+            p += len;
+        }
+        else if (d [0] == 0xFF)
+        {
+            st = 0;
+            if (p >= e) return 1;
+            type = *p++;
+            if (get_var (&p, e, &len) || (len > (uint32_t)(e - p))) return 1;
+            if (type == 0x2F) return 0;
+            if ((type == 0x51) && (len == 3))
+            {
+                add_item (tick, (*seq)++, (p [0] << 16) | (p [1] << 8) | p [2], 0);
+            }
+            p += len;
+        }
+        else return 1;
+    }
+    return 0;
+}
+
+
+int Midifile::compare (const void *a, const void *b)
+{
+    const Item *A = (const Item *) a;
+    const Item *B = (const Item *) b;
+
+    if (A->_tick != B->_tick) return (A->_tick < B->_tick) ? -1 : 1;
+    if (A->_seq != B->_seq) return (A->_seq < B->_seq) ? -1 : 1;
+    return 0;
+}
+
+
+int Midifile::load (const char *path)
+{
+    FILE       *F;
+    uint8_t    *buf, *p, *e;
+    long        size;
+    uint32_t    len, seq, tempo, tick;
+    int         i, k, format, ntrk, fps;
+    double      time, spt;
+
+    delete[] _item;
+    delete[] _event;
+    _item = 0;
+    _event = 0;
+    _nitem = _mitem = _nevent = 0;
+
+    if (! (F = fopen (path, "r")))
+    {
+        fprintf (stderr, "Can't open '%s' for reading\n", path);
+        return 1;
+    }
+    fseek (F, 0, SEEK_END);
+    size = ftell (F);
+    fseek (F, 0, SEEK_SET);
+    buf = new uint8_t [size > 0 ? size : 1];
+    if ((size < 14) || (fread (buf, 1, size, F) != (size_t) size) || memcmp (buf, "MThd", 4))
+    {
+        fprintf (stderr, "File '%s' is not a MIDI file\n", path);
+        fclose (F);
+        delete[] buf;
+        return 1;
+    }
+    fclose (F);
+
+    len = get_u32 (buf + 4);
+    format = get_u16 (buf + 8);
+    ntrk = get_u16 (buf + 10);
+    _division = get_u16 (buf + 12);
+    if ((len < 6) || (format > 1) || (_division == 0))
+    {
+        fprintf (stderr, "File '%s': unsupported MIDI file format %d\n", path, format);
+        delete[] buf;
+        return 1;
+    }
+
+    // Read all tracks. The sequence number keeps the order of events
+    // at the same tick, with the tempo track first.
+    p = buf + 8 + len;
+    e = buf + size;
+    seq = 0;
+    k = 0;
+    while ((k < ntrk) && (p + 8 <= e))
+    {
+        len = get_u32 (p + 4);
+        if (len > (uint32_t)(e - p - 8)) len = e - p - 8;
+        if (! memcmp (p, "MTrk", 4))
+        {
+            if (read_track (p + 8, len, &seq))
+            {
+                fprintf (stderr, "File '%s': error in track %d\n", path, k + 1);
+                delete[] buf;
+                return 1;
+            }
+            k++;
+        }
+        p += 8 + len;
+    }
+    delete[] buf;
+    if (_nitem) qsort (_item, _nitem, sizeof (Item), compare);
+
+    // Convert ticks to seconds.
+    if (_division & 0x8000)
+    {
+        fps = -(int8_t)(_division >> 8);
+        spt = 1.0 / (((fps == 29) ? 29.97 : fps) * (_division & 0xFF));
+    }
+    else spt = 0;
+    _event = new Midievent [_nitem ? _nitem : 1];
+    tempo = 500000;
+    tick = 0;
+    time = 0;
+    for (i = 0; i < _nitem; i++)
+    {
+        if (spt) time = _item [i]._tick * spt;
+        else
+        {
+            time += (_item [i]._tick - tick) * 1e-6 * tempo / _division;
+            tick = _item [i]._tick;
+        }
+        if (_item [i]._tempo) tempo = _item [i]._tempo;
+        else
+        {
+            _event [_nevent]._time = time;
+            memcpy (_event [_nevent]._data, _item [i]._data, 3);
+            _nevent++;
+        }
+    }
+    delete[] _item;
+    _item = 0;
+    _nitem = _mitem = 0;
+    return 0;
+}
+
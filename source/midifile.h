@@ -0,0 +1,83 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __MIDIFILE_H
+#define __MIDIFILE_H
+
+
+#include <stdint.h>
+
+
+// A channel message from a Standard MIDI File, with its time
+// in seconds from the start of the file.
+
+class Midievent
+{
+public:
+
+    double    _time;
+    uint8_t   _data [3];
+};
+
+
+// Reads a Standard MIDI File (format 0 or 1) into a single list of
+// channel messages, sorted by time. Tempo changes are applied, all
+// other meta events and sysex messages are skipped.
+
+class Midifile
+{
+public:
+
+    Midifile (void);
+    ~Midifile (void);
+
+    int  load (const char *path);
+    int  nevent (void) const { return _nevent; }
+    const Midievent *event (int i) const { return _event + i; }
+
+private:
+
+    Midifile (const Midifile&);
+    Midifile& operator=(const Midifile&);
+
+    class Item
+    {
+    public:
+
+        uint32_t  _tick;
+        uint32_t  _seq;
+        uint32_t  _tempo;   // zero for channel messages
+        uint8_t   _data [3];
+    };
+
+    int  read_track (const uint8_t *p, int n, uint32_t *seq);
+    void add_item (uint32_t tick, uint32_t seq, uint32_t tempo, const uint8_t *d);
+    static int compare (const void *a, const void *b);
+
+    int          _division;
+    int          _nitem;
+    int          _mitem;
+    Item        *_item;
+    int          _nevent;
+    Midievent   *_event;
+};
+
+
+#endif
@@ -23,9 +23,19 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #include "model.h"
+#include "capture.h"
 #include "scales.h"
 #include "global.h"
+#include "tracer.h"
+#include "startup.h"
 
 
 Divis::Divis (void) :
@@ -90,10 +100,21 @@ Model::Model (Lfq_u32      *qcomm,
     _nkeybd (0),
     _ngroup (0),
     _count (0),
+    _nsync (0),
+    _igen (0),
+    _prev (0),
+    _reload (0),
+    _nreuse (0),
+    _treload (0),
+    _pfbase (0),
+    _pitemp (0),
+    _psave (false),
     _bank (0),
     _pres (0),
     _sc_cmode (0),
     _sc_group (0),
+    _wavemem (0),
+    _tuse (0),
     _audio (0),
     _midi (0)
 {
@@ -113,8 +134,11 @@ Model::~Model (void)
 
 void Model::thr_main (void)
 {
-    int E;
+    int        E, t;
+    char       s [1024];
+    ITC_mesg  *M;
 
+    Tracer::thread ("model");
     init ();
     set_time (0);
     inc_time (100000);
@@ -126,12 +150,23 @@ void Model::thr_main (void)
         case FM_IMIDI:
         case FM_SLAVE:
         case FM_IFACE:
-            proc_mesg (get_message ());
+            M = get_message ();
+            t = M->type ();
+            Tracer::begin ("model_mesg", t);
+            proc_mesg (M);
+            Tracer::end ("model_mesg", t);
             break;
 
         case EV_TIME:
             inc_time (50000);
             proc_qmidi ();
+            proc_qdead ();
+            if (Tracer::pending ())
+            {
+                // An xrun froze the trace rings.
+                if (Tracer::dump (0, s)) fprintf (stderr, "Can't write trace file '%s'.\n", s);
+                else fprintf (stderr, "Xrun, trace written to '%s'.\n", s);
+            }
             break;
 
         case EV_QMIDI:
@@ -149,8 +184,27 @@ void Model::thr_main (void)
 
 void Model::init (void)
 {
-    read_instr ();
+    int r;
+
+    Startup::begin ("read_cache");
+    r = read_cache ();
+    Startup::end ("read_cache");
+    if (r)
+    {
+        Startup::begin ("read_instr");
+        r = read_instr ();
+        Startup::end ("read_instr");
+        if (! r)
+        {
+            Startup::begin ("write_cache");
+            write_cache ();
+            Startup::end ("write_cache");
+        }
+    }
+    Startup::begin ("read_presets");
     read_presets ();
+    Startup::end ("read_presets");
+    Startup::begin ("wait_audio");
 }
 
 
@@ -321,20 +375,50 @@ void Model::proc_mesg (ITC_mesg *M)
         save ();
         break;
 
+    case MT_IFC_CAPTURE:
+    {
+        // Start or stop recording the audio output.
+        M_ifc_capture *X = (M_ifc_capture *) M;
+        set_capture (X->_stat, X->_stems, X->_path);
+        break;
+    }
+
     case MT_LOAD_RANK:
     case MT_CALC_RANK:
+    case MT_DROP_RANK:
     {
         // Load a rank into a division.
         M_def_rank *X = (M_def_rank *) M;
-        _divis [X->_divis]._ranks [X->_rank]._rwave = X->_rwave;
+        // Ranks of the previous instrument are deleted with it.
+        if (X->_gen < _igen) break;
+        Rank *R = _divis [X->_divis]._ranks + X->_rank;
+        R->_rwave = X->_rwave;
+        if ((M->type () != MT_DROP_RANK) && (R->_resid == Rank::LOADING))
+        {
+            R->_resid = Rank::RESIDENT;
+            R->_stale = false;
+            R->_size = R->_rwave->size ();
+            // Only loads on demand are timed.
+            if (R->_tload) _audio->_perfstats->add_reload (1e-6f * (Perfstats::tnow () - R->_tload));
+        }
+        evict_ranks ();
         break;
     }
     case MT_AUDIO_INFO:
+        if (_audio)
+        {
+            // Sample rate change, regenerate all ranks.
+            _audio->_fsamp = ((M_audio_info *) M)->_fsamp;
+            _audio->_fsize = ((M_audio_info *) M)->_fsize;
+            if (_midi) init_ranks (MT_CALC_RANK);
+            break;
+        }
         // Initialisation info from audio thread.
         _audio = (M_audio_info *) M;
         M = 0;
         if (_midi)
         {
+            Startup::end ("wait_audio");
             init_audio ();
             init_iface ();
             init_ranks (MT_LOAD_RANK);
@@ -347,6 +431,7 @@ void Model::proc_mesg (ITC_mesg *M)
         M = 0;
         if (_audio)
         {
+            Startup::end ("wait_audio");
             init_audio ();
             init_iface ();
             init_ranks (MT_LOAD_RANK);
@@ -354,9 +439,32 @@ void Model::proc_mesg (ITC_mesg *M)
         break;
 
     case MT_AUDIO_SYNC:
-        // Wavetable calculation done.
-        send_event (TO_IFACE, new ITC_mesg (MT_IFC_READY));
+        // Wavetable calculation done, unless more batches
+        // were started in the mean time, or a new instrument
+        // is not yet playing.
+        if ((--_nsync > 0) || _prev) break;
+        send_event (TO_IFACE, new M_pooled (MT_IFC_READY));
         _ready = true;
+        Startup::end ("ranks");
+        Startup::ready ();
+        break;
+
+    case MT_NEW_INSTR:
+        // The audio thread has the new instrument.
+        swap_instr ((M_new_instr *) M);
+        break;
+
+    case MT_IFC_RELOAD:
+        // Change or reload the instrument.
+        reload (((M_ifc_reload *) M)->_instr);
+        break;
+
+    case MT_AUDIO_FLUSH:
+        // Offline rendering: execute pending MIDI commands
+        // now instead of at the next timer tick.
+        proc_qmidi ();
+        send_event (TO_AUDIO, M);
+        M = 0;
         break;
 
     default:
@@ -366,16 +474,45 @@ void Model::proc_mesg (ITC_mesg *M)
 }
 
 
+void Model::proc_qdead (void)
+{
+    int      n;
+    Lfq_ptr *Q;
+
+    // Delete the ranks the audio thread has replaced. This
+    // may free or unmap their waves, which is not done in
+    // the audio thread.
+    if (! _audio || ! (Q = _audio->_qdead)) return;
+    for (n = 0; Q->read_avail (); n++)
+    {
+        delete (Rankwave *) Q->read (0);
+        Q->read_commit (1);
+    }
+#ifdef __GLIBC__
+    // Give the memory of evicted waves back to the system.
+    if (n) malloc_trim (0);
+#endif
+}
+
+
 void Model::proc_qmidi (void)
 {
-    int c, d, p, t, v;
+    int    c, d, p, t, v, m;
+    int    pmask [NDIVIS];
+    float  pval [NDIVIS][3];
 
     // Handle commands from the qmidi queue. These are coming
     // from either the midi thread (ALSA), or the audio thread
     // (JACK). They are encoded as raw MIDI, except that all
     // messages are 3 bytes. All command have already been
     // checked at the sending side.
+    //
+    // Swell and tremulant controllers are collected, and only
+    // the last value for each division and parameter is sent
+    // to the audio thread and the interface.
 
+    for (d = 0; d < NDIVIS; d++) pmask [d] = 0;
+    m = 0;
     while (_qmidi->read_avail () >= 3)
     {
         t = _qmidi->read (0);
@@ -397,17 +534,23 @@ void Model::proc_qmidi (void)
             {
             case MIDICTL_SWELL:
                 // Swell pedal
-                set_dipar (SRC_MIDI_PAR, d, 0, SWELL_MIN + v * (SWELL_MAX - SWELL_MIN) / 127.0f);
+                pval [d][0] = SWELL_MIN + v * (SWELL_MAX - SWELL_MIN) / 127.0f;
+                if (pmask [d] & 1) m++;
+                pmask [d] |= 1;
                 break;
 
             case MIDICTL_TFREQ:
                 // Tremulant frequency
-                set_dipar (SRC_MIDI_PAR, d, 1, TFREQ_MIN + v * (TFREQ_MAX - TFREQ_MIN) / 127.0f);
+                pval [d][1] = TFREQ_MIN + v * (TFREQ_MAX - TFREQ_MIN) / 127.0f;
+                if (pmask [d] & 2) m++;
+                pmask [d] |= 2;
                 break;
 
             case MIDICTL_TMODD:
                 // Tremulant amplitude
-                set_dipar (SRC_MIDI_PAR, d, 2, TMODD_MIN + v * (TMODD_MAX - TMODD_MIN) / 127.0f);
+                pval [d][2] = TMODD_MIN + v * (TMODD_MAX - TMODD_MIN) / 127.0f;
+                if (pmask [d] & 4) m++;
+                pmask [d] |= 4;
                 break;
 
             case MIDICTL_BANK:
@@ -415,6 +558,11 @@ void Model::proc_qmidi (void)
                  if (v < NBANK) _bank = v;
                 break;
 
+            case MIDICTL_CAPTURE:
+                // Capture on/off.
+                set_capture (v > 63, false, 0);
+                break;
+
             case MIDICTL_IFELM:
                 // Stop control.
                 if (v & 64)
@@ -439,6 +587,14 @@ void Model::proc_qmidi (void)
             break;
         }
     }
+    for (d = 0; d < NDIVIS; d++)
+    {
+        for (p = 0; p < 3; p++)
+        {
+            if (pmask [d] & (1 << p)) set_dipar (SRC_MIDI_PAR, d, p, pval [d][p]);
+        }
+    }
+    if (m && _audio) _audio->_perfstats->add_ctl_merge (m);
 }
 
 
@@ -482,6 +638,8 @@ void Model::init_iface (void)
     M->_ndivis = _ndivis;
     M->_ngroup = _ngroup;
     M->_ntempe = NSCALES;
+    M->_perfstats = _audio->_perfstats;
+    M->_capture = _audio->_capture;
     for (i = 0; i < NKEYBD; i++)
     {
         K = _keybd + i;
@@ -543,6 +701,7 @@ void Model::init_ranks (int comm)
 
     _count++;
     _ready = false;
+    Startup::begin ("ranks");
     send_event (TO_IFACE, new M_ifc_retune (_fbase, _itemp));
 
     for (g = 0; g < _ngroup; g++)
@@ -550,46 +709,46 @@ void Model::init_ranks (int comm)
         G = _group + g;
         for (i = 0; i < G->_nifelm; i++) proc_rank (g, i, comm);
     }
-    send_event (TO_SLAVE, new ITC_mesg (MT_AUDIO_SYNC));
+    send_sync ();
 }
 
 
 void Model::proc_rank (int g, int i, int comm)
 {
     int         d, r;
-    M_def_rank  *M;
     Ifelm       *I;
-    Rank        *R;
 
     I = _group [g]._ifelms + i;
     if ((I->_type == Ifelm::DIVRANK) || (I->_type == Ifelm::KBDRANK))
     {
         d = (I->_action0 >>  8) & 255;
         r = (I->_action0 >> 16) & 255;
-        R = _divis [d]._ranks + r;
-        if (comm == MT_SAVE_RANK)
-        {
-            if (R->_rwave->modif ())
-            {
-                M = new M_def_rank (comm);
-                   M->_fsamp = _audio->_fsamp;
-                M->_fbase = _fbase;
-                M->_scale = scales [_itemp]._data;
-                M->_synth = R->_synth;
-                M->_rwave = R->_rwave;
-                M->_path  = _wavesdir;
-                send_event (TO_SLAVE, M);
-            }
-        }
-        else if (R->_count != _count)
+        send_rank (d, r, g, i, comm);
+    }
+}
+
+
+void Model::send_rank (int d, int r, int g, int i, int comm)
+{
+    M_def_rank  *M;
+    Rank        *R;
+    Rankwave    *W;
+
+    R = _divis [d]._ranks + r;
+    W = 0;
+    // An extension needs the rank it extends, which
+    // must be in place first.
+    if (R->_unit >= 0)
+    {
+        send_rank (d, R->_unit, g, i, comm);
+        if (comm == MT_SAVE_RANK) return;
+    }
+    if (comm == MT_SAVE_RANK)
+    {
+        if (R->_rwave->modif ())
         {
-            R->_count = _count;
             M = new M_def_rank (comm);
-            M->_divis = d;
-            M->_rank  = r;
-            M->_group = g;
-            M->_ifelm = i;
-            M->_fsamp = _audio->_fsamp;
+               M->_fsamp = _audio->_fsamp;
             M->_fbase = _fbase;
             M->_scale = scales [_itemp]._data;
             M->_synth = R->_synth;
@@ -598,6 +757,188 @@ void Model::proc_rank (int g, int i, int comm)
             send_event (TO_SLAVE, M);
         }
     }
+    else if (R->_count != _count)
+    {
+        R->_count = _count;
+        // A new instrument takes the waves of the old one's ranks
+        // made from the same stops.
+        if (_reload && (R->_unit < 0) && (W = prev_waves (R->_synth))) _nreuse++;
+        if (_wavemem && (R->_unit < 0) && (R->_resid == Rank::EVICTED) && ! W && ! engaged (d, r))
+        {
+            // Made when a stop needs it. Only the first time
+            // the division needs an empty rank in its place.
+            if (comm == MT_CALC_RANK) R->_stale = true;
+            if (R->_rwave) return;
+            comm = MT_DROP_RANK;
+        }
+        else
+        {
+            R->_resid = Rank::LOADING;
+            R->_tload = 0;
+        }
+        M = new M_def_rank (comm);
+        M->_gen   = _count;
+        M->_divis = d;
+        M->_rank  = r;
+        M->_unit  = R->_unit;
+        M->_offs  = R->_offs;
+        M->_group = g;
+        M->_ifelm = i;
+        M->_fsamp = _audio->_fsamp;
+        M->_fbase = _fbase;
+        M->_scale = scales [_itemp]._data;
+        M->_synth = R->_synth;
+        M->_rwave = R->_rwave;
+        M->_path  = _wavesdir;
+        M->_target = _reload ? _reload->_divisp [d] : 0;
+        M->_share = W;
+        send_event (TO_SLAVE, M);
+    }
+}
+
+
+bool Model::engaged (int d, int r)
+{
+    int     g, i, k;
+    Ifelm  *I;
+    Group  *G;
+
+    // True if a stop using rank r of division d is drawn.
+    for (g = 0; g < _ngroup; g++)
+    {
+        G = _group + g;
+        for (i = 0; i < G->_nifelm; i++)
+        {
+            I = G->_ifelms + i;
+            if (   ! (I->_state & 1)
+                || ((I->_type != Ifelm::DIVRANK) && (I->_type != Ifelm::KBDRANK))
+                || ((int)((I->_action0 >> 8) & 255) != d)) continue;
+            k = (I->_action0 >> 16) & 255;
+            if ((k == r) || (_divis [d]._ranks [k]._unit == r)) return true;
+        }
+    }
+    return false;
+}
+
+
+void Model::use_rank (int g, int i)
+{
+    int         d, r;
+    Ifelm       *I;
+    Rank        *R;
+
+    I = _group [g]._ifelms + i;
+    if ((I->_type != Ifelm::DIVRANK) && (I->_type != Ifelm::KBDRANK)) return;
+    d = (I->_action0 >>  8) & 255;
+    r = (I->_action0 >> 16) & 255;
+    R = _divis [d]._ranks + r;
+    R->_tuse = ++_tuse;
+    if (R->_unit >= 0)
+    {
+        r = R->_unit;
+        R = _divis [d]._ranks + r;
+        R->_tuse = _tuse;
+    }
+    if (R->_resid == Rank::EVICTED) load_rank (d, r, g, i, true);
+}
+
+
+void Model::load_rank (int d, int r, int g, int i, bool timed)
+{
+    Rank        *R;
+    M_def_rank  *M;
+
+    // Load an evicted rank. If its stop is drawn, held notes
+    // start with their attack when the waves are ready.
+    R = _divis [d]._ranks + r;
+    R->_resid = Rank::LOADING;
+    R->_tload = timed ? Perfstats::tnow () : 0;
+    R->_count = _count;
+    M = new M_def_rank (R->_stale ? MT_CALC_RANK : MT_LOAD_RANK);
+    M->_gen   = _count;
+    M->_divis = d;
+    M->_rank  = r;
+    M->_group = g;
+    M->_ifelm = i;
+    M->_fsamp = _audio->_fsamp;
+    M->_fbase = _fbase;
+    M->_scale = scales [_itemp]._data;
+    M->_synth = R->_synth;
+    M->_rwave = R->_rwave;
+    M->_path  = _wavesdir;
+    send_event (TO_SLAVE, M);
+    send_sync ();
+}
+
+
+void Model::send_sync (void)
+{
+    // Ends a batch of ranks. The Slave drops rank jobs made stale
+    // by later ones, but all batches come back in order.
+    _nsync++;
+    send_event (TO_SLAVE, new M_pooled (MT_AUDIO_SYNC));
+}
+
+
+void Model::evict_ranks (void)
+{
+    int         d, r, n, k, ed, er;
+    size_t      t;
+    Rank        *R, *E;
+    M_def_rank  *M;
+
+    // Total size and number of resident and evicted ranks.
+    for (d = n = k = 0, t = 0; d < _ndivis; d++)
+    {
+        for (r = 0; r < _divis [d]._nrank; r++)
+        {
+            R = _divis [d]._ranks + r;
+            if (R->_unit >= 0) continue;
+            if (R->_resid == Rank::EVICTED) k++;
+            else n++;
+            t += R->_size;
+        }
+    }
+
+    // Evict the least recently drawn ones that are not in use,
+    // those needed by the adjacent presets last. Not while a new
+    // instrument is being made, its divisions are not yet playing.
+    while (_wavemem && ! _prev && (t > _wavemem))
+    {
+        E = 0;
+        ed = er = 0;
+        for (d = 0; d < _ndivis; d++)
+        {
+            for (r = 0; r < _divis [d]._nrank; r++)
+            {
+                R = _divis [d]._ranks + r;
+                if (   (R->_unit >= 0)
+                    || (R->_resid != Rank::RESIDENT)
+                    || (E && (R->_warm > E->_warm))
+                    || (E && (R->_warm == E->_warm) && (R->_tuse >= E->_tuse))
+                    || engaged (d, r)) continue;
+                E = R;
+                ed = d;
+                er = r;
+            }
+        }
+        if (! E) break;
+        // Unsaved waves must be made again.
+        if (E->_rwave->modif ()) E->_stale = true;
+        E->_resid = Rank::EVICTED;
+        t -= E->_size;
+        E->_size = 0;
+        n--;
+        k++;
+        M = new M_def_rank (MT_DROP_RANK);
+        M->_gen   = _count;
+        M->_divis = ed;
+        M->_rank  = er;
+        M->_synth = E->_synth;
+        M->_rwave = E->_rwave;
+        send_event (TO_SLAVE, M);
+    }
+    if (_audio) _audio->_perfstats->set_waves (t, n, k);
 }
 
 
@@ -614,6 +955,7 @@ void Model::set_ifelm (int g, int i, int m)
     if (I->_state != s)
     {
         I->_state = s;
+        if (s && _wavemem) use_rank (g, i);
         if (_qcomm->write_avail ())
         {
             _qcomm->write (0, s ? I->_action1 : I->_action0);
@@ -676,6 +1018,8 @@ void Model::set_state (int bank, int pres)
     int    g, i;
     uint32_t    d [NGROUP], s;
     Group  *G;
+    Ifelm  *I;
+    Rank   *R;
 
     _bank = bank;
     _pres = pres;
@@ -687,6 +1031,13 @@ void Model::set_state (int bank, int pres)
             G = _group + g;
             for (i = 0; i < G->_nifelm; i++)
             {
+                I = G->_ifelms + i;
+                if ((s & 1) && ! I->_state && (R = find_rank (g, i)))
+                {
+                    // Was the rank ready before it was needed ?
+                    if (R->_unit >= 0) R = _divis [(I->_action0 >> 8) & 255]._ranks + R->_unit;
+                    if (_audio) _audio->_perfstats->add_prewarm (R->_resid == Rank::RESIDENT);
+                }
                 set_ifelm (g, i, s & 1);
                 s >>= 1;
             }
@@ -694,6 +1045,63 @@ void Model::set_state (int bank, int pres)
         send_event (TO_IFACE, new M_ifc_preset (MT_IFC_PRRCL, bank, pres, _ngroup, d));
     }
     else send_event (TO_IFACE, new M_ifc_preset (MT_IFC_PRRCL, bank, pres, 0, 0));
+    prewarm ();
+}
+
+
+void Model::prewarm (void)
+{
+    int         b, d, g, i, p, r;
+    uint32_t    bits [NGROUP], s;
+    Ifelm       *I;
+    Rank        *R;
+    M_def_rank  *M;
+
+    // Load or page in the ranks the previous and next presets
+    // would use, so stepping to them is immediate. This runs
+    // in the Slave thread, at normal priority.
+    if (! _ready) return;
+    for (d = 0; d < _ndivis; d++)
+    {
+        for (r = 0; r < _divis [d]._nrank; r++) _divis [d]._ranks [r]._warm = false;
+    }
+    for (b = -1; b <= 1; b += 2)
+    {
+        p = _pres + b;
+        if (! get_preset (_bank, p, bits)) continue;
+        for (g = 0; g < _ngroup; g++)
+        {
+            s = bits [g];
+            for (i = 0; s && (i < _group [g]._nifelm); i++, s >>= 1)
+            {
+                I = _group [g]._ifelms + i;
+                if (   ! (s & 1)
+                    || ((I->_type != Ifelm::DIVRANK) && (I->_type != Ifelm::KBDRANK))) continue;
+                d = (I->_action0 >>  8) & 255;
+                r = (I->_action0 >> 16) & 255;
+                R = _divis [d]._ranks + r;
+                if (R->_unit >= 0)
+                {
+                    r = R->_unit;
+                    R = _divis [d]._ranks + r;
+                }
+                if (R->_warm) continue;
+                R->_warm = true;
+                if (R->_resid == Rank::EVICTED)
+                {
+                    load_rank (d, r, g, i, false);
+                }
+                else if (R->_resid == Rank::RESIDENT)
+                {
+                    M = new M_def_rank (MT_WARM_RANK);
+                    M->_divis = d;
+                    M->_rank  = r;
+                    M->_rwave = R->_rwave;
+                    send_event (TO_SLAVE, M);
+                }
+            }
+        }
+    }
 }
 
 
@@ -729,6 +1137,35 @@ void Model::set_dipar (int s, int d, int p, float v)
 }
 
 
+void Model::set_capture (int stat, bool stems, const char *path)
+{
+    Capture    *C;
+    time_t      t;
+    char        s [1024];
+
+    if (! _audio || ! (C = _audio->_capture)) return;
+    if (stat)
+    {
+        if (C->state () == Capture::RUN) stat = 1;
+        else
+        {
+            if (! path || ! *path)
+            {
+                // 8 channel stems can exceed the 4 GB WAV limit.
+                t = time (0);
+                strftime (s, 64, "aeolus-capture-%Y%m%d-%H%M%S", localtime (&t));
+                strcat (s, stems ? ".w64" : ".wav");
+                path = s;
+            }
+            stat = C->start (path, stems) ? -1 : 1;
+            if (stat < 0) fprintf (stderr, "Can't start capture to '%s'\n", path);
+        }
+    }
+    else C->stop ();
+    send_event (TO_IFACE, new M_ifc_capture (stat, C->stems (), (stat < 0) ? path : C->path ()));
+}
+
+
 void Model::set_mconf (int i, uint16_t *d)
 {
     midi_off (NKEYBD);
@@ -749,7 +1186,15 @@ void Model::midi_off (int keybd)
 
 void Model::retune (float freq, int temp)
 {
-    if (_ready)
+    // Ranks still being made for a previous setting
+    // are dropped by the Slave. While the instrument
+    // is changing, the new one is retuned when ready.
+    if (_prev)
+    {
+        _pfbase = freq;
+        _pitemp = temp;
+    }
+    else if (_count)
     {
         _fbase = freq;
         _itemp = temp;
@@ -761,10 +1206,11 @@ void Model::retune (float freq, int temp)
 
 void Model::recalc (int g, int i)
 {
+    if (_prev) return;
     _count++;
     _ready = false;
     proc_rank (g, i, MT_CALC_RANK);
-    send_event (TO_SLAVE, new ITC_mesg (MT_AUDIO_SYNC));
+    send_sync ();
 }
 
 
@@ -773,6 +1219,11 @@ void Model::save (void)
     int     g, i;
     Group   *G;
 
+    if (_prev)
+    {
+        _psave = true;
+        return;
+    }
     write_instr ();
     write_presets ();
     _ready = false;
@@ -781,7 +1232,202 @@ void Model::save (void)
         G = _group + g;
         for (i = 0; i < G->_nifelm; i++) proc_rank (g, i, MT_SAVE_RANK);
     }
-    send_event (TO_SLAVE, new ITC_mesg (MT_AUDIO_SYNC));
+    send_sync ();
+}
+
+
+void Model::reload (const char *instr)
+{
+    int          b, d, g, p, r;
+    Divis        *D;
+    Division     *X;
+    Instr        *I;
+
+    // Only when all ranks are ready, the ones of the current
+    // instrument may be used by the new one.
+    if (! _ready || ! _midi)
+    {
+        fprintf (stderr, "Can't change the instrument while ranks are being made\n");
+        return;
+    }
+    _treload = Perfstats::tnow ();
+    for (g = 0; g < _ngroup; g++) clr_group (g);
+    write_presets ();
+
+    // Read the new definition, the current one is kept
+    // until the audio thread plays the new one.
+    I = new Instr;
+    save_instr (I);
+    for (d = 0; d < NASECT; d++) _asect [d] = Asect ();
+    for (d = 0; d < NKEYBD; d++) _keybd [d] = Keybd ();
+    for (d = 0; d < NDIVIS; d++) _divis [d] = Divis ();
+    for (g = 0; g < NGROUP; g++) _group [g] = Group ();
+    _nasect = _ndivis = _nkeybd = _ngroup = 0;
+    if (*instr) snprintf (_instrdir, sizeof (_instrdir), "%s/%s", _stopsdir, instr);
+    r = read_cache ();
+    if (r)
+    {
+        r = read_instr ();
+        if (! r) write_cache ();
+    }
+    if (r)
+    {
+        fprintf (stderr, "Can't read instrument '%s', keeping '%s'\n", _instrdir, I->_instrdir);
+        free_instr (_divis, _ndivis);
+        restore_instr (I);
+        delete I;
+        return;
+    }
+    _prev = I;
+    for (b = 0; b < NBANK; b++)
+    {
+        for (p = 0; p < NPRES; p++)
+        {
+            delete _preset [b][p];
+            _preset [b][p] = 0;
+        }
+    }
+    read_presets ();
+
+    // Its divisions are made here, and filled with ranks by
+    // the Slave. They are swapped in when all are in place.
+    _count++;
+    _igen = _count;
+    _ready = false;
+    _nreuse = 0;
+    _reload = new M_new_instr;
+    _reload->_ndivis = _ndivis;
+    for (d = 0, D = _divis; d < _ndivis; d++, D++)
+    {
+        X = new Division (0, _audio->_fsamp);
+        X->set_div_mask (D->_keybd);
+        X->set_swell (D->_param [Divis::SWELL]._val);
+        X->set_tfreq (D->_param [Divis::TFREQ]._val);
+        X->set_tmodd (D->_param [Divis::TMODD]._val);
+        _reload->_divisp [d] = X;
+        _reload->_asect [d] = D->_asect;
+    }
+    for (g = 0; g < _ngroup; g++)
+    {
+        for (r = 0; r < _group [g]._nifelm; r++) proc_rank (g, r, MT_LOAD_RANK);
+    }
+    send_event (TO_SLAVE, _reload);
+    _reload = 0;
+}
+
+
+void Model::swap_instr (M_new_instr *M)
+{
+    int d;
+
+    // The old divisions are no longer used, nor are
+    // the stops of the previous instrument.
+    for (d = 0; d < M->_ndivis; d++)
+    {
+        M->_divisp [d]->clear ();
+        delete M->_divisp [d];
+    }
+    free_instr (_prev->_divis, _prev->_ndivis);
+    delete _prev;
+    _prev = 0;
+    printf ("Instrument '%s' ready in %1.0lf ms, %d ranks reused\n",
+            _instrdir, 1e-3 * (Perfstats::tnow () - _treload), _nreuse);
+    init_iface ();
+    // Then the changes that had to wait for it.
+    if (_psave)
+    {
+        _psave = false;
+        save ();
+    }
+    if (_pfbase > 0)
+    {
+        retune (_pfbase, _pitemp);
+        _pfbase = 0;
+    }
+    if (! _nsync)
+    {
+        send_event (TO_IFACE, new M_pooled (MT_IFC_READY));
+        _ready = true;
+    }
+    evict_ranks ();
+}
+
+
+void Model::save_instr (Instr *I)
+{
+    int i;
+
+    strcpy (I->_instrdir, _instrdir);
+    for (i = 0; i < NASECT; i++) I->_asect [i] = _asect [i];
+    for (i = 0; i < NKEYBD; i++) I->_keybd [i] = _keybd [i];
+    for (i = 0; i < NDIVIS; i++) I->_divis [i] = _divis [i];
+    for (i = 0; i < NGROUP; i++) I->_group [i] = _group [i];
+    I->_nasect = _nasect;
+    I->_ndivis = _ndivis;
+    I->_nkeybd = _nkeybd;
+    I->_ngroup = _ngroup;
+    I->_fbase = _fbase;
+    I->_itemp = _itemp;
+}
+
+
+void Model::restore_instr (const Instr *I)
+{
+    int i;
+
+    strcpy (_instrdir, I->_instrdir);
+    for (i = 0; i < NASECT; i++) _asect [i] = I->_asect [i];
+    for (i = 0; i < NKEYBD; i++) _keybd [i] = I->_keybd [i];
+    for (i = 0; i < NDIVIS; i++) _divis [i] = I->_divis [i];
+    for (i = 0; i < NGROUP; i++) _group [i] = I->_group [i];
+    _nasect = I->_nasect;
+    _ndivis = I->_ndivis;
+    _nkeybd = I->_nkeybd;
+    _ngroup = I->_ngroup;
+    _fbase = I->_fbase;
+    _itemp = I->_itemp;
+}
+
+
+void Model::free_instr (Divis *D, int n)
+{
+    int   d, r;
+    Rank  *R;
+
+    // Extensions use the stop of the rank they extend.
+    for (d = 0; d < n; d++, D++)
+    {
+        for (r = 0; r < D->_nrank; r++)
+        {
+            R = D->_ranks + r;
+            if (R->_unit < 0) delete R->_synth;
+            free (R->_mixt);
+        }
+    }
+}
+
+
+Rankwave *Model::prev_waves (Addsynth *A)
+{
+    int       d, r, n;
+    Rank      *R;
+    Addsynth  *B;
+
+    // A rank of the previous instrument made from the same stop,
+    // with the same tuning. It stays in use until the new one plays.
+    if ((_prev->_fbase != _fbase) || (_prev->_itemp != _itemp)) return 0;
+    n = (const char *)(&A->_h_atp + 1) - (const char *)(&A->_n0);
+    for (d = 0; d < _prev->_ndivis; d++)
+    {
+        for (r = 0; r < _prev->_divis [d]._nrank; r++)
+        {
+            R = _prev->_divis [d]._ranks + r;
+            if ((R->_unit >= 0) || (R->_resid != Rank::RESIDENT) || R->_stale) continue;
+            B = R->_synth;
+            if (! memcmp (&A->_n0, &B->_n0, n)) return R->_rwave;
+        }
+    }
+    return 0;
 }
 
 
@@ -807,20 +1453,22 @@ int Model::read_instr (void)
     int           line, stat, n;
     bool          instr;
     int           d, k, r, s;
-    char          c, *p, *q;
+    char          c, *p, *q, *f;
     char          buff [1200];
     char          t1 [256];
     char          t2 [256];
+    char          t3 [256];
     Keybd         *K;
     Divis         *D;
     Rank          *R;
     Group         *G;
     Ifelm         *I;
     Addsynth      *A;
+    Addsynth      *S [N_MIXT];
 
     enum { CONT, DONE, ERROR, COMM, ARGS, MORE, NO_INSTR, IN_INSTR,
            BAD_SCOPE, BAD_ASECT, BAD_RANK, BAD_DIVIS, BAD_KEYBD, BAD_IFACE,
-           BAD_STR1, BAD_STR2 };
+           BAD_STR1, BAD_STR2, BAD_OFFS };
 
     sprintf (buff, "%s/definition", _instrdir);
     if (! (F = fopen (buff, "r")))
@@ -985,10 +1633,129 @@ int Model::read_instr (void)
                         R->_count = 0;
                         R->_synth = A;
                         R->_rwave = 0;
+                        R->_unit = -1;
+                        R->_offs = 0;
+                        R->_mixt = 0;
+                        R->_resid = Rank::EVICTED;
+                        R->_stale = false;
+                        R->_size = 0;
+                        R->_tuse = 0;
+                        R->_warm = false;
                     }
                  }
             }
         }
+        else if (! strcmp (p, "/mixture"))
+        {
+            if (!D || G) stat = BAD_SCOPE;
+            else if (sscanf (q, "%c%d%s%s%n", &c, &d, t1, t2, &n) != 4) stat = ARGS;
+            else
+            {
+                q += n;
+                while (isspace (*q)) q++;
+                if (D->_nrank == NRANKS)
+                {
+                    fprintf (stderr, "Line %d: can't create more than %d ranks per division\n", line, NRANKS);
+                    stat = ERROR;
+                }
+                else if (strlen (t1) >  7) stat = BAD_STR1;
+                else if (strlen (t2) > 31) stat = BAD_STR2;
+                else
+                {
+                    // Load the ranks and combine them into one.
+                    f = q;
+                    for (k = 0; (k < N_MIXT) && (sscanf (q, "%s%n", t3, &n) == 1); k++)
+                    {
+                        S [k] = new Addsynth;
+                        if (strlen (t3) > 63) stat = BAD_STR1;
+                        else
+                        {
+                            strcpy (S [k]->_filename, t3);
+                            if (S [k]->load (_stopsdir)) stat = ERROR;
+                        }
+                        q += n;
+                        if (stat)
+                        {
+                            strcpy (t1, t3);
+                            delete S [k];
+                            break;
+                        }
+                    }
+                    if (! stat && (k < 2)) stat = ARGS;
+                    if (! stat)
+                    {
+                        A = new Addsynth;
+                        if (A->mix (S, k))
+                        {
+                            fprintf (stderr, "Line %d: the ranks of mixture '%s' can't be combined\n", line, t2);
+                            stat = ERROR;
+                            delete A;
+                        }
+                        else
+                        {
+                            strcpy (A->_stopname, t2);
+                            strcpy (A->_mnemonic, t1);
+                            // Name the waves file after the combined parameters.
+                            sprintf (A->_filename, "mixture-%016llx.ae0", (unsigned long long)
+                                     Wavestore::hash (0xCBF29CE484222325ULL, &A->_n0,
+                                                      (const char *)(&A->_h_atp + 1) - (const char *)(&A->_n0)));
+                            A->_pan = c;
+                            A->_del = d;
+                            R = D->_ranks + D->_nrank++;
+                            R->_count = 0;
+                            R->_synth = A;
+                            R->_rwave = 0;
+                            R->_unit = -1;
+                            R->_offs = 0;
+                            R->_mixt = strndup (f, q - f);
+                            R->_resid = Rank::EVICTED;
+                            R->_stale = false;
+                            R->_size = 0;
+                            R->_tuse = 0;
+                            R->_warm = false;
+                        }
+                    }
+                    while (k--) delete S [k];
+                }
+            }
+        }
+        else if (! strcmp (p, "/unit"))
+        {
+            if (!D || G) stat = BAD_SCOPE;
+            else if (sscanf (q, "%d%d%s%s%n", &r, &s, t1, t2, &n) != 4) stat = ARGS;
+            else
+            {
+                q += n;
+                d = D - _divis + 1;
+                if (D->_nrank == NRANKS)
+                {
+                    fprintf (stderr, "Line %d: can't create more than %d ranks per division\n", line, NRANKS);
+                    stat = ERROR;
+                }
+                else if ((r < 1) || (r > D->_nrank) || (D->_ranks [r - 1]._unit >= 0)) stat = BAD_RANK;
+                else if ((s < -NNOTES) || (s > NNOTES)) stat = BAD_OFFS;
+                else if (strlen (t1) >  7) stat = BAD_STR1;
+                else if (strlen (t2) > 31) stat = BAD_STR2;
+                else
+                {
+                    // Extension of rank r, transposed by s semitones.
+                    R = D->_ranks + D->_nrank++;
+                    R->_count = 0;
+                    R->_synth = D->_ranks [r - 1]._synth;
+                    R->_rwave = 0;
+                    R->_unit = r - 1;
+                    R->_offs = s;
+                    R->_mixt = 0;
+                    R->_resid = Rank::EVICTED;
+                    R->_stale = false;
+                    R->_size = 0;
+                    R->_tuse = 0;
+                    R->_warm = false;
+                    strcpy (R->_mnemo, t1);
+                    strcpy (R->_label, t2);
+                }
+            }
+        }
         else if (! strcmp (p, "/tremul"))
         {
             if (D)
@@ -1048,8 +1815,16 @@ int Model::read_instr (void)
                     r--;
                     I = G->_ifelms + G->_nifelm++;
                     R = _divis [d]._ranks + r;
-                    strcpy (I->_label, R->_synth->_stopname);
-                    strcpy (I->_mnemo, R->_synth->_mnemonic);
+                    if (R->_unit >= 0)
+                    {
+                        strcpy (I->_label, R->_label);
+                        strcpy (I->_mnemo, R->_mnemo);
+                    }
+                    else
+                    {
+                        strcpy (I->_label, R->_synth->_stopname);
+                        strcpy (I->_mnemo, R->_synth->_mnemonic);
+                    }
                     I->_keybd = k;
                     if (k >= 0)
                     {
@@ -1142,6 +1917,9 @@ int Model::read_instr (void)
         case BAD_STR2:
             fprintf (stderr, "Line %d: string '%s' is too long\n", line, t1);
             break;
+        case BAD_OFFS:
+            fprintf (stderr, "Line %d: note offset '%d' out of range\n", line, s);
+            break;
         }
     }
 
@@ -1193,7 +1971,15 @@ int Model::write_instr (void)
         {
             R = D->_ranks + r;
             A = R->_synth;
-            fprintf (F, "/rank         %c %3d  %s\n", A->_pan, A->_del, A->_filename);
+            if (R->_unit >= 0)
+            {
+                fprintf (F, "/unit         %d %3d  %-7s  %s\n", R->_unit + 1, R->_offs, R->_mnemo, R->_label);
+            }
+            else if (R->_mixt)
+            {
+                fprintf (F, "/mixture      %c %3d  %-7s  %s  %s\n", A->_pan, A->_del, A->_mnemonic, A->_stopname, R->_mixt);
+            }
+            else fprintf (F, "/rank         %c %3d  %s\n", A->_pan, A->_del, A->_filename);
         }
         if (D->_flags & Divis::HAS_SWELL) fprintf (F, "/swell\n");
         if (D->_flags & Divis::HAS_TREM) fprintf (F, "/tremul       %3.1f  %3.1f\n",
@@ -1242,6 +2028,307 @@ int Model::write_instr (void)
 }
 
 
+// The instrument cache is a snapshot of the parsed definition and
+// the stop files it uses, so they don't have to be parsed and read
+// at each start. It is in native byte order and layout, and checked
+// against the sizes of the classes it copies. It is valid while all
+// the files it was made from have the same size and time.
+
+struct Cachehead
+{
+    char      _magic [8];
+    uint32_t  _vers;
+    uint32_t  _sizes [4];
+    int32_t   _ndeps;
+    int32_t   _nsynth;
+    int32_t   _nasect;
+    int32_t   _ndivis;
+    int32_t   _nkeybd;
+    int32_t   _ngroup;
+    int32_t   _itemp;
+    float     _fbase;
+};
+
+
+struct Cachedep
+{
+    int64_t   _mtime;
+    int64_t   _size;
+    char      _path [1024];
+};
+
+
+struct Cacherank
+{
+    int32_t   _synth;
+    int32_t   _nmixt;   // length of _mixt, including the zero
+};
+
+
+static const uint32_t cache_sizes [4] = { sizeof (Addsynth), sizeof (Keybd), sizeof (Divis), sizeof (Group) };
+
+
+static int cache_stat (const char *path, Cachedep *C)
+{
+    struct stat  S;
+
+    if (stat (path, &S)) return 1;
+#ifdef __APPLE__
+    C->_mtime = (int64_t) S.st_mtimespec.tv_sec * 1000000000 + S.st_mtimespec.tv_nsec;
+#else
+    C->_mtime = (int64_t) S.st_mtim.tv_sec * 1000000000 + S.st_mtim.tv_nsec;
+#endif
+    C->_size = (int64_t) S.st_size;
+    return 0;
+}
+
+
+int Model::read_cache (void)
+{
+    int             fd, d, i, r;
+    size_t          n;
+    char            name [1200];
+    const char      *p, *q, *e;
+    struct stat     S;
+    const Cachehead *H;
+    const Cachedep  *C;
+    Cachedep        T;
+    Cacherank       X;
+    Addsynth        **A;
+    Rank            *R;
+
+    sprintf (name, "%s/definition.cache", _instrdir);
+    if ((fd = open (name, O_RDONLY)) < 0) return 1;
+    if (fstat (fd, &S) || ((size_t) S.st_size < sizeof (Cachehead)))
+    {
+        close (fd);
+        return 1;
+    }
+    n = S.st_size;
+    p = (const char *) mmap (0, n, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (p == MAP_FAILED) return 1;
+    e = p + n;
+
+    H = (const Cachehead *) p;
+    if (   memcmp (H->_magic, "ae-inst", 8) || (H->_vers != 1)
+        || memcmp (H->_sizes, cache_sizes, sizeof (cache_sizes))
+        || (H->_nsynth < 0) || (H->_nsynth > NDIVIS * NRANKS)
+        || (H->_ndivis < 0) || (H->_ndivis > NDIVIS)
+        || (H->_nkeybd < 0) || (H->_nkeybd > NKEYBD)
+        || (H->_ngroup < 0) || (H->_ngroup > NGROUP)
+        || (H->_ndeps < 0)
+        || (e - p < (ptrdiff_t)(sizeof (Cachehead) + H->_ndeps * sizeof (Cachedep)
+                                + H->_nsynth * sizeof (Addsynth) + H->_nkeybd * sizeof (Keybd)
+                                + H->_ndivis * sizeof (Divis) + H->_ngroup * sizeof (Group))))
+    {
+        munmap ((void *) p, n);
+        return 1;
+    }
+
+    // All files must be unchanged.
+    C = (const Cachedep *)(H + 1);
+    for (i = 0; i < H->_ndeps; i++, C++)
+    {
+        if (   cache_stat (C->_path, &T)
+            || (T._mtime != C->_mtime)
+            || (T._size != C->_size))
+        {
+            munmap ((void *) p, n);
+            return 1;
+        }
+    }
+    printf ("Reading '%s'\n", name);
+
+    A = new Addsynth * [H->_nsynth + 1];
+    p = (const char *) C;
+    for (i = 0; i < H->_nsynth; i++, p += sizeof (Addsynth))
+    {
+        A [i] = new Addsynth;
+        memcpy ((void *) A [i], p, sizeof (Addsynth));
+    }
+    memcpy ((void *) _keybd, p, H->_nkeybd * sizeof (Keybd));
+    p += H->_nkeybd * sizeof (Keybd);
+    memcpy ((void *) _group, p, H->_ngroup * sizeof (Group));
+    p += H->_ngroup * sizeof (Group);
+    memcpy ((void *) _divis, p, H->_ndivis * sizeof (Divis));
+    p += H->_ndivis * sizeof (Divis);
+
+    // Check the ranks before any pointers are made.
+    q = p;
+    for (d = 0; (d < H->_ndivis) && q; d++)
+    {
+        if ((_divis [d]._nrank < 0) || (_divis [d]._nrank > NRANKS)) q = 0;
+        for (r = 0; (r < _divis [d]._nrank) && q; r++)
+        {
+            if (q + sizeof (Cacherank) > e) q = 0;
+            else
+            {
+                memcpy (&X, q, sizeof (Cacherank));
+                q += sizeof (Cacherank);
+                if (   (X._synth < 0) || (X._synth >= H->_nsynth) || (X._nmixt < 0)
+                    || (q + X._nmixt > e) || (X._nmixt && q [X._nmixt - 1])) q = 0;
+                else q += X._nmixt;
+            }
+        }
+    }
+    if (! q)
+    {
+        for (i = 0; i < H->_nsynth; i++) delete A [i];
+        delete[] A;
+        for (i = 0; i < NKEYBD; i++) _keybd [i] = Keybd ();
+        for (i = 0; i < NGROUP; i++) _group [i] = Group ();
+        for (i = 0; i < NDIVIS; i++) _divis [i] = Divis ();
+        munmap ((void *) H, n);
+        return 1;
+    }
+
+    _nasect = H->_nasect;
+    _ndivis = H->_ndivis;
+    _nkeybd = H->_nkeybd;
+    _ngroup = H->_ngroup;
+    _itemp  = H->_itemp;
+    _fbase  = H->_fbase;
+
+    // Only the pointers of the ranks need more work.
+    for (d = 0; d < _ndivis; d++)
+    {
+        for (r = 0; r < _divis [d]._nrank; r++)
+        {
+            R = _divis [d]._ranks + r;
+            memcpy (&X, p, sizeof (Cacherank));
+            p += sizeof (Cacherank);
+            R->_synth = A [X._synth];
+            R->_mixt = 0;
+            if (X._nmixt)
+            {
+                R->_mixt = strndup (p, X._nmixt);
+                p += X._nmixt;
+            }
+            R->_count = 0;
+            R->_rwave = 0;
+            R->_resid = Rank::EVICTED;
+            R->_stale = false;
+            R->_size = 0;
+            R->_tuse = 0;
+            R->_warm = false;
+        }
+    }
+    delete[] A;
+    munmap ((void *) H, n);
+    return 0;
+}
+
+
+void Model::write_cache (void)
+{
+    int             d, i, k, n, r;
+    char            name [1200];
+    char            temp [sizeof (name) + 4];
+    const char      *p, *q;
+    FILE            *F;
+    Cachehead       H;
+    Cachedep        C;
+    Cacherank       X;
+    Addsynth        *A [NDIVIS * NRANKS];
+    Rank            *R;
+
+    memset (&H, 0, sizeof (H));
+    memcpy (H._magic, "ae-inst", 8);
+    H._vers = 1;
+    memcpy (H._sizes, cache_sizes, sizeof (cache_sizes));
+    H._nasect = _nasect;
+    H._ndivis = _ndivis;
+    H._nkeybd = _nkeybd;
+    H._ngroup = _ngroup;
+    H._itemp  = _itemp;
+    H._fbase  = _fbase;
+
+    // Each synth once, extensions use that of their rank.
+    for (d = 0; d < _ndivis; d++)
+    {
+        for (r = 0; r < _divis [d]._nrank; r++)
+        {
+            R = _divis [d]._ranks + r;
+            for (i = 0; (i < H._nsynth) && (A [i] != R->_synth); i++);
+            if (i == H._nsynth) A [H._nsynth++] = R->_synth;
+            // The definition, and the stop files of each rank or mixture.
+            if (R->_unit < 0) H._ndeps += R->_mixt ? N_MIXT : 1;
+        }
+    }
+    H._ndeps++;
+
+    sprintf (name, "%s/definition.cache", _instrdir);
+    sprintf (temp, "%s.tmp", name);
+    if (! (F = fopen (temp, "wb"))) return;
+    fwrite (&H, sizeof (H), 1, F);
+
+    k = 0;
+    memset (&C, 0, sizeof (C));
+    // A path that doesn't fit can't be checked, so there is no cache.
+    n = snprintf (C._path, sizeof (C._path), "%s/definition", _instrdir);
+    if ((n >= (int) sizeof (C._path)) || cache_stat (C._path, &C)) k++;
+    fwrite (&C, sizeof (C), 1, F);
+    for (d = 0; d < _ndivis; d++)
+    {
+        for (r = 0; r < _divis [d]._nrank; r++)
+        {
+            R = _divis [d]._ranks + r;
+            if (R->_unit >= 0) continue;
+            if (R->_mixt)
+            {
+                // Unused entries refer to the definition again.
+                for (i = 0, p = R->_mixt; i < N_MIXT; i++)
+                {
+                    memset (&C, 0, sizeof (C));
+                    while (isspace (*p)) p++;
+                    q = p;
+                    while (*q && ! isspace (*q)) q++;
+                    if (q > p) n = snprintf (C._path, sizeof (C._path), "%s/%.*s", _stopsdir, (int)(q - p), p);
+                    else n = snprintf (C._path, sizeof (C._path), "%s/definition", _instrdir);
+                    if ((n >= (int) sizeof (C._path)) || cache_stat (C._path, &C)) k++;
+                    fwrite (&C, sizeof (C), 1, F);
+                    p = q;
+                }
+            }
+            else
+            {
+                memset (&C, 0, sizeof (C));
+                n = snprintf (C._path, sizeof (C._path), "%s/%s", _stopsdir, R->_synth->_filename);
+                if ((n >= (int) sizeof (C._path)) || cache_stat (C._path, &C)) k++;
+                fwrite (&C, sizeof (C), 1, F);
+            }
+        }
+    }
+
+    for (i = 0; i < H._nsynth; i++) fwrite ((const void *) A [i], sizeof (Addsynth), 1, F);
+    fwrite ((const void *) _keybd, sizeof (Keybd), _nkeybd, F);
+    fwrite ((const void *) _group, sizeof (Group), _ngroup, F);
+    fwrite ((const void *) _divis, sizeof (Divis), _ndivis, F);
+    for (d = 0; d < _ndivis; d++)
+    {
+        for (r = 0; r < _divis [d]._nrank; r++)
+        {
+            R = _divis [d]._ranks + r;
+            for (i = 0; A [i] != R->_synth; i++);
+            X._synth = i;
+            X._nmixt = R->_mixt ? strlen (R->_mixt) + 1 : 0;
+            fwrite (&X, sizeof (X), 1, F);
+            if (X._nmixt) fwrite (R->_mixt, 1, X._nmixt, F);
+        }
+    }
+
+    // Nothing is renamed into place after a failed write.
+    if (ferror (F)) k++;
+    if (fclose (F) || k)
+    {
+        unlink (temp);
+        return;
+    }
+    if (rename (temp, name)) unlink (temp);
+}
+
+
 int Model::get_preset (int bank, int pres, uint32_t *bits)
 {
     int     k;
@@ -44,9 +44,22 @@ class Rank
 {
 public:
 
+    enum { EVICTED, LOADING, RESIDENT };  // state of the wave data
+
     int         _count;
     Addsynth   *_synth;
     Rankwave   *_rwave;
+    int         _unit;        // extended rank, or -1
+    int         _offs;        // note offset
+    char       *_mixt;        // files of a mixture, or 0
+    char        _mnemo [8];   // for an extension
+    char        _label [32];
+    int         _resid;
+    bool        _stale;       // must be recalculated when loaded
+    size_t      _size;        // bytes of wave data
+    uint32_t    _tuse;        // when last drawn
+    bool        _warm;        // used by an adjacent preset
+    int64_t     _tload;       // when loading started
 };
 
 
@@ -113,6 +126,26 @@ public:
 };
 
 
+// An instrument definition, kept while the next one is loaded.
+
+class Instr
+{
+public:
+
+    char    _instrdir [1024];
+    Asect   _asect [NASECT];
+    Keybd   _keybd [NKEYBD];
+    Divis   _divis [NDIVIS];
+    Group   _group [NGROUP];
+    int     _nasect;
+    int     _ndivis;
+    int     _nkeybd;
+    int     _ngroup;
+    float   _fbase;
+    int     _itemp;
+};
+
+
 class Midiconf
 {
 public:
@@ -154,32 +187,56 @@ public:
 
     void terminate (void) {  put_event (EV_EXIT, 1); }
 
+    // Limit for the wave data, 0 is no limit. Ranks that are
+    // not in use are evicted when it is exceeded, and loaded
+    // again when a stop needs them. Call before starting.
+    void set_wavemem (size_t bytes) { _wavemem = bytes; }
+
 private:
 
+    friend class ModelTest;
+
     virtual void thr_main (void);
 
     void init (void);
     void fini (void);
     void proc_mesg (ITC_mesg *M);
     void proc_qmidi (void);
+    void proc_qdead (void);
     void init_audio (void);
     void init_iface (void);
     void init_ranks (int comm);
     void proc_rank (int g, int i, int comm);
+    void send_rank (int d, int r, int g, int i, int comm);
+    bool engaged (int d, int r);
+    void use_rank (int g, int i);
+    void load_rank (int d, int r, int g, int i, bool timed);
+    void send_sync (void);
+    void evict_ranks (void);
+    void prewarm (void);
     void set_ifelm (int g, int i, int m);
     void clr_group (int g);
     void set_aupar (int s, int a, int p, float v);
     void set_dipar (int s, int d, int p, float v);
     void set_mconf (int i, uint16_t *d);
+    void set_capture (int stat, bool stems, const char *path);
     void get_state (uint32_t *bits);
     void set_state (int bank, int pres);
     void midi_off (int mask);
     void retune (float freq, int temp);
     void recalc (int g, int i);
     void save (void);
+    void reload (const char *instr);
+    void swap_instr (M_new_instr *M);
+    void save_instr (Instr *I);
+    void restore_instr (const Instr *I);
+    void free_instr (Divis *D, int n);
+    Rankwave *prev_waves (Addsynth *A);
     Rank *find_rank (int g, int i);
     int  read_instr (void);
     int  write_instr (void);
+    int  read_cache (void);
+    void write_cache (void);
     int  get_preset (int bank, int pres, uint32_t *bits);
     void set_preset (int bank, int pres, uint32_t *bits);
     void ins_preset (int bank, int pres, uint32_t *bits);
@@ -209,12 +266,23 @@ private:
     float           _fbase;
     int             _itemp;
     int             _count;
+    int             _nsync;    // batches of ranks not yet done
+    int             _igen;     // _count of the first ranks of this instrument
+    Instr          *_prev;     // the previous instrument, while changing
+    M_new_instr    *_reload;   // its replacement, while sending its ranks
+    int             _nreuse;   // ranks using the waves of the previous one
+    int64_t         _treload;
+    float           _pfbase;   // tuning asked for while changing, or 0
+    int             _pitemp;
+    bool            _psave;    // save asked for while changing
     int             _bank;
     int             _pres;
     int             _client;
     int             _portid;
     int             _sc_cmode; // stop control command mode
     int             _sc_group; // stop control group number
+    size_t          _wavemem;
+    uint32_t        _tuse;
     Midiconf        _chconf [8];
     Preset         *_preset [NBANK][NPRES];
     M_audio_info   *_audio;
@@ -32,6 +32,7 @@
 
 
 #include "niface.h"
+#include "capture.h"
 
 // Global atomic flag set by signal handler
 static std::atomic<bool> resize_flag{false};
@@ -288,13 +289,14 @@ void Niface::thr_main (void)
     {
         // Use timed events only when blinking is needed, otherwise block indefinitely
         int event;
-        if (_has_tuning_stop) {
+        if (_has_tuning_stop || _ready) {
             event = get_event_timed ();
         } else {
             event = get_event ();
         }
         bool had_event = false;
         bool need_blink_update = false;
+        bool need_meter_update = false;
         
         switch (event)
         {
@@ -325,6 +327,12 @@ void Niface::thr_main (void)
                 // Continue timer for next blink
                 inc_time (250000);
             }
+            else if (_ready)
+            {
+                // Refresh the DSP load meter twice per second
+                need_meter_update = true;
+                inc_time (500000);
+            }
             // If tuning stopped, we'll switch to get_event() on next iteration
             break;
             
@@ -350,6 +358,13 @@ void Niface::thr_main (void)
             _need_redraw = false;
             draw_screen ();
         }
+        else if (need_meter_update && !_command_mode && _status_win)
+        {
+            // Only the status line changes, avoid a full redraw
+            werase (_status_win);
+            draw_status ();
+            wrefresh (_status_win);
+        }
     }
 }
 
@@ -430,6 +445,22 @@ void Niface::handle_key (int ch)
                 {
                     enter_midi_dialog();
                 }
+                else if (strcmp (_command_buffer, "reset") == 0)
+                {
+                    if (_initdata && _initdata->_perfstats) _initdata->_perfstats->reset ();
+                }
+                else if (strcmp (_command_buffer, "record off") == 0)
+                {
+                    send_event (TO_MODEL, new M_ifc_capture (0, false, 0));
+                }
+                else if (strncmp (_command_buffer, "record", 6) == 0)
+                {
+                    command_record (_command_buffer + 6, false);
+                }
+                else if (strncmp (_command_buffer, "stems", 5) == 0)
+                {
+                    command_record (_command_buffer + 5, true);
+                }
             }
             _command_mode = false;
             _command_pos = 0;
@@ -477,6 +508,11 @@ void Niface::handle_key (int ch)
     case 'M':
         enter_midi_dialog ();
         break;
+
+    case 'r':
+    case 'R':
+        toggle_capture ();
+        break;
         
     case KEY_UP:
         move_cursor (-1, 0);
@@ -1140,10 +1176,66 @@ void Niface::draw_status (void)
                 }
             }
         }
+        else if (_ready)
+        {
+            draw_meter ();
+        }
     }
 }
 
 
+void Niface::draw_meter (void)
+{
+    // DSP load meter on the right side of the status line, same
+    // fixed width and position as the tuning message.
+    int        meter_width = 30;
+    int        meter_pos = _max_cols - meter_width;
+    float      t;
+    Perfinfo   I;
+    Perfstats  *P;
+
+    Capture    *C;
+
+    if (!_initdata || !(P = _initdata->_perfstats)) return;
+    if (meter_pos < 65) meter_pos = 65;
+    if (meter_pos + meter_width > _max_cols) return;
+
+    // While recording the meter shows the capture state instead.
+    if ((C = _initdata->_capture) && (C->state () != Capture::IDLE))
+    {
+        wattron (_status_win, A_BOLD);
+        mvwprintw (_status_win, 0, meter_pos, "REC %-5s %7.1fs ovr %-4u",
+                   C->stems () ? "stems" : "", C->seconds (), C->overruns ());
+        wattroff (_status_win, A_BOLD);
+        return;
+    }
+
+    t = P->period ();
+    P->get_info (Perfstats::CYCLE, &I);
+    if (P->load () > 0.8f || P->xruns ()) wattron (_status_win, A_BOLD);
+    mvwprintw (_status_win, 0, meter_pos, "DSP %3.0f%% max %3.0f%% xrun %-4u",
+               100 * P->load (), 100 * I._max / t, P->xruns ());
+    if (P->load () > 0.8f || P->xruns ()) wattroff (_status_win, A_BOLD);
+}
+
+
+void Niface::toggle_capture (void)
+{
+    Capture *C;
+
+    if (!_initdata || !(C = _initdata->_capture)) return;
+    if (C->state () == Capture::IDLE) send_event (TO_MODEL, new M_ifc_capture (1, false, 0));
+    else send_event (TO_MODEL, new M_ifc_capture (0, false, 0));
+}
+
+
+void Niface::command_record (const char *p, bool stems)
+{
+    while (isspace (*p)) p++;
+    send_event (TO_MODEL, new M_ifc_capture (1, stems, *p ? p : 0));
+}
+
+
 void Niface::move_cursor (int dy, int dx)
 {
     if (!_initdata) return;
@@ -1301,6 +1393,11 @@ void Niface::handle_mesg (ITC_mesg *M)
     case MT_IFC_PRRCL:
         break;
 
+    case MT_IFC_CAPTURE:
+        // The status line shows the capture state.
+        _need_redraw = true;
+        break;
+
     default:
         break;
     }
@@ -1314,6 +1411,9 @@ void Niface::handle_ifc_ready (void)
     _ready = true;
     _has_tuning_stop = false;  // Clear tuning stop when ready
     _need_redraw = true;
+    // Restart the timer for the DSP load meter
+    set_time (0);
+    inc_time (500000);
 }
 
 
@@ -91,6 +91,7 @@ private:
     void draw_screen (void);
     void draw_initial_screen (void);
     void draw_status (void);
+    void draw_meter (void);
     void draw_groups (void);
     void draw_cursor (void);
     void move_cursor (int dy, int dx);
@@ -98,6 +99,8 @@ private:
     void recall_preset (int preset);
     void store_preset (int preset);
     void general_cancel (void);
+    void toggle_capture (void);
+    void command_record (const char *p, bool stems);
     void enter_command_mode (void);
     void enter_midi_dialog (void);
     void draw_midi_dialog (WINDOW *win, int cursor_row, int cursor_col, int cursor_section);
@@ -0,0 +1,253 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <string.h>
+#include <math.h>
+#include "offline_audio.h"
+#include "messages.h"
+#include "tracer.h"
+
+
+OfflineAudio::OfflineAudio (const char *appname, Lfq_u32 *qnote, Lfq_u32 *qcomm) :
+    AudioBackend (appname, qnote, qcomm),
+    _outfile (0),
+    _qmidi (0),
+    _ievent (0),
+    _frame (0)
+{
+}
+
+
+OfflineAudio::~OfflineAudio (void)
+{
+    for (int i = 0; i < _nplay; i++) delete[] _outbuf [i];
+}
+
+
+void OfflineAudio::init_offline (const char *midifile, const char *outfile, int fsamp, int fsize,
+                                 bool bform, int form, Lfq_u8 *qmidi)
+{
+    int  i, type;
+
+    if (_midifile.load (midifile)) exit (1);
+    type = Audiofile::type_from_name (outfile);
+    if (type == Audiofile::TYPE_NONE)
+    {
+        fprintf (stderr, "Error: output file '%s' must have a .wav, .w64 or .caf extension\n", outfile);
+        exit (1);
+    }
+
+    _outfile = outfile;
+    _qmidi = qmidi;
+    _bform = bform;
+    _nplay = bform ? 4 : 2;
+    _fsamp = fsamp;
+    // The synthesis loop works in whole periods.
+    _fsize = (fsize < PERIOD) ? PERIOD : fsize & ~(PERIOD - 1);
+    if (_audiofile.open_write (outfile, type, form, _nplay, _fsamp))
+    {
+        fprintf (stderr, "Error: can't open '%s' for writing\n", outfile);
+        exit (1);
+    }
+    init_audio ();
+    for (i = 0; i < _nplay; i++) _outbuf [i] = new float [_fsize];
+
+    _running = true;
+    if (thr_start (SCHED_OTHER, 0, 0))
+    {
+        fprintf (stderr, "Error: can't start the render thread\n");
+        exit (1);
+    }
+}
+
+
+void OfflineAudio::start (void)
+{
+    M_audio_info  *M;
+    M_midi_info   *MI;
+    int           i;
+
+    M = new M_audio_info ();
+    M->_nasect = _nasect;
+    M->_fsamp  = _fsamp;
+    M->_fsize  = _fsize;
+    M->_instrpar = _audiopar;
+    for (i = 0; i < _nasect; i++) M->_asectpar [i] = _asectp [i]->get_apar ();
+    M->_perfstats = &_perfstats;
+    M->_capture = &_capture;
+    M->_qdead = &_qdead;
+    send_event (TO_MODEL, M);
+
+    // There is no midi thread, the MIDI file takes its place.
+    MI = new M_midi_info ();
+    MI->_client = 0;
+    MI->_ipport = 0;
+    memcpy (MI->_chbits, _midimap, 16 * sizeof (uint16_t));
+    send_event (TO_MODEL, MI);
+}
+
+
+bool OfflineAudio::is_note (const Midievent *E) const
+{
+    int t = E->_data [0] & 0xF0;
+
+    return ((t == 0x80) || (t == 0x90)) && (E->_data [1] >= 36) && (E->_data [1] <= 96);
+}
+
+
+int64_t OfflineAudio::frame (const Midievent *E) const
+{
+    return (int64_t)(E->_time * _fsamp + 0.5);
+}
+
+
+void OfflineAudio::dispatch (const Midievent *E)
+{
+    MidiProcessor::process_midi_event (E->_data [0], E->_data [1], E->_data [2], E->_data [0] & 0x0F,
+                                       _midimap, this, _qnote, _qmidi);
+}
+
+
+void OfflineAudio::proc_midi_during_synth (int frame_time)
+{
+    const Midievent *E;
+    int              n;
+
+    // Notes are applied at the start of the period they fall in,
+    // the same resolution as JACK MIDI input.
+    n = _midifile.nevent ();
+    while (_ievent < n)
+    {
+        E = _midifile.event (_ievent);
+        if (frame (E) >= _frame + frame_time) break;
+        dispatch (E);
+        _ievent++;
+    }
+    proc_keys1 ();
+}
+
+
+float OfflineAudio::write_block (int nframes)
+{
+    int    i, j;
+    float  p, v;
+
+    p = 0;
+    for (i = 0; i < _nplay; i++)
+    {
+        for (j = 0; j < nframes; j++)
+        {
+            v = fabsf (_outbuf [i][j]);
+            if (v > p) p = v;
+        }
+    }
+    if (_audiofile.write (_outbuf, nframes))
+    {
+        fprintf (stderr, "Error: write to '%s' failed\n", _outfile);
+        _running = false;
+    }
+    return p;
+}
+
+
+void OfflineAudio::thr_main (void)
+{
+    const Midievent *E;
+    int              i, k, m, n;
+    int64_t          f, tail, sil, t0;
+    float            p;
+
+    Tracer::thread ("audio");
+
+    // Wait until the model has loaded all ranks.
+    while (_running && ! _nsync)
+    {
+        get_event (1 << FM_MODEL | 1 << FM_SLAVE);
+        proc_mesg ();
+    }
+
+    t0 = Perfstats::tnow ();
+    n = _midifile.nevent ();
+    tail = sil = 0;
+    while (_running)
+    {
+        _perfstats.cycle_begin ();
+        Tracer::begin ("cycle");
+
+        // Events other than notes go to the model. They are executed
+        // at the start of a block, which ends just before the period
+        // containing the next one.
+        k = 0;
+        while (_ievent < n)
+        {
+            E = _midifile.event (_ievent);
+            if (frame (E) >= _frame + PERIOD) break;
+            if (! is_note (E)) k++;
+            dispatch (E);
+            _ievent++;
+        }
+        if (k) flush_model ();
+
+        m = _fsize;
+        for (i = _ievent; i < n; i++)
+        {
+            E = _midifile.event (i);
+            f = frame (E) - _frame;
+            if (f >= m) break;
+            if (! is_note (E))
+            {
+                m = f & ~(PERIOD - 1);
+                if (m < PERIOD) m = PERIOD;
+                break;
+            }
+        }
+
+        proc_queue (_qnote);
+        proc_queue (_qcomm);
+        proc_keys1 ();
+        proc_keys2 ();
+        proc_synth (m);
+        proc_mesg ();
+        p = write_block (m);
+        _frame += m;
+        Tracer::end ("cycle");
+        _perfstats.cycle_end ();
+
+        // After the last event, stop when the output has been
+        // silent for a quarter second, or after TAIL_MAX seconds.
+        if (_ievent == n)
+        {
+            tail += m;
+            sil = (p < 1e-4f) ? sil + m : 0;
+            if ((4 * sil >= _fsamp) || (tail >= TAIL_MAX * (int64_t) _fsamp)) break;
+        }
+    }
+
+    if (_audiofile.close ()) fprintf (stderr, "Error: write to '%s' failed\n", _outfile);
+    else
+    {
+        t0 = Perfstats::tnow () - t0;
+        fprintf (stderr, "Rendered %.1lf s to '%s' in %.1lf s.\n",
+                 (double) _frame / _fsamp, _outfile, 1e-9 * t0);
+    }
+    _running = false;
+    send_event (EV_SYNC, 1);
+}
+
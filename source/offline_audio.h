@@ -0,0 +1,74 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __OFFLINE_AUDIO_H
+#define __OFFLINE_AUDIO_H
+
+
+#include "audio_backend.h"
+#include "audiofile.h"
+#include "midifile.h"
+#include "lfqueue.h"
+
+
+// Renders a MIDI file to an audio file as fast as possible. There is
+// no audio device, the backend's own thread runs the synthesis loop.
+// Rendering starts once all ranks are loaded, and when it is done the
+// thread sends EV_SYNC.
+
+class OfflineAudio : public AudioBackend
+{
+public:
+
+    OfflineAudio (const char *appname, Lfq_u32 *qnote, Lfq_u32 *qcomm);
+    virtual ~OfflineAudio (void);
+
+    void init_offline (const char *midifile, const char *outfile, int fsamp, int fsize,
+                       bool bform, int form, Lfq_u8 *qmidi);
+
+    // AudioBackend interface implementation
+    void start (void) override;
+    int  relpri (void) const override { return 0; }
+
+protected:
+
+    void proc_midi_during_synth (int frame_time) override;
+
+private:
+
+    enum { TAIL_MAX = 10 };
+
+    virtual void thr_main (void) override;
+
+    bool    is_note (const Midievent *E) const;
+    int64_t frame (const Midievent *E) const;
+    void    dispatch (const Midievent *E);
+    float   write_block (int nframes);
+
+    Midifile    _midifile;
+    Audiofile   _audiofile;
+    const char *_outfile;
+    Lfq_u8     *_qmidi;
+    int         _ievent;
+    int64_t     _frame;
+};
+
+
+#endif
@@ -0,0 +1,304 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include "perfstats.h"
+
+
+static const char *stage_names [Perfstats::NSTAGE] =
+{
+    "queue", "keys", "divis", "asect", "reverb", "total"
+};
+
+
+void Perfstats::Stage::clear (void)
+{
+    _count.store (0, std::memory_order_relaxed);
+    _tmin.store (UINT32_MAX, std::memory_order_relaxed);
+    _tmax.store (0, std::memory_order_relaxed);
+    _tsum.store (0, std::memory_order_relaxed);
+    for (int i = 0; i < NHIST; i++) _hist [i].store (0, std::memory_order_relaxed);
+}
+
+
+Perfstats::Perfstats (void) :
+    _tper (21333333),
+    _t0 (0),
+    _load (0.0f),
+    _xruns (0),
+    _overr (0),
+    _voices (0),
+    _culls (0),
+    _qlevel (0),
+    _qchang (0),
+    _wbytes (0),
+    _wresid (0),
+    _wevict (0),
+    _reload (0),
+    _rlast (0.0f),
+    _rmax (0.0f),
+    _whits (0),
+    _wmiss (0),
+    _jqueue (0),
+    _jdone (0),
+    _jcanc (0),
+    _jmerg (0),
+    _jabrt (0),
+    _jlast (0.0f),
+    _jmax (0.0f),
+    _cmerg (0),
+    _mevnt (0),
+    _mread (0),
+    _mrate (0.0f),
+    _mt0 (0),
+    _mwake (0),
+    _reset (false)
+{
+    for (int i = 0; i < NSTAGE; i++)
+    {
+        _acc [i] = 0;
+        _stage [i].clear ();
+    }
+}
+
+
+const char *Perfstats::stage_name (int s)
+{
+    return ((s >= 0) && (s < NSTAGE)) ? stage_names [s] : "?";
+}
+
+
+void Perfstats::init (unsigned int fsamp, unsigned int fsize)
+{
+    // Called before the audio thread starts.
+    _tper = (int64_t) 1000000000 * fsize / fsamp;
+    for (int i = 0; i < NSTAGE; i++) _stage [i].clear ();
+    _load.store (0.0f, std::memory_order_relaxed);
+    _xruns.store (0, std::memory_order_relaxed);
+    _overr.store (0, std::memory_order_relaxed);
+    _culls.store (0, std::memory_order_relaxed);
+    _qchang.store (0, std::memory_order_relaxed);
+    _reset.store (false, std::memory_order_relaxed);
+}
+
+
+void Perfstats::set_period (unsigned int fsamp, unsigned int fsize)
+{
+    // Called when the audio thread is not running a cycle. The
+    // histograms are relative to the period, so start again.
+    _tper = (int64_t) 1000000000 * fsize / fsamp;
+    reset ();
+}
+
+
+void Perfstats::add_midi (uint32_t nevent, uint32_t nread, bool wake, int64_t t)
+{
+    // Called once per batch of input events. The wakeup
+    // rate is updated when at least a second has passed.
+    _mevnt.fetch_add (nevent, std::memory_order_relaxed);
+    _mread.fetch_add (nread, std::memory_order_relaxed);
+    if (wake) _mwake++;
+    if (_mt0 == 0) _mt0 = t;
+    else if (t - _mt0 >= 1000000000)
+    {
+        _mrate.store (1e9f * _mwake / (t - _mt0), std::memory_order_relaxed);
+        _mt0 = t;
+        _mwake = 0;
+    }
+}
+
+
+void Perfstats::cycle_begin (void)
+{
+    int i;
+
+    if (_reset.exchange (false, std::memory_order_relaxed))
+    {
+        for (i = 0; i < NSTAGE; i++) _stage [i].clear ();
+        _load.store (0.0f, std::memory_order_relaxed);
+        _xruns.store (0, std::memory_order_relaxed);
+        _overr.store (0, std::memory_order_relaxed);
+        _culls.store (0, std::memory_order_relaxed);
+        _qchang.store (0, std::memory_order_relaxed);
+    }
+    for (i = 0; i < NSTAGE; i++) _acc [i] = 0;
+    _t0 = tnow ();
+}
+
+
+void Perfstats::cycle_end (void)
+{
+    int    i;
+    float  v, w;
+
+    _acc [CYCLE] = tnow () - _t0;
+    for (i = 0; i < NSTAGE; i++) update (_stage + i, _acc [i]);
+    if (_acc [CYCLE] > _tper) _overr.fetch_add (1, std::memory_order_relaxed);
+
+    // Smoothed load, time constant is about 16 cycles.
+    v = (float) _acc [CYCLE] / _tper;
+    w = _load.load (std::memory_order_relaxed);
+    _load.store (w + 0.0625f * (v - w), std::memory_order_relaxed);
+}
+
+
+void Perfstats::set_quality (uint32_t q)
+{
+    if (q == _qlevel.load (std::memory_order_relaxed)) return;
+    _qlevel.store (q, std::memory_order_relaxed);
+    _qchang.fetch_add (1, std::memory_order_relaxed);
+}
+
+
+void Perfstats::set_waves (uint64_t bytes, uint32_t nres, uint32_t nevict)
+{
+    _wbytes.store (bytes, std::memory_order_relaxed);
+    _wresid.store (nres, std::memory_order_relaxed);
+    _wevict.store (nevict, std::memory_order_relaxed);
+}
+
+
+void Perfstats::add_reload (float ms)
+{
+    _reload.fetch_add (1, std::memory_order_relaxed);
+    _rlast.store (ms, std::memory_order_relaxed);
+    if (ms > _rmax.load (std::memory_order_relaxed)) _rmax.store (ms, std::memory_order_relaxed);
+}
+
+
+void Perfstats::add_job (float ms)
+{
+    _jdone.fetch_add (1, std::memory_order_relaxed);
+    _jlast.store (ms, std::memory_order_relaxed);
+    if (ms > _jmax.load (std::memory_order_relaxed)) _jmax.store (ms, std::memory_order_relaxed);
+}
+
+
+void Perfstats::update (Stage *S, int64_t dt)
+{
+    uint32_t  t;
+    int64_t   k;
+
+    t = (dt > UINT32_MAX) ? UINT32_MAX : (uint32_t) dt;
+    if (t < S->_tmin.load (std::memory_order_relaxed)) S->_tmin.store (t, std::memory_order_relaxed);
+    if (t > S->_tmax.load (std::memory_order_relaxed)) S->_tmax.store (t, std::memory_order_relaxed);
+    S->_tsum.store (S->_tsum.load (std::memory_order_relaxed) + t, std::memory_order_relaxed);
+    k = dt * HSCALE / _tper;
+    if (k >= NHIST) k = NHIST - 1;
+    S->_hist [k].store (S->_hist [k].load (std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    S->_count.store (S->_count.load (std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+
+float Perfstats::percentile (const Stage *S, uint32_t n, float p) const
+{
+    int       i;
+    uint32_t  k, m;
+
+    // Returns the upper edge of the bin containing the percentile.
+    m = (uint32_t)(p * n);
+    k = 0;
+    for (i = 0; i < NHIST - 1; i++)
+    {
+        k += S->_hist [i].load (std::memory_order_relaxed);
+        if (k > m) break;
+    }
+    return 1e-3f * (i + 1) * _tper / (int) HSCALE;
+}
+
+
+void Perfstats::get_info (int s, Perfinfo *I) const
+{
+    const Stage *S = _stage + s;
+    uint32_t     n;
+
+    n = S->_count.load (std::memory_order_acquire);
+    I->_count = n;
+    if (n == 0)
+    {
+        I->_min = I->_avg = I->_max = 0.0f;
+        I->_p50 = I->_p95 = I->_p99 = 0.0f;
+        return;
+    }
+    I->_min = 1e-3f * S->_tmin.load (std::memory_order_relaxed);
+    I->_max = 1e-3f * S->_tmax.load (std::memory_order_relaxed);
+    I->_avg = 1e-3f * S->_tsum.load (std::memory_order_relaxed) / n;
+    I->_p50 = percentile (S, n, 0.50f);
+    I->_p95 = percentile (S, n, 0.95f);
+    I->_p99 = percentile (S, n, 0.99f);
+    if (I->_p50 > I->_max) I->_p50 = I->_max;
+    if (I->_p95 > I->_max) I->_p95 = I->_max;
+    if (I->_p99 > I->_max) I->_p99 = I->_max;
+}
+
+
+const float Quality::HIGH = 0.85f;
+const float Quality::LOW  = 0.50f;
+
+
+Quality::Quality (void) :
+    _enable (false),
+    _level (FULL),
+    _hold (0),
+    _good (0),
+    _nup (100)
+{
+}
+
+
+void Quality::init (unsigned int fsamp, unsigned int fsize)
+{
+    _level = FULL;
+    _hold = 0;
+    _good = 0;
+    _nup = 2 * fsamp / fsize;
+    if (_nup < HOLD) _nup = HOLD;
+}
+
+
+int Quality::update (float load)
+{
+    if (! enabled ())
+    {
+        _level = FULL;
+        _good = 0;
+        return _level;
+    }
+    if (_hold) _hold--;
+    if (load > HIGH)
+    {
+        _good = 0;
+        if (! _hold && (_level < NLEVEL - 1))
+        {
+            _level++;
+            _hold = HOLD;
+        }
+    }
+    else if (load < LOW)
+    {
+        if ((++_good >= _nup) && (_level > FULL))
+        {
+            _level--;
+            _good = 0;
+            _hold = HOLD;
+        }
+    }
+    else _good = 0;
+    return _level;
+}
@@ -0,0 +1,216 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __PERFSTATS_H
+#define __PERFSTATS_H
+
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+
+
+// Timing statistics for the audio thread. There is a single writer
+// (the audio thread) and any number of readers (the user interfaces).
+// All shared fields are atomics, so readers never block the writer.
+// Individual values are always consistent, but a reader may see a
+// mix of two successive cycles, which is fine for monitoring.
+
+
+class Perfinfo
+{
+public:
+
+    uint32_t  _count;  // number of cycles
+    float     _min;    // all times in microseconds
+    float     _avg;
+    float     _max;
+    float     _p50;
+    float     _p95;
+    float     _p99;
+};
+
+
+class Perfstats
+{
+public:
+
+    enum { QUEUE, KEYS, DIVIS, ASECT, REVERB, CYCLE, NSTAGE };
+    enum { NHIST = 64, HSCALE = 32 };  // histogram bins are 1/32 of a period
+
+    Perfstats (void);
+
+    static int64_t tnow (void)
+    {
+        struct timespec t;
+        clock_gettime (CLOCK_MONOTONIC, &t);
+        return (int64_t) t.tv_sec * 1000000000 + t.tv_nsec;
+    }
+
+    static const char *stage_name (int s);
+
+    void init (unsigned int fsamp, unsigned int fsize);
+    void set_period (unsigned int fsamp, unsigned int fsize);
+
+    // Audio thread only.
+    void cycle_begin (void);
+    void cycle_end (void);
+    void stage_add (int s, int64_t dt) { _acc [s] += dt; }
+    void set_voices (uint32_t n) { _voices.store (n, std::memory_order_relaxed); }
+    void add_culls (uint32_t n) { if (n) _culls.fetch_add (n, std::memory_order_relaxed); }
+    void set_quality (uint32_t q);
+
+    // Model thread.
+    void set_waves (uint64_t bytes, uint32_t nres, uint32_t nevict);
+    void add_reload (float ms);
+    void add_prewarm (bool hit) { (hit ? _whits : _wmiss).fetch_add (1, std::memory_order_relaxed); }
+
+    // Slave thread.
+    void set_jobs (uint32_t n) { _jqueue.store (n, std::memory_order_relaxed); }
+    void add_job (float ms);
+    void add_cancel (void) { _jcanc.fetch_add (1, std::memory_order_relaxed); }
+    void add_merge (void) { _jmerg.fetch_add (1, std::memory_order_relaxed); }
+    void add_abort (void) { _jabrt.fetch_add (1, std::memory_order_relaxed); }
+
+    // Midi thread.
+    void add_midi (uint32_t nevent, uint32_t nread, bool wake, int64_t t);
+
+    // Any thread.
+    void add_ctl_merge (uint32_t n) { if (n) _cmerg.fetch_add (n, std::memory_order_relaxed); }
+    void xrun (void) { _xruns.fetch_add (1, std::memory_order_relaxed); }
+    void reset (void) { _reset.store (true, std::memory_order_relaxed); }
+    void get_info (int s, Perfinfo *I) const;
+    float    period (void) const { return 1e-3f * _tper; }
+    float    load (void) const { return _load.load (std::memory_order_relaxed); }
+    uint32_t xruns (void) const { return _xruns.load (std::memory_order_relaxed); }
+    uint32_t overruns (void) const { return _overr.load (std::memory_order_relaxed); }
+    uint32_t voices (void) const { return _voices.load (std::memory_order_relaxed); }
+    uint32_t culls (void) const { return _culls.load (std::memory_order_relaxed); }
+    uint32_t quality (void) const { return _qlevel.load (std::memory_order_relaxed); }
+    uint32_t qchanges (void) const { return _qchang.load (std::memory_order_relaxed); }
+    uint64_t wavebytes (void) const { return _wbytes.load (std::memory_order_relaxed); }
+    uint32_t resident (void) const { return _wresid.load (std::memory_order_relaxed); }
+    uint32_t evicted (void) const { return _wevict.load (std::memory_order_relaxed); }
+    uint32_t reloads (void) const { return _reload.load (std::memory_order_relaxed); }
+    float    reload_last (void) const { return _rlast.load (std::memory_order_relaxed); }
+    float    reload_max (void) const { return _rmax.load (std::memory_order_relaxed); }
+    uint32_t prewarm_hits (void) const { return _whits.load (std::memory_order_relaxed); }
+    uint32_t prewarm_misses (void) const { return _wmiss.load (std::memory_order_relaxed); }
+    uint32_t jobs_queued (void) const { return _jqueue.load (std::memory_order_relaxed); }
+    uint32_t jobs_done (void) const { return _jdone.load (std::memory_order_relaxed); }
+    uint32_t jobs_cancelled (void) const { return _jcanc.load (std::memory_order_relaxed); }
+    uint32_t jobs_merged (void) const { return _jmerg.load (std::memory_order_relaxed); }
+    uint32_t jobs_aborted (void) const { return _jabrt.load (std::memory_order_relaxed); }
+    float    job_last (void) const { return _jlast.load (std::memory_order_relaxed); }
+    float    job_max (void) const { return _jmax.load (std::memory_order_relaxed); }
+    uint32_t ctl_merged (void) const { return _cmerg.load (std::memory_order_relaxed); }
+    uint32_t midi_events (void) const { return _mevnt.load (std::memory_order_relaxed); }
+    uint32_t midi_reads (void) const { return _mread.load (std::memory_order_relaxed); }
+    float    midi_wakerate (void) const { return _mrate.load (std::memory_order_relaxed); }
+
+private:
+
+    class Stage
+    {
+    public:
+
+        void clear (void);
+
+        std::atomic<uint32_t>  _count;
+        std::atomic<uint32_t>  _tmin;  // nanoseconds
+        std::atomic<uint32_t>  _tmax;
+        std::atomic<uint64_t>  _tsum;
+        std::atomic<uint32_t>  _hist [NHIST];
+    };
+
+    void update (Stage *S, int64_t dt);
+    float percentile (const Stage *S, uint32_t n, float p) const;
+
+    int64_t                _tper;  // period in nanoseconds
+    int64_t                _t0;
+    int64_t                _acc [NSTAGE];
+    Stage                  _stage [NSTAGE];
+    std::atomic<float>     _load;
+    std::atomic<uint32_t>  _xruns;
+    std::atomic<uint32_t>  _overr;
+    std::atomic<uint32_t>  _voices;  // sounding pipes
+    std::atomic<uint32_t>  _culls;   // pipes culled by the voice budget
+    std::atomic<uint32_t>  _qlevel;  // see Quality
+    std::atomic<uint32_t>  _qchang;
+    std::atomic<uint64_t>  _wbytes;  // wave data of resident ranks
+    std::atomic<uint32_t>  _wresid;
+    std::atomic<uint32_t>  _wevict;
+    std::atomic<uint32_t>  _reload;  // ranks loaded again on demand
+    std::atomic<float>     _rlast;   // reload times in milliseconds
+    std::atomic<float>     _rmax;
+    std::atomic<uint32_t>  _whits;   // ranks ready when a preset needed them
+    std::atomic<uint32_t>  _wmiss;
+    std::atomic<uint32_t>  _jqueue;  // Slave jobs waiting
+    std::atomic<uint32_t>  _jdone;   // ranks made
+    std::atomic<uint32_t>  _jcanc;   // dropped, a later job replaced them
+    std::atomic<uint32_t>  _jmerg;   // dropped, a later job was the same
+    std::atomic<uint32_t>  _jabrt;   // stopped while being made
+    std::atomic<float>     _jlast;   // time from sending to done, in milliseconds
+    std::atomic<float>     _jmax;
+    std::atomic<uint32_t>  _cmerg;   // swell and tremulant events replaced by a later one
+    std::atomic<uint32_t>  _mevnt;   // ALSA midi input events
+    std::atomic<uint32_t>  _mread;   // reads from the sequencer
+    std::atomic<float>     _mrate;   // model wakeups per second
+    int64_t                _mt0;     // start of the wakeup count, midi thread only
+    uint32_t               _mwake;
+    std::atomic<bool>      _reset;
+};
+
+
+// Chooses the processing quality from the cycle load. Steps down
+// as soon as the load is too high, and up again only after it has
+// been low for a few seconds. Audio thread only, except enable().
+
+class Quality
+{
+public:
+
+    enum { FULL, LIGHT_REVERB, LIGHT_ALL, NLEVEL };
+
+    Quality (void);
+
+    void init (unsigned int fsamp, unsigned int fsize);
+    void enable (bool e) { _enable.store (e, std::memory_order_relaxed); }
+    bool enabled (void) const { return _enable.load (std::memory_order_relaxed); }
+    int  update (float load);
+    int  level (void) const { return _level; }
+
+    static const float HIGH;
+    static const float LOW;
+
+private:
+
+    enum { HOLD = 32 };  // cycles, about twice the load time constant
+
+    std::atomic<bool>  _enable;
+    int                _level;
+    int                _hold;  // cycles before the next step down
+    int                _good;  // cycles with a low load
+    int                _nup;   // low load cycles needed to step up
+};
+
+
+#endif
+
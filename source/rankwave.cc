@@ -22,7 +22,9 @@
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <assert.h>
 #include "rankwave.h"
+#include "waveindex.h"
 
 
 extern float exp2ap (float);
@@ -31,14 +33,19 @@ extern float exp2ap (float);
 Rngen   Pipewave::_rgen;
 float  *Pipewave::_arg = 0;
 float  *Pipewave::_att = 0;
+int     Pipewave::_nsta = 0;
 
 
 void Pipewave::initstatic (float fsamp)
 {
     int k;
 
-    if (_arg) return;
+    // Grow the buffers if the sample rate has increased.
     k = (int)(fsamp);
+    if (k <= _nsta) return;
+    delete[] _arg;
+    delete[] _att;
+    _nsta = k;
     _arg = new float [k];
     k = (int)(0.5f * fsamp);
     _att = new float [k];
@@ -61,6 +68,7 @@ void Pipewave::play (void)
             p = _p0;
             _y_p = 0.0f;
             _z_p = 0.0f;
+            _cull = 0;
         }
     }
     else
@@ -71,7 +79,7 @@ void Pipewave::play (void)
             p = 0;
             _g_r = 1.0f;
             _y_r = _y_p;
-            _i_r = _k_r;
+            _i_r = (_cull && (_k_r > FADE)) ? (int16_t) FADE : _k_r;
         }
     }
 
@@ -203,7 +211,6 @@ void Pipewave::genwave (Addsynth *D, int n, float fsamp, float fpipe)
 
     k = _l0 + _l1 + _k_s * (PERIOD + 4);
 
-    delete[] _p0;
     _p0 = new float [k];
     _p1 = _p0 + _l0;
     _p2 = _p1 + _l1;
@@ -252,6 +259,28 @@ void Pipewave::genwave (Addsynth *D, int n, float fsamp, float fpipe)
         }
     }
     for (i = 0; i < _k_s * (PERIOD + 4); i++) _p0 [i + _l0 + _l1] = _p0 [i + _l0];
+    measure ();
+}
+
+
+void Pipewave::measure (void)
+{
+    int    i;
+    float  s;
+
+    for (i = 0, s = 0; i < _l1; i++) s += _p1 [i] * _p1 [i];
+    _lev = (_l1 > 0) ? sqrtf (s / _l1) : 0.0f;
+}
+
+
+void Pipewave::cull (void)
+{
+    // Start a short release, or shorten the current one.
+    _sbit = 0;
+    _sdel = 0;
+    _keys = 0;
+    _cull = 1;
+    if (_p_r && (_i_r > FADE)) _i_r = FADE;
 }
 
 
@@ -325,15 +354,17 @@ void Pipewave::attgain (int n, float p)
 }
 
 
-void Pipewave::save (FILE *F)
+union Pipeparam
 {
-    int  k;
-    union
-    {
-        int16_t i16 [16];
-        int32_t i32 [8];
-        float   flt [8];
-    } d;
+    int16_t i16 [16];
+    int32_t i32 [8];
+    float   flt [8];
+};
+
+
+void Pipewave::pack (void *p) const
+{
+    Pipeparam d;
 
     d.i32 [0] = _l0;
     d.i32 [1] = _l1;
@@ -344,23 +375,15 @@ void Pipewave::save (FILE *F)
     d.flt [5] = _d_a;
     d.flt [6] = _d_w;
     d.i32 [7] = 0;
-    fwrite (&d, 1, 32, F);
-    k = _l0 +_l1 + _k_s * (PERIOD + 4);
-    fwrite (_p0, k, sizeof (float), F);
+    memcpy (p, &d, 32);
 }
 
 
-void Pipewave::load (FILE *F)
+void Pipewave::unpack (const void *p)
 {
-    int  k;
-    union
-    {
-        int16_t i16 [16];
-        int32_t i32 [8];
-        float   flt [8];
-    } d;
+    Pipeparam d;
 
-    fread (&d, 1, 32, F);
+    memcpy (&d, p, 32);
     _l0  = d.i32 [0];
     _l1  = d.i32 [1];
     _k_s = d.i16 [4];
@@ -369,39 +392,215 @@ void Pipewave::load (FILE *F)
     _d_r = d.flt [4];
     _d_a = d.flt [5];
     _d_w = d.flt [6];
-    k = _l0 +_l1 + _k_s * (PERIOD + 4);
-    delete[] _p0;
+}
+
+
+void Pipewave::save (FILE *F)
+{
+    char d [32];
+
+    pack (d);
+    fwrite (d, 1, 32, F);
+    fwrite (_p0, nsamp (), sizeof (float), F);
+}
+
+
+void Pipewave::load (FILE *F)
+{
+    int  k;
+    char d [32];
+
+    fread (d, 1, 32, F);
+    unpack (d);
+    k = nsamp ();
     _p0 = new float [k];
     _p1 = _p0 + _l0;
     _p2 = _p1 + _l1;
     fread (_p0, k, sizeof (float), F);
+    measure ();
 }
 
 
 
 
-Rankwave::Rankwave (int n0, int n1) : _n0 (n0), _n1 (n1), _list (0), _modif (false)
+Wavebank::Wavebank (int n) : _npipe (n), _refs (1)
+{
+    _bufs = new float * [n];
+    memset (_bufs, 0, n * sizeof (float *));
+}
+
+
+Wavebank::~Wavebank (void)
+{
+    for (int i = 0; i < _npipe; i++) delete[] _bufs [i];
+    delete[] _bufs;
+}
+
+
+Rankwave::Rankwave (int n0, int n1) :
+    _n0 (n0), _n1 (n1), _sbit (0), _list (0), _modif (false),
+    _unit (0), _offs (0), _ubit (1)
 {
     _pipes = new Pipewave [n1 - n0 + 1];
+    _bank = new Wavebank (n1 - n0 + 1);
 }
 
 
 Rankwave::~Rankwave (void)
 {
     delete[] _pipes;
+    _bank->unref ();
+}
+
+
+size_t Rankwave::size (void) const
+{
+    int     i;
+    size_t  n;
+
+    for (i = 0, n = 0; i <= _n1 - _n0; i++)
+    {
+        if (_pipes [i]._p0) n += _pipes [i].nsamp () * sizeof (float);
+    }
+    return n;
+}
+
+
+float Rankwave::touch (void) const
+{
+    int     i, k, n;
+    float   s;
+    const float *p;
+
+    // Makes sure the waves are in memory, e.g. when they are in
+    // a shared segment or were paged out. Done by the Slave thread
+    // before they are needed, the result only keeps the reads.
+    for (i = 0, s = 0; i <= _n1 - _n0; i++)
+    {
+        p = _pipes [i]._p0;
+        if (! p) continue;
+        n = _pipes [i].nsamp ();
+        for (k = 0; k < n; k += 1024) s += p [k];
+        s += p [n - 1];
+    }
+    return s;
+}
+
+
+uint64_t Rankwave::key (Addsynth *D, float fsamp, float fbase, float *scale)
+{
+    uint64_t  h;
+
+    // Everything that determines the waves. Pan and delay
+    // only affect playing.
+    h = Wavestore::hash (0xCBF29CE484222325ULL, "ae1 2", 6);
+    h = Wavestore::hash (h, &D->_n0, (const char *)(&D->_h_atp + 1) - (const char *)(&D->_n0));
+    h = Wavestore::hash (h, &fsamp, sizeof (float));
+    h = Wavestore::hash (h, &fbase, sizeof (float));
+    h = Wavestore::hash (h, scale, 12 * sizeof (float));
+    return h;
+}
+
+
+void Rankwave::share (const Rankwave *R)
+{
+    int        i;
+    Pipewave  *P, *Q;
+
+    // Copy the wave parameters, the playing state stays apart.
+    for (i = _n0, P = _pipes, Q = R->_pipes; i <= _n1; i++, P++, Q++)
+    {
+        P->_p0  = Q->_p0;
+        P->_p1  = Q->_p1;
+        P->_p2  = Q->_p2;
+        P->_l0  = Q->_l0;
+        P->_l1  = Q->_l1;
+        P->_k_s = Q->_k_s;
+        P->_k_r = Q->_k_r;
+        P->_m_r = Q->_m_r;
+        P->_d_r = Q->_d_r;
+        P->_d_a = Q->_d_a;
+        P->_d_w = Q->_d_w;
+        P->_lev = Q->_lev;
+    }
+    R->_bank->ref ();
+    _bank->unref ();
+    _bank = R->_bank;
+    _modif = R->_modif;
+}
+
+
+int Rankwave::attach (Addsynth *D, float fsamp, float fbase, float *scale)
+{
+    int          i;
+    const char  *p;
+    Pipewave    *P;
+
+    if (! Wavestore::enabled ()) return 1;
+    if (_bank->_store.acquire (key (D, fsamp, fbase, scale)) != Wavestore::ATTACHED) return 1;
+
+    // Same layout as the ae1 file, without the headers.
+    p = (const char *) _bank->_store.data ();
+    for (i = _n0, P = _pipes; i <= _n1; i++, P++)
+    {
+        P->unpack (p);
+        p += 32;
+        P->_p0 = (float *) p;
+        P->_p1 = P->_p0 + P->_l0;
+        P->_p2 = P->_p1 + P->_l1;
+        P->measure ();
+        p += P->nsamp () * sizeof (float);
+    }
+    _modif = true;
+    return 0;
+}
+
+
+void Rankwave::publish (void)
+{
+    int        i, k;
+    size_t     n;
+    char      *p;
+    Pipewave  *P;
+
+    if (_bank->_store.state () != Wavestore::CREATED) return;
+    for (i = _n0, n = 0, P = _pipes; i <= _n1; i++, P++) n += 32 + P->nsamp () * sizeof (float);
+    if (! (p = (char *) _bank->_store.create (n))) return;
+
+    // Copy the waves and switch to the shared copy.
+    for (i = _n0, P = _pipes; i <= _n1; i++, P++)
+    {
+        P->pack (p);
+        p += 32;
+        k = P->nsamp ();
+        memcpy (p, P->_p0, k * sizeof (float));
+        delete[] _bank->_bufs [i - _n0];
+        _bank->_bufs [i - _n0] = 0;
+        P->_p0 = (float *) p;
+        P->_p1 = P->_p0 + P->_l0;
+        P->_p2 = P->_p1 + P->_l1;
+        p += k * sizeof (float);
+    }
+    _bank->_store.commit ();
 }
 
 
-void Rankwave::gen_waves (Addsynth *D, float fsamp, float fbase, float *scale)
+int Rankwave::gen_waves (Addsynth *D, float fsamp, float fbase, float *scale, bool (*cancel)(void *), void *arg)
 {
+    // Waves used by other ranks or in a shared segment can't be replaced.
+    assert ((_bank->_refs.load () == 1) && ! _bank->_store.data ());
     Pipewave::initstatic (fsamp);
 
     fbase *=  D->_fn / (D->_fd * scale [9]);
     for (int i = _n0; i <= _n1; i++)
     {
+        if (cancel && cancel (arg)) return 1;
         _pipes [i - _n0].genwave (D, i - _n0, fsamp, ldexpf (fbase * scale [i % 12], i / 12 - 5));
+        delete[] _bank->_bufs [i - _n0];
+        _bank->_bufs [i - _n0] = _pipes [i - _n0]._p0;
     }
     _modif = true;
+    return 0;
 }
 
 
@@ -422,21 +621,91 @@ void Rankwave::set_param (float *out, int del, int pan)
 }
 
 
-void Rankwave::play (int shift)
+void Rankwave::set_unit (Rankwave *U, int offs)
+{
+    // The keys that map to a pipe of U, within the
+    // range of the keyboard (36..96). The others are
+    // silent.
+    _unit = U;
+    _offs = offs;
+    _n0 = U->_n0 - offs;
+    _n1 = U->_n1 - offs;
+    if (_n0 < 36) _n0 = 36;
+    if (_n1 > 96) _n1 = 96;
+}
+
+
+int Rankwave::play (int shift)
 {
+    int       n;
     Pipewave *P, *Q;
 
-    for (P = 0, Q = _list; Q; Q = Q->_link)
+    // Returns the number of pipes playing, not counting
+    // those being culled.
+    for (n = 0, P = 0, Q = _list; Q; Q = Q->_link)
     {
         Q->play ();
         if (shift) Q->_sdel = (Q->_sdel >> 1) | Q->_sbit;
-        if (Q->_sdel || Q->_p_p || Q->_p_r) P = Q;
+        if (Q->_sdel || Q->_p_p || Q->_p_r)
+        {
+            P = Q;
+            if (! Q->_cull) n++;
+        }
         else
         {
               if (P) P->_link = Q->_link;
             else      _list = Q->_link;
         }
     }
+    return n;
+}
+
+
+void Rankwave::offer (Voicebudget *B, float gain)
+{
+    int       n;
+    float     v;
+    Pipewave *P;
+
+    // Pipes at both ends of the compass carry the bass and the
+    // melody, they are kept longer than those in the middle.
+    // Released pipes are weighted by their remaining gain.
+    for (P = _list; P; P = P->_link)
+    {
+        if (P->_cull) continue;
+        n = (P - _pipes) + _n0;
+        v = gain * P->_lev * (1.0f + fabsf (n - 66.0f) / 30.0f);
+        if (P->_p_r && ! P->_p_p) v *= P->_g_r;
+        B->offer (P, v);
+    }
+}
+
+
+void Voicebudget::offer (Pipewave *P, float v)
+{
+    int  i;
+
+    // Keep the _nwant lowest, in ascending order.
+    if (_ncand < _nwant) i = _ncand++;
+    else if (_ncand && (v < _vcand [_ncand - 1])) i = _ncand - 1;
+    else return;
+    while (i && (v < _vcand [i - 1]))
+    {
+        _cand [i] = _cand [i - 1];
+        _vcand [i] = _vcand [i - 1];
+        i--;
+    }
+    _cand [i] = P;
+    _vcand [i] = v;
+}
+
+
+int Voicebudget::cull (void)
+{
+    int  i;
+
+    for (i = 0; i < _ncand; i++) _cand [i]->cull ();
+    return _ncand;
 }
 
 
@@ -448,6 +717,7 @@ int Rankwave::save (const char *path, Addsynth *D, float fsamp, float fbase, flo
     char       name [1024];
     char       data [64];
     char      *p;
+    Waveindex::Entry  E;
 
     sprintf (name, "%s/%s", path, D->_filename);
     if ((p = strrchr (name, '.'))) strcpy (p, ".ae1");
@@ -481,99 +751,149 @@ int Rankwave::save (const char *path, Addsynth *D, float fsamp, float fbase, flo
 
     for (i = _n0, P = _pipes; i <= _n1; i++, P++) P->save (F);
 
+    memset (&E, 0, sizeof (E));
+    E._offs  = 80;
+    E._n0    = _n0;
+    E._n1    = _n1;
+    E._fsamp = fsamp;
+    E._fbase = fbase;
+    memcpy (E._scale, scale, 12 * sizeof (float));
+    fflush (F);
+    Waveindex::update (path, name + strlen (path) + 1, fileno (F), &E);
     fclose (F);
+    Waveindex::flush ();
 
     _modif = false;
     return 0;
 }
 
 
-int Rankwave::load (const char *path, Addsynth *D, float fsamp, float fbase, float *scale)
+static int check (const Waveindex::Entry *E, int n0, int n1, float fsamp, float fbase, float *scale)
 {
-    FILE      *F;
-    Pipewave  *P;
-    int        i;
-    char       name [1024];
-    char       data [64];
-    char      *p;
-    float      f;
+    int i;
 
-    sprintf (name, "%s/%s", path, D->_filename);
-    if ((p = strrchr (name, '.'))) strcpy (p, ".ae1");
-    else strcat (name, ".ae1");
-
-    F = fopen (name, "rb");
-    if (F == NULL)
+    if ((E->_n0 != n0) || (E->_n1 != n1))
     {
 #ifdef DEBUG
-        fprintf (stderr, "Can't open waveform file '%s' for reading\n", name);
+        fprintf (stderr, "File '%s' has an incompatible note range (%d %d), (%d %d)\n", E->_name, n0, n1, E->_n0, E->_n1);
 #endif
         return 1;
     }
 
-    fread (data, 1, 16, F);
-    if (strcmp (data, "ae1"))
+    if (fabsf (E->_fsamp - fsamp) > 0.1f)
     {
 #ifdef DEBUG
-        fprintf (stderr, "File '%s' is not an Aeolus waveform file\n", name);
+        fprintf (stderr, "File '%s' has a different sample frequency (%3.1lf)\n", E->_name, E->_fsamp);
 #endif
-        fclose (F);
         return 1;
     }
 
-    if (data [4] != 2)
+    if (fabsf (E->_fbase - fbase) > 0.1f)
     {
 #ifdef DEBUG
-        fprintf (stderr, "File '%s' has an incompatible version tag (%d)\n", name, data [4]);
+        fprintf (stderr, "File '%s' has a different tuning (%3.1lf)\n", E->_name, E->_fbase);
 #endif
-        fclose (F);
         return 1;
     }
 
-    fread (data, 1, 64, F);
-    if (_n0 != data [4] || _n1 != data [5])
+    for (i = 0; i < 12; i++)
     {
+        if (fabsf (E->_scale [i] /  scale [i] - 1.0f) > 6e-5f)
+        {
 #ifdef DEBUG
-        fprintf (stderr, "File '%s' has an incompatible note range (%d %d), (%d %d)\n", name, _n0, _n1, data [4], data [5]);
+            fprintf (stderr, "File '%s' has a different temperament\n", E->_name);
 #endif
-        fclose (F);
-        return 1;
+            return 1;
+        }
     }
+    return 0;
+}
+
 
-    f = *((float *)(data + 8));
-    if (fabsf (f - fsamp) > 0.1f)
+int Rankwave::load (const char *path, Addsynth *D, float fsamp, float fbase, float *scale)
+{
+    FILE      *F;
+    Pipewave  *P;
+    int        i, k;
+    char       name [1024];
+    char       data [64];
+    char      *p;
+    Waveindex::Entry  E;
+
+    sprintf (name, "%s/%s", path, D->_filename);
+    if ((p = strrchr (name, '.'))) strcpy (p, ".ae1");
+    else strcat (name, ".ae1");
+
+    // The index tells if the file exists and what it was made for,
+    // without opening it.
+    k = Waveindex::find (path, name + strlen (path) + 1, &E);
+    if (k == Waveindex::MISSING) return 1;
+    if ((k == Waveindex::KNOWN) && check (&E, _n0, _n1, fsamp, fbase, scale))
     {
-#ifdef DEBUG
-        fprintf (stderr, "File '%s' has a different sample frequency (%3.1lf)\n", name, f);
-#endif
-        fclose (F);
-        return 1;
+        // Made for other parameters, unless it was changed since.
+        if (Waveindex::current (path, &E)) return 1;
+        k = Waveindex::UNKNOWN;
     }
 
-    f = *((float *)(data + 12));
-    if (fabsf (f - fbase) > 0.1f)
+    F = fopen (name, "rb");
+    if (F == NULL)
     {
 #ifdef DEBUG
-        fprintf (stderr, "File '%s' has a different tuning (%3.1lf)\n", name, f);
+        fprintf (stderr, "Can't open waveform file '%s' for reading\n", name);
 #endif
-        fclose (F);
         return 1;
     }
 
-    for (i = 0; i < 12; i++)
+    if ((k == Waveindex::KNOWN) && Waveindex::current (fileno (F), &E))
+    {
+        fseek (F, E._offs, SEEK_SET);
+    }
+    else
     {
-        f = *((float *)(data + 16 + 4 * i));
-        if (fabsf (f /  scale [i] - 1.0f) > 6e-5f)
+        // Not in the index, or changed since.
+        fread (data, 1, 16, F);
+        if (strcmp (data, "ae1"))
+        {
+#ifdef DEBUG
+            fprintf (stderr, "File '%s' is not an Aeolus waveform file\n", name);
+#endif
+            fclose (F);
+            return 1;
+        }
+
+        if (data [4] != 2)
         {
 #ifdef DEBUG
-            fprintf (stderr, "File '%s' has a different temperament\n", name);
+            fprintf (stderr, "File '%s' has an incompatible version tag (%d)\n", name, data [4]);
 #endif
             fclose (F);
             return 1;
         }
+
+        fread (data, 1, 64, F);
+        memset (&E, 0, sizeof (E));
+        strncpy (E._name, name + strlen (path) + 1, sizeof (E._name) - 1);
+        E._offs  = 80;
+        E._n0    = data [4];
+        E._n1    = data [5];
+        E._fsamp = *((float *)(data + 8));
+        E._fbase = *((float *)(data + 12));
+        memcpy (E._scale, data + 16, 12 * sizeof (float));
+        Waveindex::update (path, name + strlen (path) + 1, fileno (F), &E);
+        if (check (&E, _n0, _n1, fsamp, fbase, scale))
+        {
+            fclose (F);
+            return 1;
+        }
     }
 
-    for (i = _n0, P = _pipes; i <= _n1; i++, P++) P->load (F);
+    assert ((_bank->_refs.load () == 1) && ! _bank->_store.data ());
+    for (i = _n0, P = _pipes; i <= _n1; i++, P++)
+    {
+        P->load (F);
+        delete[] _bank->_bufs [i - _n0];
+        _bank->_bufs [i - _n0] = P->_p0;
+    }
 
     fclose (F);
 
@@ -22,8 +22,10 @@
 #define __RANKWAVE_H
 
 
+#include <atomic>
 #include "addsynth.h"
 #include "rngen.h"
+#include "wavestore.h"
 
 
 #define PERIOD 64
@@ -37,18 +39,24 @@ private:
         _p0 (0), _p1 (0), _p2 (0), _l1 (0),
         _k_s (0),  _k_r (0),
         _m_r (0), _d_r (0), _d_a (0), _d_w (0),
-        _link (0), _sbit (0), _sdel (0),
-        _p_p (0), _y_p (0), _z_p (0), _p_r (0), _y_r (0), _g_r (0), _i_r (0)
+        _lev (0), _link (0), _sbit (0), _sdel (0), _keys (0),
+        _p_p (0), _y_p (0), _z_p (0), _p_r (0), _y_r (0), _g_r (0), _i_r (0), _cull (0)
     {}
 
-    ~Pipewave (void) { delete[] _p0; }
-
     friend class Rankwave;
+    friend class Voicebudget;
+
+    enum { FADE = 4 };  // release length when culled, in periods
 
     void genwave (Addsynth *D, int n, float fsamp, float fpipe);
     void save (FILE *F);
     void load (FILE *F);
+    void pack (void *d) const;
+    void unpack (const void *d);
+    int  nsamp (void) const { return _l0 + _l1 + _k_s * (PERIOD + 4); }
     void play (void);
+    void measure (void);
+    void cull (void);
 
     static void looplen (float f, float fsamp, int lmax, int *aa, int *bb);
     static void attgain (int n, float p);
@@ -64,10 +72,12 @@ private:
     float      _d_r;   // release detune
     float      _d_a;   // instability amplitude
     float      _d_w;   // instability bandwidth
+    float      _lev;   // rms level of the loop
 
     Pipewave  *_link;  // link to next in active chain
     uint32_t   _sbit;  // on state bit
     uint32_t   _sdel;  // delayed state
+    uint32_t   _keys;  // ranks holding this pipe
     float     *_out;   // audio output buffer
     float     *_p_p;   // play pointer
     float      _y_p;   // play interpolation
@@ -76,6 +86,7 @@ private:
     float      _y_r;   // release interpolation
     float      _g_r;   // release gain
     int16_t    _i_r;   // release count
+    int16_t    _cull;  // fading out by voice budget
 
 
     static void initstatic (float fsamp);
@@ -83,6 +94,61 @@ private:
     static   Rngen   _rgen;
     static   float  *_arg;
     static   float  *_att;
+    static   int     _nsta;
+};
+
+
+// The wave data of a rank. It does not change once made, and
+// is shared by all Rankwaves made from identical stops. It is
+// deleted with the last of them.
+
+class Wavebank
+{
+private:
+
+    Wavebank (int n);
+    ~Wavebank (void);
+
+    void ref (void) { _refs.fetch_add (1); }
+    void unref (void) { if (_refs.fetch_sub (1) == 1) delete this; }
+
+    friend class Rankwave;
+
+    int               _npipe;
+    float           **_bufs;   // owned buffers, unless in _store
+    Wavestore         _store;
+    std::atomic<int>  _refs;
+};
+
+
+// Limits the number of sounding pipes. When there are too many,
+// the least audible ones are faded out quickly. Only the limit
+// may be changed by other threads.
+
+class Voicebudget
+{
+public:
+
+    enum { NCULL = 16 };  // maximum per period
+
+    Voicebudget (void) : _limit (0), _nwant (0), _ncand (0) {}
+
+    void set_limit (int n) { _limit.store (n, std::memory_order_relaxed); }
+    int  limit (void) const { return _limit.load (std::memory_order_relaxed); }
+
+    // Audio thread. Offer all pipes after begin(), cull()
+    // fades out the n quietest and returns their number.
+    void begin (int n) { _nwant = (n > NCULL) ? NCULL : n; _ncand = 0; }
+    void offer (Pipewave *P, float v);
+    int  cull (void);
+
+private:
+
+    std::atomic<int>  _limit;
+    int               _nwant;
+    int               _ncand;
+    Pipewave         *_cand [NCULL];
+    float             _vcand [NCULL];
 };
 
 
@@ -95,39 +161,61 @@ public:
 
     void note_on (int n)
     {
-        if ((n < _n0) || (n > _n1)) return;
-        Pipewave *P = _pipes + (n - _n0);
-        P->_sbit = _sbit;
-        if (! (P->_sdel || P->_p_p || P->_p_r))
-        {
-            P->_sdel |= _sbit;
-            P->_link = _list;
-            _list = P;
-        }
+        if (_unit) _unit->pipe_on (n + _offs, _ubit);
+        else       pipe_on (n, _ubit);
     }
 
     void note_off (int n)
     {
-        if ((n < _n0) || (n > _n1)) return;
-        Pipewave *P = _pipes + (n - _n0);
-        P->_sdel >>= 4;
-        P->_sbit = 0;
+        if (_unit) _unit->pipe_off (n + _offs, _ubit);
+        else       pipe_off (n, _ubit);
     }
 
     void all_off (void)
     {
-        Pipewave *P;
-        for (P = _list; P; P = P->_link) P->_sbit = 0;
+        if (_unit) _unit->pipes_off (_ubit);
+        else       pipes_off (_ubit);
     }
 
+    // Releases all pipes, whoever holds them.
+    void release (void) { pipes_off (~0U); }
+    bool sounding (void) const { return _list != 0; }
+
     int  n0 (void) const { return _n0; }
     int  n1 (void) const { return _n1; }
-    void play (int shift);
+    int  play (int shift);
+    void offer (Voicebudget *B, float gain);
     void set_param (float *out, int del, int pan);
-    void gen_waves (Addsynth *D, float fsamp, float fbase, float *scale);
-    int  save (const char *path, Addsynth *D, float fsamp, float fbase, float *scale);
+    // Waves are made only once, by one of the following. If cancel
+    // is given it is called before each pipe, gen_waves() returns
+    // non-zero and leaves the waves incomplete when it returns true.
+    int  gen_waves (Addsynth *D, float fsamp, float fbase, float *scale, bool (*cancel)(void *) = 0, void *arg = 0);
     int  load (const char *path, Addsynth *D, float fsamp, float fbase, float *scale);
+    void share (const Rankwave *R);
+    int  save (const char *path, Addsynth *D, float fsamp, float fbase, float *scale);
     bool modif (void) const { return _modif; }
+    size_t size (void) const;  // bytes of wave data
+    float  touch (void) const;  // reads each page of the waves
+    bool shares (const Rankwave *R) const { return _bank == R->_bank; }
+
+    // Identifies the waves made by gen_waves() for these arguments.
+    static uint64_t key (Addsynth *D, float fsamp, float fbase, float *scale);
+
+    // Shared wavetables, see wavestore.h. If attach() returns
+    // non-zero the waves must be made as usual and then offered
+    // to other processes by publish().
+    int  attach (Addsynth *D, float fsamp, float fbase, float *scale);
+    void publish (void);
+
+    static void seed (uint32_t s) { Pipewave::_rgen.init (s); }
+
+    // Unit organ extension. A Rankwave without pipes of its own can
+    // play those of rank U, transposed by offs semitones. Each user
+    // of a pipe has its own bit, the pipe sounds while any is set.
+    void set_unit (Rankwave *U, int offs);
+    void set_user (int ind) { _ubit = 1U << ind; }
+    Rankwave *unit (void) const { return _unit; }
+    int  offs (void) const { return _offs; }
 
     int  _nmask;  // used by division logic
 
@@ -136,12 +224,50 @@ private:
     Rankwave (const Rankwave&);
     Rankwave& operator=(const Rankwave&);
 
+    void pipe_on (int n, uint32_t b)
+    {
+        if ((n < _n0) || (n > _n1)) return;
+        Pipewave *P = _pipes + (n - _n0);
+        P->_keys |= b;
+        P->_sbit = _sbit;
+        if (! (P->_sdel || P->_p_p || P->_p_r))
+        {
+            P->_sdel |= _sbit;
+            P->_link = _list;
+            _list = P;
+        }
+    }
+
+    void pipe_off (int n, uint32_t b)
+    {
+        if ((n < _n0) || (n > _n1)) return;
+        Pipewave *P = _pipes + (n - _n0);
+        P->_keys &= ~b;
+        if (P->_keys) return;
+        P->_sdel >>= 4;
+        P->_sbit = 0;
+    }
+
+    void pipes_off (uint32_t b)
+    {
+        Pipewave *P;
+        for (P = _list; P; P = P->_link)
+        {
+            P->_keys &= ~b;
+            if (! P->_keys) P->_sbit = 0;
+        }
+    }
+
     int         _n0;
     int         _n1;
     uint32_t    _sbit;
     Pipewave   *_list;
     Pipewave   *_pipes;
     bool        _modif;
+    Wavebank   *_bank;
+    Rankwave   *_unit;
+    int         _offs;
+    uint32_t    _ubit;
 };
 
 
@@ -42,6 +42,14 @@ void Delelm::fini (void)
 }
 
 
+void Delelm::clear (void)
+{
+    memset (_line, 0, _size * sizeof (float));
+    _slo = 0;
+    _shi = 0;
+}
+
+
 void Delelm::set_t60mf (float tmf)
 {
     _gmf = powf (0.001f, _size / tmf);
@@ -125,6 +133,7 @@ void Reverb::init (float rate)
     m = (rate < 64e3) ? 1 : 2;
     for (int i = 0; i < 16; i++) _delm [i].init (m * _sizes [i], _feedb [i]);
     _x0 = _x1 = _x2 = _x3 = _x4 = _x5 = _x6 = _x7 = _z = 0;
+    _m = _mt = 1;
     set_delay (0.05);
     set_t60mf (4.0f);
     set_t60lo (5.0f, 250.0f);
@@ -193,6 +202,11 @@ void Reverb::process (int n, float gain, float *R, float *W, float *X, float *Y,
     int   i, j;
     float t, g, x;
 
+    if ((_m < 1) || (_mt < 1))
+    {
+        process_light (n, gain, R, W, X, Y, Z);
+        return;
+    }
     g = sqrtf (0.125f);
     gain *= _gain;
 
@@ -247,3 +261,97 @@ void Reverb::process (int n, float gain, float *R, float *W, float *X, float *Y,
     _i = i;
 }
 
+
+
+void Reverb::process_light (int n, float gain, float *R, float *W, float *X, float *Y, float *Z)
+{
+    int   i, j;
+    float t, g, x, m, d, s;
+    float h0, h1, h2, h3;
+
+    // The 8 point Hadamard matrix combines two 4 point ones on the
+    // first and the last four loops. Without the last four, using
+    // the first one alone and scaling by sqrt (2) keeps the energy
+    // in the remaining loops, so the reverb time does not change.
+    // While m goes from 1 to 0 the last four loops are faded out,
+    // and the first four are crossfaded between the two matrices.
+    // Fading their input as well avoids a step when the delayed
+    // signal reappears after they have been cleared.
+
+    g = sqrtf (0.125f);
+    s = sqrtf (2.0f);
+    gain *= _gain;
+    d = 20.0f / _rate;
+    m = _m;
+    if ((m == 0) && (_mt > 0))
+    {
+        for (j = 8; j < 16; j++) _delm [j].clear ();
+        _x4 = _x5 = _x6 = _x7 = 0;
+    }
+
+    i = _i;
+    while (n--)
+    {
+        if      (m < _mt) { m += d; if (m > _mt) m = _mt; }
+        else if (m > _mt) { m -= d; if (m < _mt) m = _mt; }
+
+        j = i - _idel;
+        if (j < 0) j += _size;
+        x = _line [j];
+        _z += 0.6f * (*R++ - _z) + 1e-10f;
+        _line [i] = _z;
+        if (++i == _size) i = 0;
+
+        _x0 = _delm [0].process (g * _x0 + x);
+        _x1 = _delm [2].process (g * _x1 + x);
+        _x2 = _delm [4].process (g * _x2 + x);
+        _x3 = _delm [6].process (g * _x3 + x);
+
+        t = _x0 - _x1; _x0 += _x1;  _x1 = t;
+        t = _x2 - _x3; _x2 += _x3;  _x3 = t;
+        t = _x0 - _x2; _x0 += _x2;  _x2 = t;
+        t = _x1 - _x3; _x1 += _x3;  _x3 = t;
+
+        if (m > 0)
+        {
+            h0 = _delm  [8].process (m * (g * _x4 + x));
+            h1 = _delm [10].process (m * (g * _x5 + x));
+            h2 = _delm [12].process (m * (g * _x6 + x));
+            h3 = _delm [14].process (m * (g * _x7 + x));
+
+            t = h0 - h1; h0 += h1;  h1 = t;
+            t = h2 - h3; h2 += h3;  h3 = t;
+            t = h0 - h2; h0 += h2;  h2 = t;
+            t = h1 - h3; h1 += h3;  h3 = t;
+
+            *W++ += 1.25f * gain * (m * (_x0 + h0) + (1 - m) * s * _x0);
+            *X++ += gain * (m * (_x1 + h1 - 0.05f * (_x2 + h2)) + (1 - m) * s * (_x1 - 0.05f * _x2));
+            *Y++ += gain * (m * (_x2 + h2) + (1 - m) * s * _x2);
+            *Z++ += gain * (m * (_x0 - h0) + (1 - m) * s * _x3);
+
+            _x4 = _delm  [9].process (m * (_x0 - h0));
+            _x5 = _delm [11].process (m * (_x1 - h1));
+            _x6 = _delm [13].process (m * (_x2 - h2));
+            _x7 = _delm [15].process (m * (_x3 - h3));
+            t = (1 - m) * s;
+            _x0 = _delm [1].process (m * (_x0 + h0) + t * _x0);
+            _x1 = _delm [3].process (m * (_x1 + h1) + t * _x1);
+            _x2 = _delm [5].process (m * (_x2 + h2) + t * _x2);
+            _x3 = _delm [7].process (m * (_x3 + h3) + t * _x3);
+        }
+        else
+        {
+            *W++ += 1.25f * gain * s * _x0;
+            *X++ += gain * s * (_x1 - 0.05f * _x2);
+            *Y++ += gain * s * _x2;
+            *Z++ += gain * s * _x3;
+
+            _x0 = _delm [1].process (s * _x0);
+            _x1 = _delm [3].process (s * _x1);
+            _x2 = _delm [5].process (s * _x2);
+            _x3 = _delm [7].process (s * _x3);
+        }
+    }
+    _i = i;
+    _m = m;
+}
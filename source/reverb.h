@@ -30,6 +30,7 @@ private:
 
     void init (int size, float fb);
     void fini (void);
+    void clear (void);
     void set_t60mf (float tmf);
     void set_t60lo (float tlo, float _wlo);
     void set_t60hi (float thi, float chi);
@@ -63,9 +64,15 @@ public:
     void set_t60lo (float tlo, float flo);
     void set_t60hi (float thi, float fhi);
 
+    // In light mode only half of the feedback loops are used.
+    // Changes are crossfaded, it can be switched at any time.
+    void set_light (bool light) { _mt = light ? 0.0f : 1.0f; }
+    bool light (void) const { return _mt < 1.0f; }
+
 private:
 
     void print (void);
+    void process_light (int n, float gain, float *R, float *W, float *X, float *Y, float *Z);
     float  *_line;
     int     _size;
     int     _idel;
@@ -80,6 +87,8 @@ private:
     float   _fhi;
     float   _x0, _x1, _x2, _x3, _x4, _x5, _x6, _x7;
     float   _z;
+    float   _m;
+    float   _mt;
 
     static int   _sizes [16];
     static float _feedb [16];
@@ -19,60 +19,291 @@
 
 
 #include <unistd.h>
+#include <string.h>
 #include "slave.h"
+#include "tracer.h"
+#include "startup.h"
+#include "waveindex.h"
 
 
 void Slave::thr_main (void)
 {
     ITC_mesg *M;
 
-    while (get_event () != EV_EXIT)
+    Tracer::thread ("slave");
+    while (! _exit)
     {
-        M = get_message ();
-        if (! M) continue;
+        // Take all waiting messages first, so that jobs made
+        // stale by later ones are dropped before they start.
+        fetch (_njob == 0);
+        if (_exit) break;
+        M = next ();
+        if (M) proc_mesg (M);
+    }
+    send_event (EV_EXIT, 1);
+}
 
-        switch (M->type ())
-        {
-            case MT_CALC_RANK:
-            {
-                M_def_rank *X = (M_def_rank *) M;
-                send_event (TO_MODEL, new M_ifc_ifelm (MT_IFC_ELATT, X->_group, X->_ifelm));
-                X->_rwave = new Rankwave (X->_synth->_n0, X->_synth->_n1);
-                X->_rwave->gen_waves (X->_synth, X->_fsamp, X->_fbase, X->_scale);
-                send_event (TO_AUDIO, M);
-                break;
-            }
 
-            case MT_LOAD_RANK:
+void Slave::proc_mesg (ITC_mesg *M)
+{
+    int  how;
+
+    switch (M->type ())
+    {
+        case MT_CALC_RANK:
+        case MT_LOAD_RANK:
+        {
+            M_def_rank *X = (M_def_rank *) M;
+            const char *s = (M->type () == MT_LOAD_RANK) ? "load_rank" : "calc_rank";
+            send_event (TO_MODEL, new M_ifc_ifelm (MT_IFC_ELATT, X->_group, X->_ifelm));
+            Tracer::begin (s, X->_ifelm);
+            Startup::begin (s, X->_synth->_filename);
+            if (! find_waves (X, &how))
             {
-                M_def_rank *X = (M_def_rank *) M;
-                send_event (TO_MODEL, new M_ifc_ifelm (MT_IFC_ELATT, X->_group, X->_ifelm));
-                X->_rwave = new Rankwave (X->_synth->_n0, X->_synth->_n1);
-                if (X->_rwave->load (X->_path, X->_synth, X->_fsamp, X->_fbase, X->_scale))
+                // Loaded if asked for and possible, else made.
+                how = Startup::LOADED;
+                if (   (M->type () == MT_CALC_RANK)
+                    || X->_rwave->load (X->_path, X->_synth, X->_fsamp, X->_fbase, X->_scale))
                 {
-                    X->_rwave->gen_waves (X->_synth, X->_fsamp, X->_fbase, X->_scale);
+                    how = make_waves (X) ? Startup::GENERATED : Startup::NONE;
                 }
-                send_event (TO_AUDIO, M);
-                break;
+                if (how != Startup::NONE) X->_rwave->publish ();
             }
-
-            case MT_SAVE_RANK:
+            Startup::end (s, how);
+            Tracer::end (s, X->_ifelm);
+            if (how == Startup::NONE)
             {
-                M_def_rank *X = (M_def_rank *) M;
-                X->_rwave->save (X->_path, X->_synth, X->_fsamp, X->_fbase, X->_scale);
                 M->recover ();
                 break;
             }
+            _perfstats->add_job (1e-6f * (Perfstats::tnow () - X->_time));
+            deliver (X);
+            break;
+        }
 
-            case MT_AUDIO_SYNC:
-                send_event (TO_AUDIO, M);
-                break;
+        case MT_SAVE_RANK:
+        {
+            M_def_rank *X = (M_def_rank *) M;
+            Tracer::begin ("save_rank", X->_ifelm);
+            X->_rwave->save (X->_path, X->_synth, X->_fsamp, X->_fbase, X->_scale);
+            Tracer::end ("save_rank", X->_ifelm);
+            M->recover ();
+            break;
+        }
 
-            default:
-                M->recover ();
+        case MT_DROP_RANK:
+        {
+            // Replace an evicted rank by an empty one. Ranks
+            // made before may be deleted now, so don't share.
+            M_def_rank *X = (M_def_rank *) M;
+            X->_rwave = new Rankwave (0, -1);
+            _nshare = 0;
+            deliver (X);
+            break;
+        }
+
+        case MT_WARM_RANK:
+        {
+            // Any change to the rank is queued after this.
+            M_def_rank *X = (M_def_rank *) M;
+            Tracer::begin ("warm_rank", X->_rank);
+            X->_rwave->touch ();
+            Tracer::end ("warm_rank", X->_rank);
+            M->recover ();
+            break;
+        }
+
+        case MT_AUDIO_SYNC:
+        case MT_NEW_INSTR:
+            // End of a batch of ranks.
+            _nshare = 0;
+            Waveindex::flush ();
+            send_event (TO_AUDIO, M);
+            break;
+
+        default:
+            M->recover ();
+    }
+}
+
+
+void Slave::fetch (bool wait)
+{
+    int        E;
+    ITC_mesg  *M;
+
+    while (_wr - _rd < NJOB)
+    {
+        E = wait ? get_event () : get_event_nowait ();
+        wait = false;
+        if (E == EV_EXIT)
+        {
+            _exit = true;
+            return;
         }
+        if (E == EV_TIME) return;
+        M = get_message ();
+        if (M) queue (M);
     }
-    send_event (EV_EXIT, 1);
+}
+
+
+void Slave::queue (ITC_mesg *M)
+{
+    int          i, t;
+    M_def_rank  *X, *Y;
+
+    // A rank job replaces any waiting job for the same rank,
+    // and stops the one being made. The other messages, and
+    // the MT_AUDIO_SYNC at the end of each batch, are kept.
+    t = M->type ();
+    if ((t == MT_CALC_RANK) || (t == MT_LOAD_RANK) || (t == MT_DROP_RANK))
+    {
+        X = (M_def_rank *) M;
+        for (i = _rd; i < _wr; i++)
+        {
+            Y = (M_def_rank *) _jobs [i % NJOB];
+            if (! (Y && same_rank (X, Y))) continue;
+            if (   (X->type () == Y->type ()) && (X->_synth == Y->_synth) && (X->_fsamp == Y->_fsamp)
+                && (X->_fbase == Y->_fbase) && (X->_scale == Y->_scale)) _perfstats->add_merge ();
+            else _perfstats->add_cancel ();
+            Y->recover ();
+            _jobs [i % NJOB] = 0;
+            _njob--;
+        }
+        if (_curr && same_rank (X, _curr)) _stop = true;
+    }
+    _jobs [_wr++ % NJOB] = M;
+    _njob++;
+    _perfstats->set_jobs (_njob);
+}
+
+
+ITC_mesg *Slave::next (void)
+{
+    ITC_mesg *M;
+
+    while (_rd < _wr)
+    {
+        M = _jobs [_rd++ % NJOB];
+        if (M)
+        {
+            _njob--;
+            _perfstats->set_jobs (_njob);
+            return M;
+        }
+    }
+    return 0;
+}
+
+
+bool Slave::same_rank (M_def_rank *X, M_def_rank *Y)
+{
+    int t = Y->type ();
+
+    return    ((t == MT_CALC_RANK) || (t == MT_LOAD_RANK) || (t == MT_DROP_RANK))
+           && (X->_divis == Y->_divis) && (X->_rank == Y->_rank) && (X->_gen >= Y->_gen)
+           && (X->_target == Y->_target);
+}
+
+
+void Slave::deliver (M_def_rank *X)
+{
+    // Ranks of a new instrument are put in its divisions before
+    // the audio thread uses them, and go back to the Model.
+    if (X->_target)
+    {
+        if (X->_unit >= 0) X->_target->set_unit (X->_rank, X->_rwave, X->_unit, X->_offs);
+        else X->_target->set_rank (X->_rank, X->_rwave, X->_synth->_pan, X->_synth->_del);
+        send_event (TO_MODEL, X);
+    }
+    else send_event (TO_AUDIO, X);
+}
+
+
+bool Slave::cancel (void *arg)
+{
+    Slave *S = (Slave *) arg;
+
+    // Called by gen_waves() between pipes.
+    S->fetch (false);
+    return S->_stop || S->_exit;
+}
+
+
+bool Slave::make_waves (M_def_rank *X)
+{
+    _curr = X;
+    _stop = false;
+    X->_rwave->gen_waves (X->_synth, X->_fsamp, X->_fbase, X->_scale, cancel, this);
+    _curr = 0;
+    if (! (_stop || _exit)) return true;
+
+    // A later job replaces this one. The rank was the last
+    // one offered for sharing, see share_rank().
+    if (_nshare && (_share [_nshare - 1]._rwave == X->_rwave)) _nshare--;
+    delete X->_rwave;
+    X->_rwave = 0;
+    _perfstats->add_abort ();
+    return false;
+}
+
+
+bool Slave::find_waves (M_def_rank *X, int *how)
+{
+    // Makes the Rankwave of X, with waves that exist already if
+    // possible. Returns false if they must be loaded or made.
+    if (X->_unit >= 0)
+    {
+        // Unit extension, uses the pipes of another rank.
+        X->_rwave = new Rankwave (0, -1);
+        *how = Startup::EXTENSION;
+        return true;
+    }
+    X->_rwave = new Rankwave (X->_synth->_n0, X->_synth->_n1);
+    if (X->_share)
+    {
+        // Same waves in the previous instrument.
+        X->_rwave->share (X->_share);
+        *how = Startup::SHARED;
+    }
+    else if (share_rank (X)) *how = Startup::SHARED;
+    else if (! X->_rwave->attach (X->_synth, X->_fsamp, X->_fbase, X->_scale)) *how = Startup::ATTACHED;
+    else return false;
+    return true;
+}
+
+
+bool Slave::share_rank (M_def_rank *X)
+{
+    int        i, n;
+    uint64_t   k;
+    Addsynth   *A, *B;
+
+    // Instruments often use the same stop in several divisions.
+    // Within a batch, the second and later ones share the waves
+    // of the first. Ranks are only deleted after the audio
+    // thread replaced them, which can't happen within a batch.
+    A = X->_synth;
+    n = (const char *)(&A->_h_atp + 1) - (const char *)(&A->_n0);
+    k = Rankwave::key (A, X->_fsamp, X->_fbase, X->_scale);
+    for (i = 0; i < _nshare; i++)
+    {
+        B = _share [i]._synth;
+        if ((_share [i]._key == k) && ! memcmp (&A->_n0, &B->_n0, n))
+        {
+            X->_rwave->share (_share [i]._rwave);
+            return true;
+        }
+    }
+    if (_nshare < NSHARE)
+    {
+        _share [_nshare]._key = k;
+        _share [_nshare]._synth = A;
+        _share [_nshare]._rwave = X->_rwave;
+        _nshare++;
+    }
+    return false;
 }
 
 
@@ -30,14 +30,53 @@ class Slave : public A_thread
 {
 public:
 
-    Slave (void) : A_thread ("Slave") {}
+    Slave (Perfstats *perfstats) :
+        A_thread ("Slave"), _perfstats (perfstats), _nshare (0),
+        _rd (0), _wr (0), _njob (0), _curr (0), _stop (false), _exit (false) {}
     virtual ~Slave (void) {}
 
     void terminate (void) {  put_event (EV_EXIT, 1); }
 
 private:
 
+    friend class SlaveTest;
+
     virtual void thr_main (void);
+
+    void proc_mesg (ITC_mesg *M);
+    void fetch (bool wait);
+    void queue (ITC_mesg *M);
+    ITC_mesg *next (void);
+    bool find_waves (M_def_rank *X, int *how);
+    bool make_waves (M_def_rank *X);
+    bool share_rank (M_def_rank *X);
+    void deliver (M_def_rank *X);
+
+    static bool same_rank (M_def_rank *X, M_def_rank *Y);
+    static bool cancel (void *arg);
+
+    enum { NSHARE = NDIVIS * NRANKS, NJOB = 4 * NDIVIS * NRANKS };
+
+    Perfstats      *_perfstats;
+
+    // Ranks made since the last MT_AUDIO_SYNC.
+    int             _nshare;
+    struct
+    {
+        uint64_t    _key;
+        Addsynth   *_synth;
+        Rankwave   *_rwave;
+    }               _share [NSHARE];
+
+    // Messages received and not yet handled, in order. Dropped
+    // jobs leave a null entry.
+    int             _rd;
+    int             _wr;
+    int             _njob;
+    ITC_mesg       *_jobs [NJOB];
+    M_def_rank     *_curr;    // rank being made
+    bool            _stop;    // a later job replaces it
+    bool            _exit;
 };
 
 
@@ -0,0 +1,275 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <string.h>
+#include "startup.h"
+#include "perfstats.h"
+
+
+Startup::Entry        Startup::_entry [Startup::NENTRY];
+std::atomic<int>      Startup::_nentry (0);
+std::atomic<int>      Startup::_state (Startup::ON);
+int64_t               Startup::_tstart = Perfstats::tnow ();
+int64_t               Startup::_tready = 0;
+const char           *Startup::_path = 0;
+
+
+void Startup::enable (const char *path)
+{
+    // Recording starts with the program, this only
+    // decides if and where the report is written.
+    _path = path;
+}
+
+
+void Startup::begin (const char *name, const char *label)
+{
+    Entry  *E;
+    int     k;
+
+    if (_state.load (std::memory_order_relaxed) != ON) return;
+    k = _nentry.fetch_add (1, std::memory_order_relaxed);
+    if (k >= NENTRY)
+    {
+        _nentry.store (NENTRY, std::memory_order_relaxed);
+        return;
+    }
+    E = _entry + k;
+    if (label) snprintf (E->_label, sizeof (E->_label), "%s", label);
+    else E->_label [0] = 0;
+    E->_how = NONE;
+    E->_t1.store (0, std::memory_order_relaxed);
+    E->_t0 = Perfstats::tnow ();
+    E->_name.store (name, std::memory_order_release);
+}
+
+
+void Startup::end (const char *name, int how)
+{
+    Entry  *E;
+    int     k;
+
+    // Ends the last open entry with this name. Each
+    // name is used by one thread only.
+    if (_state.load (std::memory_order_relaxed) != ON) return;
+    k = _nentry.load (std::memory_order_relaxed);
+    if (k > NENTRY) k = NENTRY;
+    while (k--)
+    {
+        E = _entry + k;
+        if (   (E->_name.load (std::memory_order_acquire) == name)
+            && (E->_t1.load (std::memory_order_relaxed) == 0))
+        {
+            E->_how = how;
+            E->_t1.store (Perfstats::tnow (), std::memory_order_release);
+            return;
+        }
+    }
+}
+
+
+void Startup::ready (void)
+{
+    FILE  *F;
+    int    s = ON;
+    bool   j;
+
+    // Only the first time the instrument becomes ready.
+    if (! _state.compare_exchange_strong (s, DONE)) return;
+    _tready = Perfstats::tnow ();
+    if (! _path) return;
+    if (strcmp (_path, "-"))
+    {
+        F = fopen (_path, "w");
+        if (! F)
+        {
+            fprintf (stderr, "Can't write startup report '%s'.\n", _path);
+            return;
+        }
+        j = strlen (_path) > 5 && ! strcmp (_path + strlen (_path) - 5, ".json");
+    }
+    else
+    {
+        F = stdout;
+        j = false;
+    }
+    if (j) json (F);
+    else summary (F);
+    if (F == stdout) fflush (F);
+    else fclose (F);
+}
+
+
+void Startup::reset (void)
+{
+    int k;
+
+    for (k = 0; k < NENTRY; k++) _entry [k]._name.store (0);
+    _nentry.store (0);
+    _tstart = Perfstats::tnow ();
+    _tready = 0;
+    _state.store (ON);
+}
+
+
+const char *Startup::howname (int how)
+{
+    static const char *names [NHOW] = { "generated", "loaded", "attached", "shared", "extension" };
+
+    return ((how >= 0) && (how < NHOW)) ? names [how] : "";
+}
+
+
+void Startup::summary (FILE *F)
+{
+    Entry    *E;
+    int       i, j, k, n, nrank;
+    int       cnt [NHOW];
+    int64_t   t, t1, tot [NHOW];
+    int       slow [5];
+
+    n = _nentry.load ();
+    if (n > NENTRY) n = NENTRY;
+    fprintf (F, "Startup, ready after %.1lf ms\n", ms (_tready - _tstart));
+    fprintf (F, "  %-24s %10s %10s\n", "phase", "start", "time");
+    for (i = 0; i < n; i++)
+    {
+        E = _entry + i;
+        if (! E->_name.load (std::memory_order_acquire) || (E->_label [0])) continue;
+        t1 = E->_t1.load (std::memory_order_acquire);
+        if (t1) fprintf (F, "  %-24s %10.1lf %10.1lf\n", E->_name.load (), ms (E->_t0 - _tstart), ms (t1 - E->_t0));
+        else    fprintf (F, "  %-24s %10.1lf %10s\n", E->_name.load (), ms (E->_t0 - _tstart), "-");
+    }
+
+    nrank = 0;
+    memset (cnt, 0, sizeof (cnt));
+    memset (tot, 0, sizeof (tot));
+    for (i = 0; i < n; i++)
+    {
+        E = _entry + i;
+        if (! E->_name.load (std::memory_order_acquire) || ! (E->_label [0])) continue;
+        t1 = E->_t1.load (std::memory_order_acquire);
+        if (! t1 || (E->_how < 0)) continue;
+        nrank++;
+        cnt [E->_how]++;
+        tot [E->_how] += t1 - E->_t0;
+    }
+    fprintf (F, "  %d ranks, %d cache hits, %d misses\n", nrank,
+             cnt [LOADED] + cnt [ATTACHED] + cnt [SHARED], cnt [GENERATED]);
+    for (k = 0; k < EXTENSION; k++)
+    {
+        if (cnt [k]) fprintf (F, "    %-10s %5d %10.1lf ms\n", howname (k), cnt [k], ms (tot [k]));
+    }
+
+    // The slowest few ranks.
+    for (j = 0; j < 5; j++)
+    {
+        slow [j] = -1;
+        t = 0;
+        for (i = 0; i < n; i++)
+        {
+            E = _entry + i;
+            if (! E->_name.load (std::memory_order_acquire) || ! (E->_label [0]) || (E->_how < 0)) continue;
+            t1 = E->_t1.load (std::memory_order_acquire);
+            if (! t1 || (t1 - E->_t0 <= t)) continue;
+            for (k = 0; (k < j) && (slow [k] != i); k++);
+            if (k < j) continue;
+            slow [j] = i;
+            t = t1 - E->_t0;
+        }
+        if (slow [j] < 0) break;
+        if (j == 0) fprintf (F, "  slowest\n");
+        E = _entry + slow [j];
+        fprintf (F, "    %-24s %-10s %10.1lf ms\n", E->_label, howname (E->_how), ms (t));
+    }
+    if (_nentry.load () > NENTRY) fprintf (F, "  some entries were not recorded\n");
+}
+
+
+static void jstring (FILE *F, const char *s)
+{
+    fputc ('"', F);
+    for (; *s; s++)
+    {
+        if ((*s == '"') || (*s == '\\')) fprintf (F, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20) fprintf (F, "\\u%04x", *s);
+        else fputc (*s, F);
+    }
+    fputc ('"', F);
+}
+
+
+void Startup::json (FILE *F)
+{
+    Entry    *E;
+    int       i, n, h, m;
+    int64_t   t1;
+    bool      first;
+
+    n = _nentry.load ();
+    if (n > NENTRY) n = NENTRY;
+    fprintf (F, "{\n  \"version\": ");
+    jstring (F, VERSION);
+    fprintf (F, ",\n  \"ready_ms\": %.3lf,\n  \"phases\": [", ms (_tready - _tstart));
+    first = true;
+    for (i = 0; i < n; i++)
+    {
+        E = _entry + i;
+        if (! E->_name.load (std::memory_order_acquire) || (E->_label [0])) continue;
+        t1 = E->_t1.load (std::memory_order_acquire);
+        fprintf (F, "%s\n    { \"name\": ", first ? "" : ",");
+        jstring (F, E->_name.load ());
+        fprintf (F, ", \"start_ms\": %.3lf", ms (E->_t0 - _tstart));
+        if (t1) fprintf (F, ", \"ms\": %.3lf }", ms (t1 - E->_t0));
+        else fprintf (F, ", \"ms\": null }");
+        first = false;
+    }
+    fprintf (F, "\n  ],\n  \"ranks\": [");
+    first = true;
+    h = m = 0;
+    for (i = 0; i < n; i++)
+    {
+        E = _entry + i;
+        if (! E->_name.load (std::memory_order_acquire) || ! (E->_label [0])) continue;
+        t1 = E->_t1.load (std::memory_order_acquire);
+        if (! t1 || (E->_how < 0)) continue;
+        fprintf (F, "%s\n    { \"name\": ", first ? "" : ",");
+        jstring (F, E->_label);
+        fprintf (F, ", \"phase\": ");
+        jstring (F, E->_name.load ());
+        fprintf (F, ", \"start_ms\": %.3lf, \"ms\": %.3lf, \"how\": \"%s\"",
+                 ms (E->_t0 - _tstart), ms (t1 - E->_t0), howname (E->_how));
+        if (E->_how == GENERATED)
+        {
+            fprintf (F, ", \"cache\": \"miss\" }");
+            m++;
+        }
+        else if (E->_how != EXTENSION)
+        {
+            fprintf (F, ", \"cache\": \"hit\" }");
+            h++;
+        }
+        else fprintf (F, " }");
+        first = false;
+    }
+    fprintf (F, "\n  ],\n  \"cache_hits\": %d,\n  \"cache_misses\": %d,\n  \"complete\": %s\n}\n",
+             h, m, (_nentry.load () > NENTRY) ? "false" : "true");
+}
+
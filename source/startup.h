@@ -0,0 +1,88 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __STARTUP_H
+#define __STARTUP_H
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+
+
+// Startup profiler. Records the duration of each startup phase and
+// of making each rank, from program start until the instrument is
+// first ready. The report is then written once, as a text summary
+// or as JSON, and recording stops.
+//
+// Phases are begun and ended by name from the main, model and slave
+// threads, never from the audio thread. Names must be string literals,
+// only the pointer is stored.
+
+
+class Startup
+{
+public:
+
+    enum { ON, DONE };
+    enum { NENTRY = 2048 };
+
+    // How a rank was made. LOADED, ATTACHED and SHARED are cache
+    // hits, GENERATED is a miss. Extensions have no waves of their own.
+    enum { NONE = -1, GENERATED, LOADED, ATTACHED, SHARED, EXTENSION, NHOW };
+
+    static void enable (const char *path);
+    static void begin (const char *name, const char *label = 0);
+    static void end (const char *name, int how = NONE);
+    static void ready (void);
+    static int  state (void) { return _state.load (std::memory_order_relaxed); }
+
+    // Write the report. Used by ready (), and by the tests.
+    static void summary (FILE *F);
+    static void json (FILE *F);
+    static void reset (void);
+
+private:
+
+    class Entry
+    {
+    public:
+
+        std::atomic<const char *>  _name;
+        char                       _label [32];
+        int64_t                    _t0;
+        std::atomic<int64_t>       _t1;
+        int                        _how;
+    };
+
+    static double ms (int64_t t) { return 1e-6 * t; }
+    static const char *howname (int how);
+
+    static Entry                  _entry [NENTRY];
+    static std::atomic<int>       _nentry;
+    static std::atomic<int>       _state;
+    static int64_t                _tstart;
+    static int64_t                _tready;
+    static const char            *_path;
+};
+
+
+#endif
+
@@ -24,6 +24,8 @@
 #include <readline/readline.h>
 #include <readline/history.h>
 #include "tiface.h"
+#include "capture.h"
+#include "tracer.h"
 
 
 
@@ -168,6 +170,10 @@ void Tiface::handle_mesg (ITC_mesg *M)
     case MT_IFC_PRRCL:
         break;
 
+    case MT_IFC_CAPTURE:
+        handle_ifc_capture ((M_ifc_capture *) M);
+        break;
+
     default:
         printf ("Received message of unknown type %5ld\n", M->type ());
     }
@@ -252,6 +258,14 @@ void Tiface::handle_ifc_txtip (M_ifc_txtip *M)
 }
 
 
+void Tiface::handle_ifc_capture (M_ifc_capture *M)
+{
+    if (M->_stat < 0) printf ("Can't start capture to '%s'\n", M->_path);
+    else if (M->_stat) printf ("Capturing %s to '%s'\n", M->_stems ? "stems" : "output", M->_path);
+    else printf ("Capture to '%s' stopped\n", M->_path);
+}
+
+
 void Tiface::print_info (void)
 {
     printf ("Application id:  %s\n", _initdata->_appid);
@@ -419,13 +433,33 @@ void Tiface::parse_command (const char *p)
         command_s (p);
         break;
 
+    case 'L':
+    case 'l':
+        command_l (p);
+        break;
+
+    case 'T':
+    case 't':
+        command_t (p);
+        break;
+
     case 'Q':
     case 'q':
         fclose (stdin);
         break;
 
+    case 'R':
+    case 'r':
+        command_r (p);
+        break;
+
+    case 'I':
+    case 'i':
+        command_i (p);
+        break;
+
     case '!':
-        send_event (TO_MODEL, new ITC_mesg (MT_IFC_SAVE));
+        send_event (TO_MODEL, new M_pooled (MT_IFC_SAVE));
         break;
 
     default:
@@ -490,6 +524,175 @@ void Tiface::command_s (const char *p)
 }
 
 
+void Tiface::command_l (const char *p)
+{
+    char s [64];
+
+    if (! _initdata->_perfstats)
+    {
+        printf ("No DSP statistics available\n");
+        return;
+    }
+    if (sscanf (p, "%s", s) != 1)
+    {
+        print_perfstats ();
+        return;
+    }
+    if (! strcmp (s, "0"))
+    {
+        _initdata->_perfstats->reset ();
+        printf ("DSP statistics cleared\n");
+        return;
+    }
+    printf ("Expected nothing or 0\n");
+}
+
+
+void Tiface::command_t (const char *p)
+{
+    char s [1024];
+    char f [1024];
+    int  n;
+
+    n = sscanf (p, "%1023s %1023s", s, f);
+    if (n < 1)
+    {
+        n = Tracer::state ();
+        printf ("Tracing is %s%s\n", (n == Tracer::OFF) ? "off" : ((n == Tracer::ON) ? "on" : "frozen"),
+                Tracer::autodump () ? ", dump on xrun" : "");
+        return;
+    }
+    if (! strcmp (s, "on"))
+    {
+        Tracer::enable (true, true);
+        return;
+    }
+    if (! strcmp (s, "off"))
+    {
+        Tracer::enable (false, false);
+        return;
+    }
+    if (! strcmp (s, "dump"))
+    {
+        if (Tracer::dump ((n > 1) ? f : 0, s)) printf ("Can't write trace file '%s'\n", s);
+        else printf ("Trace written to '%s'\n", s);
+        return;
+    }
+    printf ("Expected nothing, on, off or dump [file]\n");
+}
+
+
+void Tiface::command_r (const char *p)
+{
+    char      s [1024];
+    char      f [1024];
+    int       n;
+    Capture  *C;
+
+    if (! (C = _initdata->_capture))
+    {
+        printf ("Capture is not available\n");
+        return;
+    }
+    n = sscanf (p, "%1023s %1023s", s, f);
+    if (n < 1)
+    {
+        n = C->state ();
+        if (n == Capture::IDLE) printf ("Capture is off\n");
+        else printf ("Capture %s to '%s', %.1lf s, %u overruns%s\n",
+                     C->stems () ? "stems" : "output", C->path (), C->seconds (), C->overruns (),
+                     (n == Capture::STOP) ? ", stopping" : "");
+        return;
+    }
+    if (! strcmp (s, "on") || ! strcmp (s, "stems"))
+    {
+        send_event (TO_MODEL, new M_ifc_capture (1, s [0] == 's', (n > 1) ? f : 0));
+        return;
+    }
+    if (! strcmp (s, "off"))
+    {
+        send_event (TO_MODEL, new M_ifc_capture (0, false, 0));
+        return;
+    }
+    printf ("Expected nothing, on [file], stems [file] or off\n");
+}
+
+
+void Tiface::command_i (const char *p)
+{
+    char s [1024];
+
+    if (sscanf (p, "%1023s", s) != 1)
+    {
+        printf ("Instrument:      %s\n", _initdata->_instrdir);
+        return;
+    }
+    if (! strcmp (s, "="))
+    {
+        send_event (TO_MODEL, new M_ifc_reload (0));
+        return;
+    }
+    send_event (TO_MODEL, new M_ifc_reload (s));
+}
+
+
+void Tiface::print_perfstats (void)
+{
+    int        i;
+    float      t;
+    Perfinfo   I;
+    Perfstats  *P;
+
+    P = _initdata->_perfstats;
+    t = P->period ();
+    P->get_info (Perfstats::CYCLE, &I);
+    printf ("DSP load, period %1.0lf us, %u cycles\n", t, I._count);
+    printf ("  stage        min      avg      p50      p95      p99      max   (us)\n");
+    for (i = 0; i < Perfstats::NSTAGE; i++)
+    {
+        P->get_info (i, &I);
+        printf ("  %-7s %8.1lf %8.1lf %8.1lf %8.1lf %8.1lf %8.1lf\n",
+                Perfstats::stage_name (i), I._min, I._avg, I._p50, I._p95, I._p99, I._max);
+    }
+    P->get_info (Perfstats::CYCLE, &I);
+    printf ("  load    %7.1lf%% %7.1lf%% %7.1lf%% %7.1lf%% %7.1lf%% %7.1lf%%\n",
+            100 * I._min / t, 100 * I._avg / t, 100 * I._p50 / t,
+            100 * I._p95 / t, 100 * I._p99 / t, 100 * I._max / t);
+    printf ("  xruns %u, overruns %u\n", P->xruns (), P->overruns ());
+    printf ("  voices %u, culled %u\n", P->voices (), P->culls ());
+    printf ("  quality %u, changes %u\n", P->quality (), P->qchanges ());
+    printf ("  waves %1.1lf MB, %u ranks resident, %u evicted\n",
+            P->wavebytes () / 1048576.0, P->resident (), P->evicted ());
+    if (P->prewarm_hits () + P->prewarm_misses ())
+    {
+        printf ("  presets found %u ranks ready, %u not ready\n",
+                P->prewarm_hits (), P->prewarm_misses ());
+    }
+    if (P->reloads ())
+    {
+        printf ("  %u reloads, last %1.0lf ms, max %1.0lf ms\n",
+                P->reloads (), P->reload_last (), P->reload_max ());
+    }
+    printf ("  ranks made %u, last %1.0lf ms, max %1.0lf ms, %u queued\n",
+            P->jobs_done (), P->job_last (), P->job_max (), P->jobs_queued ());
+    if (P->jobs_cancelled () + P->jobs_merged () + P->jobs_aborted ())
+    {
+        printf ("  rank jobs dropped %u, merged %u, stopped %u\n",
+                P->jobs_cancelled (), P->jobs_merged (), P->jobs_aborted ());
+    }
+    if (P->ctl_merged ())
+    {
+        printf ("  swell and tremulant events merged %u\n", P->ctl_merged ());
+    }
+    if (P->midi_reads ())
+    {
+        printf ("  midi input %u events, %1.1lf per read, %1.1lf wakeups/s\n",
+                P->midi_events (), (double) P->midi_events () / P->midi_reads (), P->midi_wakerate ());
+    }
+    printf ("  messages %u in use, %u from the heap\n", Mesgpool::inuse (), Mesgpool::misses ());
+}
+
+
 int Tiface::find_group (const char *p)
 {
     int g;
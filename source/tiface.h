@@ -64,6 +64,7 @@ private:
     void handle_ifc_elset (M_ifc_ifelm *);
     void handle_ifc_elatt (M_ifc_ifelm *);
     void handle_ifc_txtip (M_ifc_txtip *);
+    void handle_ifc_capture (M_ifc_capture *);
     void print_info (void);
     void print_midimap (void);
     void print_keybdd (void);
@@ -71,9 +72,14 @@ private:
     void print_asectd (void);
     void print_stops_short (int);
     void print_stops_long (int);
+    void print_perfstats (void);
     void rewrite_label (const char *);
     void parse_command (const char *);
     void command_s (const char *);
+    void command_l (const char *);
+    void command_t (const char *);
+    void command_r (const char *);
+    void command_i (const char *);
     int  find_group (const char *);
     int  find_ifelm (const char *, int);
     int  comm1 (const char *);
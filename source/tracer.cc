@@ -0,0 +1,195 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "tracer.h"
+
+
+std::atomic<Tracer::Ring *> Tracer::_ring (0);
+const char               *Tracer::_name [Tracer::NRING];
+std::atomic<int>          Tracer::_nring (0);
+std::atomic<int>          Tracer::_state (Tracer::OFF);
+std::atomic<bool>         Tracer::_pending (false);
+std::atomic<bool>         Tracer::_autodump (false);
+thread_local bool         Tracer::_none = false;
+int                       Tracer::_ndump = 0;
+thread_local int          Tracer::_this = -1;
+
+static pthread_mutex_t dump_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+int Tracer::index (void)
+{
+    int k;
+
+    // Claim a ring for the calling thread. If the pool is
+    // exhausted the thread is silently not traced.
+    if ((_this >= 0) || _none) return _this;
+    k = _nring.fetch_add (1, std::memory_order_relaxed);
+    if (k >= NRING)
+    {
+        _nring.store (NRING, std::memory_order_relaxed);
+        _none = true;
+        return -1;
+    }
+    _this = k;
+    return _this;
+}
+
+
+void Tracer::record (const char *name, int arg, char type)
+{
+    Ring     *R;
+    Event    *E;
+    uint64_t  k;
+    int       i;
+
+    i = index ();
+    R = _ring.load (std::memory_order_acquire);
+    if ((i < 0) || ! R) return;
+    R += i;
+    k = R->_wr.load (std::memory_order_relaxed);
+    E = R->_event + (k & (NEVENT - 1));
+    E->_time = Perfstats::tnow ();
+    E->_name = name;
+    E->_arg  = arg;
+    E->_type = type;
+    R->_wr.store (k + 1, std::memory_order_release);
+}
+
+
+void Tracer::thread (const char *name)
+{
+    int i;
+
+    i = index ();
+    if (i >= 0) _name [i] = name;
+}
+
+
+void Tracer::trigger (void)
+{
+    int s = ON;
+
+    // Called on an xrun. Stop recording so the events leading
+    // up to it are preserved, and ask for a dump.
+    if (! _autodump.load (std::memory_order_relaxed)) return;
+    if (_state.compare_exchange_strong (s, FROZEN)) _pending.store (true);
+}
+
+
+void Tracer::enable (bool on, bool autodump)
+{
+    Ring *R;
+
+    if (on && ! _ring.load ())
+    {
+        // Allocated only when tracing is wanted, so mlockall ()
+        // doesn't lock the rings otherwise.
+        R = new Ring [NRING];
+        for (int i = 0; i < NRING; i++) R [i]._wr.store (0, std::memory_order_relaxed);
+        _ring.store (R, std::memory_order_release);
+    }
+    _autodump.store (autodump);
+    _state.store (on ? ON : OFF);
+    _pending.store (false);
+}
+
+
+int Tracer::dump (const char *path, char *name)
+{
+    FILE      *F;
+    Ring      *R, *R0;
+    Event     *E;
+    char       s [1024];
+    int        i, n, d, s0;
+    uint64_t   j, j0, j1;
+    int64_t    t0;
+    bool       first;
+
+    pthread_mutex_lock (&dump_mutex);
+    if (! path)
+    {
+        snprintf (s, 1024, "/tmp/aeolus-trace-%d-%d.json", getpid (), ++_ndump);
+        path = s;
+    }
+    if (name) snprintf (name, 1024, "%s", path);
+    F = fopen (path, "w");
+    if (! F)
+    {
+        _pending.store (false);
+        pthread_mutex_unlock (&dump_mutex);
+        return 1;
+    }
+
+    // Recording is suspended while the rings are read. Any write that
+    // was already in progress goes to the slot just after the newest
+    // event, which is the oldest one in a full ring and is skipped.
+    s0 = _state.exchange (FROZEN);
+    n = _nring.load ();
+    if (n > NRING) n = NRING;
+    R0 = _ring.load (std::memory_order_acquire);
+    if (! R0) n = 0;
+
+    t0 = INT64_MAX;
+    for (i = 0; i < n; i++)
+    {
+        R = R0 + i;
+        j1 = R->_wr.load (std::memory_order_acquire);
+        j0 = (j1 > NEVENT - 1) ? j1 - (NEVENT - 1) : 0;
+        if ((j1 > j0) && (R->_event [j0 & (NEVENT - 1)]._time < t0)) t0 = R->_event [j0 & (NEVENT - 1)]._time;
+    }
+
+    fprintf (F, "{\"traceEvents\":[\n");
+    first = true;
+    for (i = 0; i < n; i++)
+    {
+        R = R0 + i;
+        fprintf (F, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                 first ? "" : ",\n", getpid (), i + 1, _name [i] ? _name [i] : "thread");
+        first = false;
+        j1 = R->_wr.load (std::memory_order_acquire);
+        j0 = (j1 > NEVENT - 1) ? j1 - (NEVENT - 1) : 0;
+        d = 0;
+        for (j = j0; j < j1; j++)
+        {
+            E = R->_event + (j & (NEVENT - 1));
+            // Skip end events whose begin was overwritten.
+            if (E->_type == 'B') d++;
+            else if (d > 0) d--;
+            else continue;
+            fprintf (F, ",\n{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3lf",
+                     E->_type, E->_name, getpid (), i + 1, 1e-3 * (E->_time - t0));
+            if (E->_arg >= 0) fprintf (F, ",\"args\":{\"arg\":%d}", E->_arg);
+            fprintf (F, "}");
+        }
+    }
+    fprintf (F, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    fclose (F);
+
+    // Resume recording, also after an xrun triggered the dump.
+    _state.store ((s0 == OFF) ? OFF : ON);
+    _pending.store (false);
+    pthread_mutex_unlock (&dump_mutex);
+    return 0;
+}
+
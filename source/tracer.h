@@ -0,0 +1,97 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __TRACER_H
+#define __TRACER_H
+
+
+#include <stdint.h>
+#include <atomic>
+#include "perfstats.h"
+
+
+// Event tracer. Each thread records begin/end events into its own
+// ring buffer, so recording is wait-free and safe in the audio thread.
+// Each thread claims a ring index on first use. The pool of rings is
+// allocated by the first enable (true), so it takes no memory unless
+// tracing is used, and is never freed. The rings can be written to a file in the Chrome trace
+// event format, which can be loaded into chrome://tracing or Perfetto.
+//
+// Event names must be string literals or otherwise remain valid for
+// the lifetime of the program, only the pointer is stored.
+
+
+class Tracer
+{
+public:
+
+    enum { OFF, ON, FROZEN };
+    enum { NRING = 16, NEVENT = 16384 };
+
+    // Any thread, wait-free.
+    static void begin (const char *name, int arg = -1) { if (_state.load (std::memory_order_relaxed) == ON) record (name, arg, 'B'); }
+    static void end (const char *name, int arg = -1) { if (_state.load (std::memory_order_relaxed) == ON) record (name, arg, 'E'); }
+    static void thread (const char *name);
+    static void trigger (void);
+
+    // Non-RT threads only.
+    static void enable (bool on, bool autodump);
+    static int  state (void) { return _state.load (std::memory_order_relaxed); }
+    static bool autodump (void) { return _autodump.load (std::memory_order_relaxed); }
+    static bool pending (void) { return _pending.load (std::memory_order_relaxed); }
+    static int  dump (const char *path, char *name = 0);
+
+private:
+
+    class Event
+    {
+    public:
+
+        int64_t      _time;
+        const char  *_name;
+        int32_t      _arg;
+        char         _type;
+    };
+
+    class Ring
+    {
+    public:
+
+        std::atomic<uint64_t>   _wr;
+        Event                   _event [NEVENT];
+    };
+
+    static int  index (void);
+    static void record (const char *name, int arg, char type);
+
+    static std::atomic<Ring *>    _ring;
+    static const char            *_name [NRING];
+    static std::atomic<int>       _nring;
+    static std::atomic<int>       _state;
+    static std::atomic<bool>      _pending;
+    static std::atomic<bool>      _autodump;
+    static thread_local bool      _none;
+    static int                    _ndump;
+    static thread_local int       _this;
+};
+
+
+#endif
+
@@ -0,0 +1,286 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "waveindex.h"
+
+
+// The index file is in native byte order, like the wave files.
+
+struct Indexhead
+{
+    char      _magic [8];
+    uint32_t  _vers;
+    uint32_t  _esize;
+    int32_t   _nentry;
+};
+
+
+Waveindex::Entry  *Waveindex::_entry = 0;
+bool              *Waveindex::_known = 0;
+int                Waveindex::_nentry = 0;
+int                Waveindex::_size = 0;
+bool               Waveindex::_dirty = false;
+bool               Waveindex::_valid = false;
+char               Waveindex::_path [1024] = "";
+
+static pthread_mutex_t index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void file_time (const struct stat *S, int64_t *mtime, int64_t *size)
+{
+#ifdef __APPLE__
+    *mtime = (int64_t) S->st_mtimespec.tv_sec * 1000000000 + S->st_mtimespec.tv_nsec;
+#else
+    *mtime = (int64_t) S->st_mtim.tv_sec * 1000000000 + S->st_mtim.tv_nsec;
+#endif
+    *size = (int64_t) S->st_size;
+}
+
+
+Waveindex::Entry *Waveindex::lookup (const char *name)
+{
+    int i;
+
+    for (i = 0; i < _nentry; i++)
+    {
+        if (! strcmp (_entry [i]._name, name)) return _entry + i;
+    }
+    return 0;
+}
+
+
+Waveindex::Entry *Waveindex::insert (const char *name)
+{
+    int     n;
+    Entry  *E;
+    bool   *K;
+
+    // Names that don't fit are not indexed.
+    if (strlen (name) >= sizeof (E->_name)) return 0;
+    if (_nentry == _size)
+    {
+        n = _size ? 2 * _size : 256;
+        E = new Entry [n];
+        K = new bool [n];
+        if (_nentry)
+        {
+            memcpy (E, _entry, _nentry * sizeof (Entry));
+            memcpy (K, _known, _nentry * sizeof (bool));
+        }
+        delete[] _entry;
+        delete[] _known;
+        _entry = E;
+        _known = K;
+        _size = n;
+    }
+    E = _entry + _nentry;
+    memset (E, 0, sizeof (Entry));
+    strcpy (E->_name, name);
+    _known [_nentry++] = false;
+    return E;
+}
+
+
+void Waveindex::scan (const char *path)
+{
+    int             fd, i;
+    char            name [1200];
+    DIR            *D;
+    struct dirent  *d;
+    size_t          n;
+    Indexhead       H;
+    Entry           X, *E;
+
+    if (_valid && ! strcmp (path, _path)) return;
+    if (_dirty) write ();
+    _nentry = 0;
+    _dirty = false;
+    _valid = true;
+    snprintf (_path, sizeof (_path), "%s", path);
+
+    // One directory listing tells which files exist.
+    if ((D = opendir (path)))
+    {
+        while ((d = readdir (D)))
+        {
+            n = strlen (d->d_name);
+            if ((n < 5) || strcmp (d->d_name + n - 4, ".ae1")) continue;
+            insert (d->d_name);
+        }
+        closedir (D);
+    }
+
+    // Then the index gives the parameters of those it knows.
+    snprintf (name, sizeof (name), "%s/waves.index", path);
+    if ((fd = open (name, O_RDONLY)) < 0) return;
+    if (   (read (fd, &H, sizeof (H)) == sizeof (H))
+        && ! memcmp (H._magic, "ae-wind", 8) && (H._vers == 1) && (H._esize == sizeof (Entry)))
+    {
+        for (i = 0; (i < H._nentry) && (read (fd, &X, sizeof (X)) == sizeof (X)); i++)
+        {
+            X._name [sizeof (X._name) - 1] = 0;
+            E = lookup (X._name);
+            if (! E) continue;
+            *E = X;
+            _known [E - _entry] = true;
+        }
+    }
+    close (fd);
+}
+
+
+void Waveindex::write (void)
+{
+    int        i, n;
+    char       name [1200];
+    char       temp [1200];
+    FILE      *F;
+    Indexhead  H;
+
+    _dirty = false;
+    snprintf (name, sizeof (name), "%s/waves.index", _path);
+    snprintf (temp, sizeof (temp), "%s/waves.index.tmp", _path);
+    if (! (F = fopen (temp, "wb"))) return;
+    for (i = n = 0; i < _nentry; i++) if (_known [i]) n++;
+    memset (&H, 0, sizeof (H));
+    memcpy (H._magic, "ae-wind", 8);
+    H._vers = 1;
+    H._esize = sizeof (Entry);
+    H._nentry = n;
+    fwrite (&H, sizeof (H), 1, F);
+    for (i = 0; i < _nentry; i++)
+    {
+        if (_known [i]) fwrite (_entry + i, sizeof (Entry), 1, F);
+    }
+    // Replace the old index only by a complete one.
+    if (fclose (F) || rename (temp, name))
+    {
+        fprintf (stderr, "Can't write wave index '%s'\n", name);
+        unlink (temp);
+    }
+}
+
+
+int Waveindex::find (const char *path, const char *name, Entry *E)
+{
+    Entry       *X;
+    int          r;
+    char         s [1200];
+    struct stat  S;
+
+    pthread_mutex_lock (&index_mutex);
+    scan (path);
+    X = lookup (name);
+    if (! X)
+    {
+        // Made after the listing, or a name that is not indexed.
+        snprintf (s, sizeof (s), "%s/%s", path, name);
+        if (stat (s, &S)) r = MISSING;
+        else
+        {
+            insert (name);
+            r = UNKNOWN;
+        }
+    }
+    else if (! _known [X - _entry]) r = UNKNOWN;
+    else
+    {
+        *E = *X;
+        r = KNOWN;
+    }
+    pthread_mutex_unlock (&index_mutex);
+    return r;
+}
+
+
+bool Waveindex::current (int fd, const Entry *E)
+{
+    int64_t      t, n;
+    struct stat  S;
+
+    if (fstat (fd, &S)) return false;
+    file_time (&S, &t, &n);
+    return (t == E->_mtime) && (n == E->_size);
+}
+
+
+bool Waveindex::current (const char *path, const Entry *E)
+{
+    int64_t      t, n;
+    char         s [1200];
+    struct stat  S;
+
+    snprintf (s, sizeof (s), "%s/%s", path, E->_name);
+    if (stat (s, &S)) return false;
+    file_time (&S, &t, &n);
+    return (t == E->_mtime) && (n == E->_size);
+}
+
+
+void Waveindex::update (const char *path, const char *name, int fd, const Entry *E)
+{
+    Entry       *X;
+    struct stat  S;
+
+    pthread_mutex_lock (&index_mutex);
+    scan (path);
+    X = lookup (name);
+    if (! X) X = insert (name);
+    if (X)
+    {
+        *X = *E;
+        strcpy (X->_name, name);
+        if (! fstat (fd, &S)) file_time (&S, &X->_mtime, &X->_size);
+        _known [X - _entry] = true;
+        _dirty = true;
+    }
+    pthread_mutex_unlock (&index_mutex);
+}
+
+
+void Waveindex::flush (void)
+{
+    pthread_mutex_lock (&index_mutex);
+    if (_dirty) write ();
+    pthread_mutex_unlock (&index_mutex);
+}
+
+
+void Waveindex::reset (void)
+{
+    pthread_mutex_lock (&index_mutex);
+    if (_dirty) write ();
+    delete[] _entry;
+    delete[] _known;
+    _entry = 0;
+    _known = 0;
+    _nentry = 0;
+    _size = 0;
+    _valid = false;
+    pthread_mutex_unlock (&index_mutex);
+}
+
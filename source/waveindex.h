@@ -0,0 +1,96 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __WAVEINDEX_H
+#define __WAVEINDEX_H
+
+
+#include <stdint.h>
+
+
+// Index of the wave files in a waves directory, kept in the file
+// 'waves.index' in that directory. It holds the parameters from the
+// header of each .ae1 file, so that Rankwave::load() can tell from
+// memory if a file is missing or made for other parameters, and only
+// opens the files it will use. An entry is trusted only while the
+// file has the same size and time, the files themselves remain the
+// reference. Names that don't fit in an entry are not indexed, those
+// files are always read.
+//
+// One directory is indexed at a time, and listed once. A file not in
+// the listing is looked for again, as other processes may have made
+// it since. Used by the Slave thread, the functions are serialised so
+// tests and tools can use them as well.
+
+
+class Waveindex
+{
+public:
+
+    enum { MISSING, UNKNOWN, KNOWN };
+
+    class Entry
+    {
+    public:
+
+        char      _name [64];   // file name in the directory
+        int64_t   _mtime;
+        int64_t   _size;
+        int32_t   _offs;        // start of the pipe data
+        int32_t   _n0;
+        int32_t   _n1;
+        float     _fsamp;
+        float     _fbase;
+        float     _scale [12];
+    };
+
+    // Returns MISSING if the file does not exist, UNKNOWN if it exists
+    // but its parameters are not known, or KNOWN and its entry.
+    static int  find (const char *path, const char *name, Entry *E);
+    // True if the open file fd is the one described by E.
+    static bool current (int fd, const Entry *E);
+    // The same for the file of E in the directory path.
+    static bool current (const char *path, const Entry *E);
+    // Records the parameters E of the open file fd, with the given name.
+    static void update (const char *path, const char *name, int fd, const Entry *E);
+    // Writes the index if it was changed.
+    static void flush (void);
+    // Forgets the index, it is read again when next used.
+    static void reset (void);
+
+private:
+
+    static void   scan (const char *path);
+    static Entry *lookup (const char *name);
+    static Entry *insert (const char *name);
+    static void   write (void);
+
+    static Entry   *_entry;
+    static bool    *_known;
+    static int      _nentry;
+    static int      _size;
+    static bool     _dirty;
+    static bool     _valid;
+    static char     _path [1024];
+};
+
+
+#endif
+
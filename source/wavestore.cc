@@ -0,0 +1,252 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include "wavestore.h"
+
+
+// The first page of a segment holds the header, the data follows.
+// Only the header is mapped writable by processes that attach.
+
+struct Wavestore::Head
+{
+    uint32_t              _magic;
+    std::atomic<int32_t>  _ready;   // 0 while filled, 1 ready, -1 abandoned
+    std::atomic<int32_t>  _refs;
+    int32_t               _pid;     // creator
+    uint64_t              _size;    // data size
+};
+
+static_assert (std::atomic<int32_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+
+bool Wavestore::_enabled = false;
+
+
+Wavestore::Wavestore (void) :
+    _state (NONE),
+    _fd (-1),
+    _head (0),
+    _data (0),
+    _size (0),
+    _page (0)
+{
+    _name [0] = 0;
+}
+
+
+Wavestore::~Wavestore (void)
+{
+    release ();
+}
+
+
+uint64_t Wavestore::hash (uint64_t h, const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t *) data;
+
+    while (size--)
+    {
+        h ^= *p++;
+        h *= 0x100000001B3ULL;
+    }
+    return h;
+}
+
+
+int Wavestore::acquire (uint64_t key)
+{
+    int  i, fd, r;
+
+    release ();
+    if (! _enabled) return NONE;
+    snprintf (_name, 32, "/aeolus-%016llx", (unsigned long long) key);
+    _page = sysconf (_SC_PAGESIZE);
+
+    for (i = 0; i < 100; i++)
+    {
+        fd = shm_open (_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0)
+        {
+            // We are the first, the caller has to fill the segment.
+            _fd = fd;
+            if (   ftruncate (fd, _page)
+                || ((_head = (Head *) mmap (0, _page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED))
+            {
+                _head = 0;
+                abort ();
+                return NONE;
+            }
+            _head->_magic = MAGIC;
+            _head->_pid = getpid ();
+            _head->_size = 0;
+            _head->_refs.store (1);
+            _head->_ready.store (0, std::memory_order_release);
+            return _state = CREATED;
+        }
+        if (errno != EEXIST) return NONE;
+        fd = shm_open (_name, O_RDWR, 0);
+        if (fd < 0)
+        {
+            // Removed in the mean time, try again.
+            if (errno == ENOENT) continue;
+            return NONE;
+        }
+        r = attach (fd);
+        close (fd);
+        if (r >= 0) return r;
+        usleep (10000);
+    }
+    return NONE;
+}
+
+
+int Wavestore::attach (int fd)
+{
+    int          i, r;
+    struct stat  S;
+
+    // Wait until the creator has filled the segment.
+    for (i = 0; ; i++)
+    {
+        if (fstat (fd, &S)) return NONE;
+        if (! _head && (S.st_size >= (off_t) _page))
+        {
+            _head = (Head *) mmap (0, _page, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (_head == MAP_FAILED)
+            {
+                _head = 0;
+                return NONE;
+            }
+        }
+        if (_head && (_head->_magic == MAGIC))
+        {
+            r = _head->_ready.load (std::memory_order_acquire);
+            if (r == 1) break;
+            if ((r < 0) || (kill (_head->_pid, 0) && (errno == ESRCH)))
+            {
+                // Abandoned, or the creator died.
+                shm_unlink (_name);
+                munmap (_head, _page);
+                _head = 0;
+                return -1;
+            }
+        }
+        if (i == 100 * WAIT)
+        {
+            fprintf (stderr, "Timeout waiting for shared rank '%s'\n", _name);
+            if (_head) munmap (_head, _page);
+            _head = 0;
+            return NONE;
+        }
+        usleep (10000);
+    }
+
+    // Take a reference, unless the last user is removing it.
+    r = _head->_refs.load ();
+    while ((r > 0) && ! _head->_refs.compare_exchange_weak (r, r + 1));
+    if (r <= 0)
+    {
+        munmap (_head, _page);
+        _head = 0;
+        return -1;
+    }
+    _size = _head->_size;
+    _data = mmap (0, _size, PROT_READ, MAP_SHARED, fd, _page);
+    if (_data == MAP_FAILED)
+    {
+        _data = 0;
+        _state = ATTACHED;
+        release ();
+        return NONE;
+    }
+    return _state = ATTACHED;
+}
+
+
+void *Wavestore::create (size_t size)
+{
+    if (_state != CREATED) return 0;
+    if (   ftruncate (_fd, _page + size)
+        || ((_data = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, _page)) == MAP_FAILED))
+    {
+        _data = 0;
+        abort ();
+        return 0;
+    }
+    _size = size;
+    _head->_size = size;
+    return _data;
+}
+
+
+void Wavestore::commit (void)
+{
+    if (_state != CREATED) return;
+    mprotect (_data, _size, PROT_READ);
+    _head->_ready.store (1, std::memory_order_release);
+    close (_fd);
+    _fd = -1;
+    _state = ATTACHED;
+}
+
+
+void Wavestore::abort (void)
+{
+    // Let any waiting processes make their own copy.
+    if (_head)
+    {
+        _head->_ready.store (-1, std::memory_order_release);
+        munmap (_head, _page);
+    }
+    shm_unlink (_name);
+    if (_data) munmap (_data, _size);
+    if (_fd >= 0) close (_fd);
+    _fd = -1;
+    _head = 0;
+    _data = 0;
+    _size = 0;
+    _state = NONE;
+}
+
+
+void Wavestore::release (void)
+{
+    if (_state == NONE) return;
+    if (_state == CREATED)
+    {
+        abort ();
+        return;
+    }
+    if (_data) munmap (_data, _size);
+    if (_head->_refs.fetch_sub (1) == 1) shm_unlink (_name);
+    munmap (_head, _page);
+    _head = 0;
+    _data = 0;
+    _size = 0;
+    _state = NONE;
+}
@@ -0,0 +1,89 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __WAVESTORE_H
+#define __WAVESTORE_H
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+// Wavetables shared between Aeolus processes through POSIX shared
+// memory. Each rank is one segment, named by a hash of everything
+// that determines its waves. The first process to need a rank
+// creates the segment and fills it, the others map it read-only.
+// The segment is removed when the last user releases it.
+//
+// A process that dies while holding a segment leaves it behind,
+// it can be removed from /dev/shm by hand.
+
+class Wavestore
+{
+public:
+
+    enum { NONE, ATTACHED, CREATED };
+
+    Wavestore (void);
+    ~Wavestore (void);
+
+    // Returns ATTACHED if the segment exists and has been mapped,
+    // CREATED if this object must fill it using create() and
+    // commit(), or NONE if the store can't be used.
+    int          acquire (uint64_t key);
+    void        *create (size_t size);
+    void         commit (void);
+    void         release (void);
+
+    int          state (void) const { return _state; }
+    const void  *data (void) const { return _data; }
+    size_t       size (void) const { return _size; }
+
+    static void  enable (bool on) { _enabled = on; }
+    static bool  enabled (void) { return _enabled; }
+
+    // FNV-1a, used to build the key.
+    static uint64_t hash (uint64_t h, const void *data, size_t size);
+
+private:
+
+    Wavestore (const Wavestore&);
+    Wavestore& operator=(const Wavestore&);
+
+    struct Head;
+
+    enum { MAGIC = 0x61657732, WAIT = 30 };
+
+    int  attach (int fd);
+    void abort (void);
+
+    int          _state;
+    int          _fd;
+    char         _name [32];
+    Head        *_head;
+    void        *_data;
+    size_t       _size;
+    size_t       _page;
+
+    static bool  _enabled;
+};
+
+
+#endif
@@ -116,6 +116,7 @@ void Xiface::handle_time (void)
     {
         _mainwin->handle_time ();
         _editwin->handle_time ();
+        _audiowin->handle_time ();
     }
     if (_aupar)
     {
@@ -225,11 +226,11 @@ void Xiface::handle_callb (int k, X_window *W, XEvent *E)
         break;
 
     case CB_GLOB_SAVE:
-        send_event (TO_MODEL, new ITC_mesg (MT_IFC_SAVE));
+        send_event (TO_MODEL, new M_pooled (MT_IFC_SAVE));
         break;
 
     case CB_GLOB_MOFF:
-        send_event (TO_MODEL, new ITC_mesg (MT_IFC_ANOFF));
+        send_event (TO_MODEL, new M_pooled (MT_IFC_ANOFF));
         break;
 
     case CB_MAIN_MSG:
@@ -0,0 +1,81 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+
+#ifndef __RANK_FIXTURE_H
+#define __RANK_FIXTURE_H
+
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include "rankwave.h"
+#include "scales.h"
+
+
+// A stop of simple pipes, 48 to 72, with its waves made in memory.
+// Shared by the tests of ranks and of what plays them, suites change
+// the synth in their SetUp() before making ranks.
+class RankFixture : public ::testing::Test {
+protected:
+    void SetUp() override {
+        synth._n0 = 48;
+        synth._n1 = 72;
+        synth._n_att.reset(0.05f);
+        for (int i = 0; i < N_NOTE; i++) synth._h_lev.setv(1, i, -10.0f);
+        Wavestore::enable(false);
+    }
+
+    // Plays into buf, so notes can be started right away.
+    Rankwave *make_rank(float fbase = 440.0f) {
+        Rankwave *R = new Rankwave(synth._n0, synth._n1);
+        R->gen_waves(&synth, 48000.0f, fbase, scales[5]._data);
+        R->set_param(buf, 0, 'C');
+        return R;
+    }
+
+    // Run R for n periods into buf, returns the output energy.
+    float run(Rankwave *R, int n) {
+        float e = 0;
+        for (int k = 0; k < n; k++) {
+            memset(buf, 0, sizeof(buf));
+            R->set_param(buf, 0, 'C');
+            R->play(1);
+            for (float v : buf) e += v * v;
+        }
+        return e;
+    }
+
+    // Run R for n periods into buf, returns the number of pipes
+    // sounding in the last one.
+    int count(Rankwave *R, int n) {
+        int k = 0;
+        while (n--) {
+            memset(buf, 0, sizeof(buf));
+            R->set_param(buf, 0, 'C');
+            k = R->play(1);
+        }
+        return k;
+    }
+
+    Addsynth synth;
+    float    buf[4 * PERIOD];
+};
+
+
+#endif
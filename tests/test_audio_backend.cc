@@ -24,6 +24,7 @@
 #include <array>
 #include "audio_backend.h"
 #include "lfqueue.h"
+#include "messages.h"
 
 using ::testing::_;
 using ::testing::Return;
@@ -46,6 +47,10 @@ public:
     void test_proc_keys2() { proc_keys2(); }
     void test_proc_mesg() { proc_mesg(); }
     void test_proc_midi_during_synth(int frame_time) { proc_midi_during_synth(frame_time); }
+    Division* divis(int i) { return _divisp[i]; }
+    int ndivis() const { return _ndivis; }
+    void set_asect(int i, Asection* A) { _asectp[i] = A; }
+    void set_divis(int i, Division* D) { _divisp[i] = D; _ndivis = i + 1; }
     
     // Helper to add events to queues
     void add_note_event(uint32_t event) { 
@@ -146,4 +151,51 @@ TEST_F(AudioBackendTest, MidiDuringSynth) {
     backend->test_proc_midi_during_synth(0);
     backend->test_proc_midi_during_synth(100);
     backend->test_proc_midi_during_synth(1000);
-}
\ No newline at end of file
+}
+
+TEST_F(AudioBackendTest, NewInstrumentSwapsDivisions) {
+    ITC_ctrl model;
+    ITC_ctrl::connect(backend.get(), TO_MODEL, &model, 0);
+    Asection* A0 = new Asection(48000.0f);
+    Asection* A1 = new Asection(48000.0f);
+    backend->set_asect(0, A0);
+    backend->set_asect(1, A1);
+    Division* D = new Division(A0, 48000.0f);
+    backend->set_divis(0, D);
+
+    M_new_instr* X = new M_new_instr;
+    Division* E0 = new Division(0, 48000.0f);
+    Division* E1 = new Division(0, 48000.0f);
+    X->_ndivis = 2;
+    X->_divisp[0] = E0;
+    X->_divisp[1] = E1;
+    X->_asect[0] = 1;
+    X->_asect[1] = 0;
+    backend->put_event(FM_SLAVE, X);
+    backend->test_proc_mesg();
+
+    // The new divisions play in their sections.
+    EXPECT_EQ(backend->ndivis(), 2);
+    EXPECT_EQ(backend->divis(0), E0);
+    EXPECT_EQ(backend->divis(1), E1);
+    EXPECT_EQ(E0->asect(), A1);
+    EXPECT_EQ(E1->asect(), A0);
+    EXPECT_EQ(D->asect(), A0);
+
+    // The old ones go back to the model.
+    ASSERT_NE(model.get_event_nowait(), EV_TIME);
+    ITC_mesg* M = model.get_message();
+    ASSERT_EQ(M, X);
+    EXPECT_EQ(X->_ndivis, 1);
+    EXPECT_EQ(X->_divisp[0], D);
+    EXPECT_EQ(X->_divisp[1], nullptr);
+
+    X->recover();
+    delete D;
+    delete E0;
+    delete E1;
+    backend->set_divis(0, 0);
+    backend->set_divis(1, 0);
+    delete A0;
+    delete A1;
+}
@@ -0,0 +1,102 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "capture.h"
+
+class CaptureTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        snprintf(path, sizeof(path), "/tmp/aeolus-test-capture-%d.wav", getpid());
+        capture.init(48000, 2, 4);
+        for (int i = 0; i < 64; i++) {
+            L[i] = 0.25f;
+            R[i] = -0.25f;
+        }
+    }
+
+    void TearDown() override {
+        unlink(path);
+    }
+
+    // The writer thread closes the file some time after stop().
+    bool wait_idle() {
+        for (int i = 0; i < 500; i++) {
+            if (capture.state() == Capture::IDLE) return true;
+            usleep(10000);
+        }
+        return false;
+    }
+
+    long file_size() {
+        struct stat s;
+        return stat(path, &s) ? -1 : (long) s.st_size;
+    }
+
+    Capture capture;
+    char path[256];
+    float L[64];
+    float R[64];
+};
+
+TEST_F(CaptureTest, IdleWriteIsIgnored) {
+    float *data[2] = {L, R};
+    capture.write(data, 2, 64);
+    EXPECT_FALSE(capture.active());
+    EXPECT_EQ(capture.overruns(), 0u);
+    EXPECT_EQ(file_size(), -1);
+}
+
+TEST_F(CaptureTest, RecordsOutput) {
+    float *data[2] = {L, R};
+
+    ASSERT_EQ(capture.start(path, false), 0);
+    EXPECT_TRUE(capture.active());
+    EXPECT_NE(capture.start(path, false), 0);   // already running
+    for (int i = 0; i < 100; i++) capture.write(data, 2, 64);
+    capture.stop();
+    EXPECT_FALSE(capture.active());
+    ASSERT_TRUE(wait_idle());
+
+    EXPECT_EQ(capture.overruns(), 0u);
+    EXPECT_DOUBLE_EQ(capture.seconds(), 6400.0 / 48000);
+    EXPECT_EQ(file_size(), 44 + 6400 * 2 * 4);
+}
+
+TEST_F(CaptureTest, StemsHaveTwoChannelsPerSection) {
+    float *data[2] = {L, R};
+
+    ASSERT_EQ(capture.start(path, true), 0);
+    EXPECT_TRUE(capture.stems());
+    // Missing channels are recorded as silence.
+    capture.write(data, 2, 64);
+    capture.stop();
+    ASSERT_TRUE(wait_idle());
+
+    // 8 channels use WAVE_FORMAT_EXTENSIBLE, a 68 byte header.
+    EXPECT_EQ(file_size(), 68 + 64 * 8 * 4);
+}
+
+TEST_F(CaptureTest, RejectsUnknownType) {
+    EXPECT_NE(capture.start("/tmp/aeolus-test-capture.flac", false), 0);
+    EXPECT_EQ(capture.state(), Capture::IDLE);
+}
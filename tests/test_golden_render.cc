@@ -0,0 +1,369 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+// Golden render regression tests. The engine (divisions, audio sections
+// and reverb) is run without an audio device on a small built-in test
+// instrument, with a fixed random seed, and plays scripted sequences.
+// The output is compared to the files in tests/golden.
+//
+// Environment:
+//   AEOLUS_GOLDEN_UPDATE=1   rewrite the golden files from this build
+//   AEOLUS_GOLDEN_EXACT=1    require bit-exact output in all cases
+//
+// An alternative implementation of any DSP stage is checked by rendering
+// with it and comparing against the reference render with compare().
+
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "audio_backend.h"
+#include "addsynth.h"
+#include "midi_processor.h"
+#include "rankwave.h"
+#include "scales.h"
+
+#ifndef GOLDEN_DIR
+#define GOLDEN_DIR "tests/golden"
+#endif
+
+namespace {
+
+constexpr unsigned int FSAMP = 48000;
+constexpr unsigned int FSIZE = 256;
+constexpr uint32_t     SEED  = 12345;
+
+// A scripted event. MIDI events go through MidiProcessor like
+// the MIDI thread does, commands go directly to the comm queue
+// as sent by the model. Events take effect at the start of the
+// block containing their frame, as in the real backends.
+struct Event {
+    int      frame;
+    bool     midi;
+    uint8_t  b0, b1, b2;
+    uint32_t cmd;
+    float    val;
+
+    static Event note_on(int f, int n)  { return {f, true, 0x90, (uint8_t) n, 100, 0, 0}; }
+    static Event note_off(int f, int n) { return {f, true, 0x80, (uint8_t) n, 0, 0, 0}; }
+    static Event stop_on(int f, int d, int r)  { return {f, false, 0, 0, 0, (7u << 24) | (r << 16) | (d << 8) | NKEYBD, 0}; }
+    static Event stop_off(int f, int d, int r) { return {f, false, 0, 0, 0, (6u << 24) | (r << 16) | (d << 8) | NKEYBD, 0}; }
+    static Event trem(int f, int d, bool on)   { return {f, false, 0, 0, 0, (16u << 24) | (d << 8) | (on ? 1 : 0), 0}; }
+    static Event swell(int f, int d, float v)  { return {f, false, 0, 0, 0, (17u << 24) | (d << 8), v}; }
+};
+
+// Tolerance for a comparison. A negative max_ulp disables the ULP
+// check, max_db is the allowed error level relative to the signal.
+struct Tolerance {
+    double max_ulp;
+    double max_db;
+
+    static Tolerance exact() { return {0, -std::numeric_limits<double>::infinity()}; }
+    static Tolerance db(double d) { return {-1, d}; }
+};
+
+struct Difference {
+    double max_ulp;
+    double err_db;
+};
+
+int64_t ordered(float f)
+{
+    int32_t i;
+    memcpy(&i, &f, sizeof(i));
+    return (i < 0) ? (int64_t) INT32_MIN - i : i;
+}
+
+Difference compare(const std::vector<float>& ref, const std::vector<float>& out)
+{
+    Difference D = {0, -std::numeric_limits<double>::infinity()};
+    double     se = 0, sr = 0;
+
+    for (size_t i = 0; i < ref.size(); i++) {
+        double u = fabs((double)(ordered(ref[i]) - ordered(out[i])));
+        if (u > D.max_ulp) D.max_ulp = u;
+        double e = (double) out[i] - ref[i];
+        se += e * e;
+        sr += (double) ref[i] * ref[i];
+    }
+    if (se > 0) D.err_db = 10 * log10(se / ((sr > 0) ? sr : 1e-30));
+    return D;
+}
+
+bool within(const Difference& D, const Tolerance& T)
+{
+    if ((T.max_ulp >= 0) && (D.max_ulp > T.max_ulp)) return false;
+    return D.err_db <= T.max_db;
+}
+
+// The built-in test instrument: stop parameters for a rank.
+struct Stop {
+    int   n0, n1;
+    int   fn, fd;      // pitch ratio
+    int   nharm;       // number of harmonics
+    float slope;       // dB per harmonic
+    float attack;
+    float release;
+    float instab;
+    char  pan;
+    int   del;
+};
+
+const Stop test_stops[] = {
+    { 36, 96, 1, 1, 12, -4.0f, 0.05f, 0.05f, 2.0f, 'C', 0 },  // principal 8
+    { 36, 96, 2, 1,  3, -9.0f, 0.03f, 0.04f, 1.0f, 'L', 10 }, // flute 4
+    { 36, 96, 3, 1,  6, -6.0f, 0.02f, 0.03f, 0.0f, 'R', 20 }, // nazard 2 2/3
+};
+
+// The engine, as an audio backend without a device.
+class GoldenEngine : public AudioBackend
+{
+public:
+    GoldenEngine(bool bform) : AudioBackend("golden", &qnote, &qcomm), qmidi(1024)
+    {
+        _fsamp = FSAMP;
+        _fsize = FSIZE;
+        _bform = bform;
+        _nplay = bform ? 4 : 2;
+        for (int i = 0; i < _nplay; i++) _outbuf[i] = new float[FSIZE];
+        for (int i = 0; i < 16; i++) _midimap[i] = (7 << 12) | i;
+        init_audio();
+    }
+
+    ~GoldenEngine() override
+    {
+        for (int i = 0; i < _nplay; i++) delete[] _outbuf[i];
+        for (int i = 0; i < _ndivis; i++) delete _divisp[i];
+    }
+
+    void start() override {}
+    int relpri() const override { return 0; }
+    void thr_main() override {}
+
+    // As for MT_NEW_DIVIS, division d plays from keyboard d.
+    void add_division(int asect)
+    {
+        Division *D = new Division(_asectp[asect], (float) _fsamp);
+        D->set_div_mask(_ndivis);
+        D->set_swell(1.0f);
+        D->set_tfreq(4.0f);
+        D->set_tmodd(0.3f);
+        _divisp[_ndivis++] = D;
+    }
+
+    void add_rank(int d, int r, const Stop& S)
+    {
+        Addsynth A;
+        A._n0 = S.n0;
+        A._n1 = S.n1;
+        A._fn = S.fn;
+        A._fd = S.fd;
+        A._n_att.reset(S.attack);
+        A._n_dct.reset(S.release);
+        A._n_ins.reset(S.instab);
+        for (int h = 0; h < S.nharm; h++) {
+            for (int i = 0; i < N_NOTE; i++) A._h_lev.setv(h, i, S.slope * h);
+        }
+        ranks.push_back(std::make_unique<Rankwave>(S.n0, S.n1));
+        ranks.back()->gen_waves(&A, (float) _fsamp, 440.0f, scales[5]._data);
+        _divisp[d]->set_rank(r, ranks.back().get(), S.pan, S.del);
+    }
+
+    // Render nframes, returns interleaved output.
+    std::vector<float> render(const std::vector<Event>& events, int nframes)
+    {
+        std::vector<float> out;
+        size_t             e = 0;
+
+        for (int t = 0; t < nframes; t += FSIZE) {
+            while ((e < events.size()) && (events[e].frame < t + (int) FSIZE)) send(events[e++]);
+            proc_queue(_qnote);
+            proc_queue(_qcomm);
+            proc_keys1();
+            proc_keys2();
+            proc_synth(FSIZE);
+            for (unsigned int i = 0; i < FSIZE; i++) {
+                for (int c = 0; c < _nplay; c++) out.push_back(_outbuf[c][i]);
+            }
+        }
+        return out;
+    }
+
+private:
+    void send(const Event& E)
+    {
+        union { uint32_t i; float f; } u;
+
+        if (E.midi) {
+            MidiProcessor::process_midi_event(E.b0, E.b1, E.b2, E.b0 & 15, _midimap, nullptr, &qnote, &qmidi);
+            return;
+        }
+        qcomm.write(0, E.cmd);
+        if ((E.cmd >> 24) == 17) {
+            u.f = E.val;
+            qcomm.write(1, u.i);
+            qcomm.write_commit(2);
+        }
+        else qcomm.write_commit(1);
+    }
+
+    Lfq_u32 qnote{256};
+    Lfq_u32 qcomm{256};
+    Lfq_u8  qmidi;
+    std::vector<std::unique_ptr<Rankwave>> ranks;
+};
+
+std::string golden_path(const char *name)
+{
+    return std::string(GOLDEN_DIR) + "/" + name + ".f32";
+}
+
+bool read_golden(const char *name, std::vector<float> *data)
+{
+    FILE *F = fopen(golden_path(name).c_str(), "rb");
+    if (!F) return false;
+    fseek(F, 0, SEEK_END);
+    long n = ftell(F) / sizeof(float);
+    fseek(F, 0, SEEK_SET);
+    data->resize(n);
+    bool ok = fread(data->data(), sizeof(float), n, F) == (size_t) n;
+    fclose(F);
+    return ok;
+}
+
+bool write_golden(const char *name, const std::vector<float>& data)
+{
+    FILE *F = fopen(golden_path(name).c_str(), "wb");
+    if (!F) return false;
+    bool ok = fwrite(data.data(), sizeof(float), data.size(), F) == data.size();
+    fclose(F);
+    return ok;
+}
+
+}  // namespace
+
+class GoldenRenderTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Rankwave::seed(SEED);
+    }
+
+    // One division on asection 0 with all test stops.
+    std::unique_ptr<GoldenEngine> make_engine(bool bform = false) {
+        auto E = std::make_unique<GoldenEngine>(bform);
+        E->add_division(0);
+        for (size_t r = 0; r < sizeof(test_stops) / sizeof(test_stops[0]); r++) {
+            E->add_rank(0, r, test_stops[r]);
+        }
+        return E;
+    }
+
+    // Compare a render against its golden file, or rewrite it.
+    void check(const char *name, const std::vector<float>& out, Tolerance T) {
+        std::vector<float> ref;
+
+        if (getenv("AEOLUS_GOLDEN_UPDATE")) {
+            ASSERT_TRUE(write_golden(name, out)) << "Can't write " << golden_path(name);
+            return;
+        }
+        if (getenv("AEOLUS_GOLDEN_EXACT")) T = Tolerance::exact();
+        ASSERT_TRUE(read_golden(name, &ref))
+            << "Missing " << golden_path(name) << ", run with AEOLUS_GOLDEN_UPDATE=1";
+        ASSERT_EQ(ref.size(), out.size());
+        Difference D = compare(ref, out);
+        EXPECT_TRUE(within(D, T))
+            << name << ": max " << D.max_ulp << " ulp, error " << D.err_db << " dB";
+    }
+
+    // Different libm versions may round sinf() and powf() differently
+    // when the waves are generated, so allow a very small error.
+    static constexpr double DEFAULT_DB = -100.0;
+};
+
+TEST_F(GoldenRenderTest, ChordAndRelease) {
+    auto E = make_engine();
+    std::vector<Event> ev = {
+        Event::stop_on(0, 0, 0),
+        Event::note_on(0, 48), Event::note_on(0, 60), Event::note_on(0, 64), Event::note_on(0, 67),
+        Event::note_off(12000, 48), Event::note_off(12000, 60),
+        Event::note_off(12000, 64), Event::note_off(12000, 67),
+    };
+    check("chord", E->render(ev, 24000), Tolerance::db(DEFAULT_DB));
+}
+
+TEST_F(GoldenRenderTest, RegistrationAndControllers) {
+    auto E = make_engine();
+    std::vector<Event> ev = {
+        Event::stop_on(0, 0, 0),
+        Event::note_on(0, 53), Event::note_on(0, 72),
+        Event::stop_on(4000, 0, 1),
+        Event::trem(6000, 0, true),
+        Event::stop_on(8000, 0, 2),
+        Event::swell(10000, 0, 0.3f),
+        Event::stop_off(12000, 0, 0),
+        Event::trem(14000, 0, false),
+        Event::note_off(18000, 53), Event::note_off(18000, 72),
+    };
+    check("registration", E->render(ev, 24000), Tolerance::db(DEFAULT_DB));
+}
+
+TEST_F(GoldenRenderTest, BFormatOutput) {
+    auto E = make_engine(true);
+    std::vector<Event> ev = {
+        Event::stop_on(0, 0, 1), Event::stop_on(0, 0, 2),
+        Event::note_on(0, 41), Event::note_on(2000, 77),
+        Event::note_off(9000, 41), Event::note_off(9000, 77),
+    };
+    check("bformat", E->render(ev, 16000), Tolerance::db(DEFAULT_DB));
+}
+
+// The reference path must be deterministic for the golden files and
+// for variant comparisons to be meaningful.
+TEST_F(GoldenRenderTest, RenderIsDeterministic) {
+    std::vector<Event> ev = {
+        Event::stop_on(0, 0, 0), Event::stop_on(0, 0, 1),
+        Event::note_on(0, 60), Event::note_off(6000, 60),
+    };
+    Rankwave::seed(SEED);
+    auto A = make_engine()->render(ev, 8192);
+    Rankwave::seed(SEED);
+    auto B = make_engine()->render(ev, 8192);
+    Difference D = compare(A, B);
+    EXPECT_TRUE(within(D, Tolerance::exact())) << "max " << D.max_ulp << " ulp";
+}
+
+TEST_F(GoldenRenderTest, CompareMetrics) {
+    std::vector<float> a = {1.0f, -0.5f, 0.25f, 0.0f};
+    std::vector<float> b = a;
+
+    EXPECT_TRUE(within(compare(a, b), Tolerance::exact()));
+    b[1] = std::nextafter(b[1], -1.0f);
+    Difference D = compare(a, b);
+    EXPECT_EQ(D.max_ulp, 1);
+    EXPECT_FALSE(within(D, Tolerance::exact()));
+    EXPECT_TRUE(within(D, Tolerance::db(-120)));
+    EXPECT_TRUE(within(D, {1, -120}));
+    b[0] = 1.1f;
+    EXPECT_FALSE(within(compare(a, b), Tolerance::db(-40)));
+}
@@ -0,0 +1,89 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <clthreads.h>
+#include "messages.h"
+#include "mesgpool.h"
+
+TEST(MesgpoolTest, MessagesComeFromThePools) {
+    unsigned int n = Mesgpool::inuse();
+    unsigned int h = Mesgpool::misses();
+
+    ITC_mesg *A = new M_ifc_ifelm(MT_IFC_ELSET, 1, 2);
+    ITC_mesg *B = new M_def_rank(MT_LOAD_RANK);
+    ITC_mesg *C = new M_ifc_capture(1, false, "/tmp/x.wav");
+    EXPECT_EQ(Mesgpool::inuse(), n + 3);
+    A->recover();
+    B->recover();
+    C->recover();
+    EXPECT_EQ(Mesgpool::inuse(), n);
+    EXPECT_EQ(Mesgpool::misses(), h);
+}
+
+TEST(MesgpoolTest, BlocksAreReused) {
+    void *p = Mesgpool::alloc(40);
+    Mesgpool::release(p);
+    void *q = Mesgpool::alloc(40);
+    EXPECT_EQ(p, q);
+    Mesgpool::release(q);
+}
+
+TEST(MesgpoolTest, LargeOrManyUseTheHeap) {
+    unsigned int h = Mesgpool::misses();
+    std::vector<void *> v;
+
+    // Too large for any pool.
+    M_ifc_init *M = new M_ifc_init;
+    EXPECT_EQ(Mesgpool::misses(), h + 1);
+    M->recover();
+
+    // All pools that fit are empty.
+    for (int i = 0; i < 4096; i++) v.push_back(Mesgpool::alloc(1000));
+    EXPECT_GT(Mesgpool::misses(), h + 1);
+    for (void *p : v) Mesgpool::release(p);
+}
+
+TEST(MesgpoolTest, ThreadsShareThePools) {
+    unsigned int n = Mesgpool::inuse();
+    std::vector<std::thread> T;
+
+    // Blocks taken in one thread are returned by another.
+    std::vector<void *> v(4 * 10000);
+    for (int k = 0; k < 4; k++) {
+        T.emplace_back([&v, k] {
+            for (int i = 0; i < 10000; i++) {
+                void *p = Mesgpool::alloc(48 + 50 * (i & 1));
+                memset(p, k, 48);
+                __atomic_store_n(&v[k * 10000 + i], p, __ATOMIC_RELEASE);
+                if (i >= 100) {
+                    int j = (k + 1) % 4 * 10000 + i - 100;
+                    while (!__atomic_load_n(&v[j], __ATOMIC_ACQUIRE)) std::this_thread::yield();
+                    Mesgpool::release(__atomic_exchange_n(&v[j], nullptr, __ATOMIC_ACQ_REL));
+                }
+            }
+        });
+    }
+    for (auto &t : T) t.join();
+    for (void *p : v) if (p) Mesgpool::release(p);
+    EXPECT_EQ(Mesgpool::inuse(), n);
+}
@@ -253,4 +253,55 @@ TEST_F(MidiProcessorTest, HelperFunctions) {
     EXPECT_FALSE(MidiProcessor::is_controller(0x90));  // Note on
     EXPECT_TRUE(MidiProcessor::is_program_change(0xC0)); // Program change
     EXPECT_FALSE(MidiProcessor::is_program_change(0x90)); // Note on
-}
\ No newline at end of file
+}
+TEST_F(MidiProcessorTest, SwellFloodKeepsLatestValue) {
+    // A moving pedal: many swell and tremulant values on two channels,
+    // with a bank select in between that must pass unchanged.
+    MidiProcessor::Coalescer merge;
+    auto send = [&](const MidiEvent& e) {
+        MidiProcessor::process_midi_event(e.status, e.data1, e.data2, e.channel,
+                                          midi_env.midimap.data(), &handler,
+                                          &midi_env.note_queue, &midi_env.midi_queue, &merge);
+    };
+    for (int v = 0; v < 100; ++v) send(MidiEvent::controller(1, 7, v));
+    send(MidiEvent::controller(2, 13, 20));
+    send(MidiEvent::controller(1, 32, 3));
+    send(MidiEvent::controller(1, 13, 40));
+    send(MidiEvent::controller(2, 13, 21));
+    send(MidiEvent::controller(1, 7, 127));
+
+    // Only the bank select has been written so far.
+    ASSERT_EQ(midi_env.midi_queue.read_avail(), 3);
+    EXPECT_EQ(midi_env.midi_queue.read(1), 32);
+    midi_env.midi_queue.read_commit(3);
+    EXPECT_EQ(merge.pending(), 3);
+
+    EXPECT_EQ(merge.flush(&midi_env.midi_queue), 3);
+    EXPECT_EQ(merge.pending(), 0);
+    EXPECT_EQ(merge.merged(), 101);
+    EXPECT_EQ(merge.merged(), 0);
+
+    // First-seen order, last value.
+    const std::array<std::array<int, 3>, 3> expected = {{
+        {0xB1, 7, 127}, {0xB2, 13, 21}, {0xB1, 13, 40}
+    }};
+    ASSERT_EQ(midi_env.midi_queue.read_avail(), 9);
+    for (const auto& x : expected) {
+        EXPECT_EQ(midi_env.midi_queue.read(0), x[0]);
+        EXPECT_EQ(midi_env.midi_queue.read(1), x[1]);
+        EXPECT_EQ(midi_env.midi_queue.read(2), x[2]);
+        midi_env.midi_queue.read_commit(3);
+    }
+}
+
+TEST_F(MidiProcessorTest, SwellIgnoredOnNonDivisionChannel) {
+    MidiProcessor::Coalescer merge;
+    midi_env.configureMidimap(3, true, false, true);
+    const auto e = MidiEvent::controller(3, 7, 64);
+    MidiProcessor::process_midi_event(e.status, e.data1, e.data2, e.channel,
+                                      midi_env.midimap.data(), &handler,
+                                      &midi_env.note_queue, &midi_env.midi_queue, &merge);
+    EXPECT_EQ(merge.pending(), 0);
+    EXPECT_EQ(merge.flush(&midi_env.midi_queue), 0);
+    EXPECT_EQ(midi_env.midi_queue.read_avail(), 0);
+}
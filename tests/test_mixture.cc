@@ -0,0 +1,112 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <string.h>
+#include "addsynth.h"
+#include "rankwave.h"
+#include "scales.h"
+
+class MixtureTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        for (int j = 0; j < 3; j++) {
+            ranks[j]._n_vol.reset(-20.0f);
+            ranks[j]._h_lev.setv(0, 4, -10.0f);
+            S[j] = ranks + j;
+        }
+    }
+
+    void pitch(int j, int fn, int fd) {
+        ranks[j]._fn = fn;
+        ranks[j]._fd = fd;
+    }
+
+    Addsynth  ranks[3];
+    Addsynth *S[3];
+    Addsynth  mix;
+};
+
+TEST_F(MixtureTest, HarmonicsGoToMultiplesOfCommonPitch) {
+    // 2-2/3' and 2' on an 8' base.
+    pitch(0, 3, 1);
+    pitch(1, 4, 1);
+    ranks[1]._h_lev.setv(1, 4, -16.0f);
+    ASSERT_EQ(mix.mix(S, 2), 0);
+    EXPECT_EQ(mix._fn, 1);
+    EXPECT_EQ(mix._fd, 1);
+    EXPECT_NEAR(mix._h_lev.vs(2, 4), -30.0f, 1e-3f);
+    EXPECT_NEAR(mix._h_lev.vs(3, 4), -30.0f, 1e-3f);
+    EXPECT_NEAR(mix._h_lev.vs(7, 4), -36.0f, 1e-3f);
+    EXPECT_LT(mix._h_lev.vs(0, 4), -80.0f);
+    EXPECT_LT(mix._h_lev.vs(4, 4), -80.0f);
+}
+
+TEST_F(MixtureTest, CoincidingHarmonicsAdd) {
+    // The second harmonic of 4' is the first of 2'.
+    pitch(0, 2, 1);
+    pitch(1, 4, 1);
+    ranks[0]._h_lev.setv(1, 4, -10.0f);
+    ASSERT_EQ(mix.mix(S, 2), 0);
+    EXPECT_EQ(mix._fn, 2);
+    EXPECT_EQ(mix._fd, 1);
+    EXPECT_NEAR(mix._h_lev.vs(0, 4), -30.0f, 1e-3f);
+    EXPECT_NEAR(mix._h_lev.vs(1, 4), -30.0f + 1.0f / 0.1661f, 1e-3f);
+}
+
+TEST_F(MixtureTest, FractionalPitches) {
+    // 5-1/3', 4' and 3-1/5' have 16' as common pitch.
+    pitch(0, 3, 2);
+    pitch(1, 2, 1);
+    pitch(2, 5, 2);
+    ASSERT_EQ(mix.mix(S, 3), 0);
+    EXPECT_EQ(mix._fn, 1);
+    EXPECT_EQ(mix._fd, 2);
+    EXPECT_NEAR(mix._h_lev.vs(2, 4), -30.0f, 1e-3f);
+    EXPECT_NEAR(mix._h_lev.vs(3, 4), -30.0f, 1e-3f);
+    EXPECT_NEAR(mix._h_lev.vs(4, 4), -30.0f, 1e-3f);
+}
+
+TEST_F(MixtureTest, NoCommonRange) {
+    ranks[0]._n1 = 60;
+    ranks[1]._n0 = 66;
+    EXPECT_NE(mix.mix(S, 2), 0);
+}
+
+TEST_F(MixtureTest, PlaysOnePipePerKey) {
+    float out[4 * PERIOD];
+    float e = 0;
+
+    pitch(0, 3, 1);
+    pitch(1, 4, 1);
+    ranks[0]._n_att.reset(0.05f);
+    ASSERT_EQ(mix.mix(S, 2), 0);
+
+    Rankwave R(mix._n0, mix._n1);
+    R.gen_waves(&mix, 48000.0f, 440.0f, scales[5]._data);
+    R.set_param(out, 0, 'C');
+    R.note_on(60);
+    for (int k = 0; k < 100; k++) {
+        memset(out, 0, sizeof(out));
+        R.play(1);
+        for (float v : out) e += v * v;
+    }
+    EXPECT_GT(e, 0.0f);
+}
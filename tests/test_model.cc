@@ -0,0 +1,445 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "model.h"
+#include "division.h"
+
+// A small instrument in a temporary stops directory: a rank, a unit
+// extension of it and a mixture whose files are separated by a tab.
+class ModelTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        snprintf(stops, sizeof(stops), "/tmp/aeolus-test-model-%d", getpid());
+        mkdir(stops, 0755);
+        mkdir((std::string(stops) + "/Aeolus").c_str(), 0755);
+        mkdir((std::string(stops) + "/waves").c_str(), 0755);
+        stop("a.ae0", 1);
+        stop("b.ae0", 2);
+        stop("c.ae0", 3, 84);
+        define("/mixture L 5 Mx Mixt a.ae0\tb.ae0\n");
+    }
+
+    void TearDown() override {
+        drain(&slave);
+        drain(&iface);
+        std::string s = std::string("rm -rf ") + stops;
+        if (system(s.c_str())) {}
+    }
+
+    void stop(const char *name, int fn, int n1 = 96) {
+        Addsynth A;
+        A.reset();
+        strcpy(A._filename, name);
+        strcpy(A._stopname, "Principal");
+        strcpy(A._mnemonic, "P");
+        A._n0 = 36;
+        A._n1 = n1;
+        A._fn = fn;
+        A._fd = 1;
+        ASSERT_EQ(A.save(stops), 0);
+    }
+
+    void define(const char *mixture) {
+        FILE *F = fopen(path("Aeolus/definition").c_str(), "w");
+        ASSERT_TRUE(F);
+        fprintf(F, "/instr/new\n/tuning 440 5\n/manual/new I\n/divis/new II 1 1\n"
+                   "/rank C 0 a.ae0\n/unit 1 -12 U4 Octave\n%s/divis/end\n"
+                   "/group/new G\n/stop 1 1 1\n/stop 1 1 2\n/stop 1 1 3\n/group/end\n/instr/end\n",
+                mixture);
+        fclose(F);
+    }
+
+    std::string path(const char *name) { return std::string(stops) + "/" + name; }
+
+    std::unique_ptr<Model> model() {
+        return std::make_unique<Model>(&qcomm, &qmidi, midimap, "test", stops, "Aeolus", "waves", false);
+    }
+
+    // The Model as started by the audio and MIDI threads, with its
+    // messages to the Slave and the interface queued here.
+    void start(Model *M) {
+        M_audio_info *A = new M_audio_info;
+        M_midi_info  *I = new M_midi_info;
+        A->_fsamp = 48000.0f;
+        A->_fsize = 1024;
+        A->_nasect = 0;
+        A->_instrpar = instrpar;
+        for (int i = 0; i < NASECT; i++) A->_asectpar[i] = asectpar[i];
+        A->_perfstats = &stats;
+        A->_capture = 0;
+        A->_qdead = 0;
+        I->_client = 0;
+        I->_ipport = 0;
+        M->_audio = A;
+        M->_midi = I;
+        ITC_ctrl::connect(M, TO_SLAVE, &slave, 0);
+        ITC_ctrl::connect(M, TO_IFACE, &iface, 0);
+        M->init();
+        M->_ready = true;
+    }
+
+    // Pretend the ranks made from a stop are resident.
+    void resident(Model *M, int r, Rankwave *W) {
+        Rank *R = M->_divis[0]._ranks + r;
+        R->_rwave = W;
+        R->_resid = Rank::RESIDENT;
+        R->_stale = false;
+    }
+
+    // The messages sent to a thread, in order.
+    std::vector<ITC_mesg *> sent(ITC_ctrl *C) {
+        std::vector<ITC_mesg *> V;
+        while (C->get_event_nowait() != EV_TIME) {
+            ITC_mesg *M = C->get_message();
+            if (M) V.push_back(M);
+        }
+        return V;
+    }
+
+    void drain(ITC_ctrl *C) {
+        for (ITC_mesg *M : sent(C)) M->recover();
+    }
+
+    // Access to the private parts of Model.
+    static int  read_instr(Model *M) { return M->read_instr(); }
+    static int  read_cache(Model *M) { return M->read_cache(); }
+    static void write_cache(Model *M) { M->write_cache(); }
+    static void init(Model *M) { M->init(); }
+    static int  ndivis(Model *M) { return M->_ndivis; }
+    static int  nkeybd(Model *M) { return M->_nkeybd; }
+    static int  ngroup(Model *M) { return M->_ngroup; }
+    static int  nasect(Model *M) { return M->_nasect; }
+    static int  itemp(Model *M) { return M->_itemp; }
+    static float fbase(Model *M) { return M->_fbase; }
+    static Divis *divis(Model *M, int d) { return M->_divis + d; }
+    static Group *group(Model *M, int g) { return M->_group + g; }
+    static Keybd *keybd(Model *M, int k) { return M->_keybd + k; }
+    static Instr *prev(Model *M) { return M->_prev; }
+    static bool ready(Model *M) { return M->_ready; }
+    static int  igen(Model *M) { return M->_igen; }
+    static int  nreuse(Model *M) { return M->_nreuse; }
+    static const char *instrdir(Model *M) { return M->_instrdir; }
+    static void reload(Model *M, const char *s) { M->reload(s); }
+    static void retune(Model *M, float f, int t) { M->retune(f, t); }
+    static void proc_mesg(Model *M, ITC_mesg *X) { M->proc_mesg(X); }
+    static Rankwave *prev_waves(Model *M, Addsynth *A) { return M->prev_waves(A); }
+    static void set_fbase(Model *M, float f) { M->_fbase = f; }
+    static void set_itemp(Model *M, int t) { M->_itemp = t; }
+    static Preset *preset(Model *M, int b, int p) { return M->_preset[b][p]; }
+    static void set_preset(Model *M, int b, int p, uint32_t *bits) { M->set_preset(b, p, bits); }
+    static int  get_preset(Model *M, int b, int p, uint32_t *bits) { return M->get_preset(b, p, bits); }
+
+    // Overwrite part of the cache file.
+    void patch(long offs, const void *data, size_t n) {
+        FILE *F = fopen(path("Aeolus/definition.cache").c_str(), "r+b");
+        ASSERT_TRUE(F);
+        fseek(F, offs, SEEK_SET);
+        fwrite(data, 1, n, F);
+        fclose(F);
+    }
+
+    long cache_size() {
+        struct stat S;
+        return stat(path("Aeolus/definition.cache").c_str(), &S) ? -1 : (long) S.st_size;
+    }
+
+    char      stops[256];
+    Lfq_u32   qcomm{1024};
+    Lfq_u8    qmidi{1024};
+    uint16_t  midimap[16];
+    Perfstats stats;
+    Fparm     instrpar[4] = {};
+    Fparm     asectpar[NASECT][5] = {};
+    ITC_ctrl  slave;
+    ITC_ctrl  iface;
+};
+
+TEST_F(ModelTest, CacheMatchesDefinition) {
+    auto A = model();
+    ASSERT_EQ(read_instr(A.get()), 0);
+    write_cache(A.get());
+    ASSERT_GT(cache_size(), 0);
+
+    auto B = model();
+    ASSERT_EQ(read_cache(B.get()), 0);
+    EXPECT_EQ(ndivis(B.get()), ndivis(A.get()));
+    EXPECT_EQ(nkeybd(B.get()), nkeybd(A.get()));
+    EXPECT_EQ(ngroup(B.get()), ngroup(A.get()));
+    EXPECT_EQ(nasect(B.get()), nasect(A.get()));
+    EXPECT_EQ(itemp(B.get()), itemp(A.get()));
+    EXPECT_EQ(fbase(B.get()), fbase(A.get()));
+    EXPECT_STREQ(keybd(B.get(), 0)->_label, "I");
+    EXPECT_EQ(memcmp(group(B.get(), 0), group(A.get(), 0), sizeof(Group)), 0);
+
+    Divis *D = divis(A.get(), 0);
+    Divis *E = divis(B.get(), 0);
+    ASSERT_EQ(D->_nrank, 3);
+    ASSERT_EQ(E->_nrank, 3);
+    for (int r = 0; r < 3; r++) {
+        Rank *R = D->_ranks + r;
+        Rank *S = E->_ranks + r;
+        EXPECT_EQ(S->_unit, R->_unit);
+        EXPECT_EQ(S->_offs, R->_offs);
+        EXPECT_STREQ(S->_mnemo, R->_mnemo);
+        EXPECT_STREQ(S->_label, R->_label);
+        ASSERT_TRUE(S->_synth);
+        EXPECT_EQ(memcmp(S->_synth, R->_synth, sizeof(Addsynth)), 0);
+        EXPECT_EQ(S->_rwave, nullptr);
+        EXPECT_EQ(S->_resid, Rank::EVICTED);
+        if (R->_mixt) {
+            ASSERT_TRUE(S->_mixt);
+            EXPECT_STREQ(S->_mixt, R->_mixt);
+        }
+        else EXPECT_EQ(S->_mixt, nullptr);
+    }
+    // The extension uses the synth of its rank, the mixture
+    // combines both files.
+    EXPECT_EQ(E->_ranks[1]._unit, 0);
+    EXPECT_EQ(E->_ranks[1]._synth, E->_ranks[0]._synth);
+    EXPECT_NE(strchr(E->_ranks[2]._mixt, '\t'), nullptr);
+}
+
+TEST_F(ModelTest, CacheFallsBackOnChangedStop) {
+    auto A = model();
+    ASSERT_EQ(read_instr(A.get()), 0);
+    write_cache(A.get());
+
+    // b.ae0 is only used by the mixture.
+    FILE *F = fopen(path("b.ae0").c_str(), "a");
+    fputc(0, F);
+    fclose(F);
+    auto B = model();
+    EXPECT_NE(read_cache(B.get()), 0);
+    EXPECT_EQ(ndivis(B.get()), 0);
+}
+
+TEST_F(ModelTest, CacheFallsBackWhenTruncated) {
+    auto A = model();
+    ASSERT_EQ(read_instr(A.get()), 0);
+    write_cache(A.get());
+    long n = cache_size();
+
+    // Short by a few bytes, only the mixture files are missing.
+    ASSERT_EQ(truncate(path("Aeolus/definition.cache").c_str(), n - 4), 0);
+    auto B = model();
+    EXPECT_NE(read_cache(B.get()), 0);
+    EXPECT_EQ(ndivis(B.get()), 0);
+    EXPECT_EQ(divis(B.get(), 0)->_nrank, 0);
+    // So the definition can still be read.
+    EXPECT_EQ(read_instr(B.get()), 0);
+    EXPECT_EQ(divis(B.get(), 0)->_nrank, 3);
+
+    ASSERT_EQ(truncate(path("Aeolus/definition.cache").c_str(), n / 2), 0);
+    auto C = model();
+    EXPECT_NE(read_cache(C.get()), 0);
+}
+
+TEST_F(ModelTest, CacheFallsBackOnOtherLayout) {
+    auto A = model();
+    ASSERT_EQ(read_instr(A.get()), 0);
+    write_cache(A.get());
+
+    // The size of Addsynth, after the magic and version.
+    uint32_t k = sizeof(Addsynth) + 8;
+    patch(12, &k, sizeof(k));
+    auto B = model();
+    EXPECT_NE(read_cache(B.get()), 0);
+}
+
+TEST_F(ModelTest, CacheIsWrittenAgainAfterFallback) {
+    auto A = model();
+    init(A.get());
+    ASSERT_EQ(ndivis(A.get()), 1);
+    ASSERT_GT(cache_size(), 0);
+
+    FILE *F = fopen(path("a.ae0").c_str(), "a");
+    fputc(0, F);
+    fclose(F);
+    auto B = model();
+    init(B.get());
+    EXPECT_EQ(divis(B.get(), 0)->_nrank, 3);
+
+    // The new cache is valid for the changed file.
+    auto C = model();
+    EXPECT_EQ(read_cache(C.get()), 0);
+    EXPECT_EQ(divis(C.get(), 0)->_nrank, 3);
+}
+
+TEST_F(ModelTest, FailedReloadKeepsInstrument) {
+    auto A = model();
+    start(A.get());
+    uint32_t bits[NGROUP] = { 5 };
+    set_preset(A.get(), 0, 0, bits);
+    Preset *P = preset(A.get(), 0, 0);
+    Addsynth *S = divis(A.get(), 0)->_ranks[0]._synth;
+    std::string dir = instrdir(A.get());
+
+    reload(A.get(), "none");
+    EXPECT_EQ(prev(A.get()), nullptr);
+    EXPECT_TRUE(ready(A.get()));
+    EXPECT_EQ(instrdir(A.get()), dir);
+    EXPECT_EQ(ndivis(A.get()), 1);
+    EXPECT_EQ(ngroup(A.get()), 1);
+    EXPECT_EQ(divis(A.get(), 0)->_nrank, 3);
+    EXPECT_EQ(divis(A.get(), 0)->_ranks[0]._synth, S);
+    EXPECT_EQ(group(A.get(), 0)->_nifelm, 3);
+    EXPECT_EQ(preset(A.get(), 0, 0), P);
+    uint32_t b[NGROUP] = { 0 };
+    EXPECT_EQ(get_preset(A.get(), 0, 0, b), 1);
+    EXPECT_EQ(b[0], 5u);
+    // Nothing was sent for a new instrument.
+    for (ITC_mesg *M : sent(&slave)) {
+        EXPECT_NE(M->type(), MT_NEW_INSTR);
+        M->recover();
+    }
+}
+
+TEST_F(ModelTest, ReloadReusesIdenticalRanks) {
+    auto A = model();
+    start(A.get());
+    Rankwave *W = new Rankwave(36, 96);
+    Rankwave *X = new Rankwave(36, 96);
+    resident(A.get(), 0, W);
+    resident(A.get(), 2, X);
+    // Only the rank is the same, the mixture has other stops.
+    define("/mixture L 5 Mx Mixt b.ae0\tc.ae0\n");
+    drain(&slave);
+
+    reload(A.get(), "");
+    ASSERT_NE(prev(A.get()), nullptr);
+    EXPECT_FALSE(ready(A.get()));
+    EXPECT_EQ(nreuse(A.get()), 1);
+    std::vector<ITC_mesg *> V = sent(&slave);
+    ASSERT_EQ(V.size(), 4u);
+    for (int i = 0; i < 3; i++) {
+        M_def_rank *M = (M_def_rank *) V[i];
+        ASSERT_EQ(M->type(), MT_LOAD_RANK);
+        EXPECT_EQ(M->_gen, igen(A.get()));
+        EXPECT_NE(M->_target, nullptr);
+        EXPECT_EQ(M->_share, (M->_rank == 0) ? W : nullptr);
+    }
+    ASSERT_EQ(V[3]->type(), MT_NEW_INSTR);
+    M_new_instr *N = (M_new_instr *) V[3];
+    EXPECT_EQ(N->_ndivis, 1);
+    EXPECT_EQ(N->_divisp[0], ((M_def_rank *) V[0])->_target);
+
+    // Another tuning or temperament can't use the old waves.
+    Addsynth *S = divis(A.get(), 0)->_ranks[0]._synth;
+    EXPECT_EQ(prev_waves(A.get(), S), W);
+    EXPECT_EQ(prev_waves(A.get(), divis(A.get(), 0)->_ranks[2]._synth), nullptr);
+    set_fbase(A.get(), 442.0f);
+    EXPECT_EQ(prev_waves(A.get(), S), nullptr);
+    set_fbase(A.get(), 440.0f);
+    set_itemp(A.get(), 4);
+    EXPECT_EQ(prev_waves(A.get(), S), nullptr);
+    set_itemp(A.get(), 5);
+
+    for (ITC_mesg *M : V) {
+        if (M != N) M->recover();
+    }
+    delete N->_divisp[0];
+    N->recover();
+    delete W;
+    delete X;
+}
+
+TEST_F(ModelTest, OldRanksAreIgnored) {
+    auto A = model();
+    start(A.get());
+    drain(&slave);
+    reload(A.get(), "");
+    Rank *R = divis(A.get(), 0)->_ranks;
+    ASSERT_EQ(R->_resid, Rank::LOADING);
+
+    // A rank made for the previous instrument.
+    Rankwave *W = new Rankwave(36, 96);
+    M_def_rank *M = new M_def_rank(MT_LOAD_RANK);
+    M->_gen = igen(A.get()) - 1;
+    M->_divis = 0;
+    M->_rank = 0;
+    M->_rwave = W;
+    proc_mesg(A.get(), M);
+    EXPECT_EQ(R->_rwave, nullptr);
+    EXPECT_EQ(R->_resid, Rank::LOADING);
+
+    M = new M_def_rank(MT_LOAD_RANK);
+    M->_gen = igen(A.get());
+    M->_divis = 0;
+    M->_rank = 0;
+    M->_rwave = W;
+    proc_mesg(A.get(), M);
+    EXPECT_EQ(R->_rwave, W);
+    EXPECT_EQ(R->_resid, Rank::RESIDENT);
+
+    for (ITC_mesg *X : sent(&slave)) {
+        if (X->type() == MT_NEW_INSTR) delete ((M_new_instr *) X)->_divisp[0];
+        X->recover();
+    }
+    delete W;
+}
+
+TEST_F(ModelTest, SwapDeletesOldAndRetunesAfterwards) {
+    auto A = model();
+    start(A.get());
+    drain(&slave);
+    reload(A.get(), "");
+    // Asked for while the new instrument is made.
+    retune(A.get(), 442.0f, 4);
+    EXPECT_EQ(fbase(A.get()), 440.0f);
+    EXPECT_EQ(itemp(A.get()), 5);
+
+    M_new_instr *N = 0;
+    for (ITC_mesg *X : sent(&slave)) {
+        if (X->type() == MT_NEW_INSTR) N = (M_new_instr *) X;
+        else X->recover();
+    }
+    ASSERT_NE(N, nullptr);
+    drain(&iface);
+
+    // As returned by the audio thread, with the divisions it played.
+    delete N->_divisp[0];
+    N->_divisp[0] = new Division(0, 48000.0f);
+    proc_mesg(A.get(), N);
+    EXPECT_EQ(prev(A.get()), nullptr);
+    EXPECT_EQ(fbase(A.get()), 442.0f);
+    EXPECT_EQ(itemp(A.get()), 4);
+    // Ready when the new tuning is.
+    EXPECT_FALSE(ready(A.get()));
+    bool init = false, calc = false;
+    for (ITC_mesg *X : sent(&iface)) {
+        if (X->type() == MT_IFC_INIT) init = true;
+        EXPECT_NE(X->type(), MT_IFC_READY);
+        X->recover();
+    }
+    for (ITC_mesg *X : sent(&slave)) {
+        if (X->type() == MT_CALC_RANK) calc = true;
+        X->recover();
+    }
+    EXPECT_TRUE(init);
+    EXPECT_TRUE(calc);
+}
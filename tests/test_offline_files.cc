@@ -0,0 +1,229 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "midifile.h"
+#include "audiofile.h"
+
+class OfflineFilesTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        snprintf(path, sizeof(path), "/tmp/aeolus-test-offline-%d", getpid());
+    }
+
+    void TearDown() override {
+        unlink(path);
+    }
+
+    void write_file(const std::vector<uint8_t>& data) {
+        FILE *F = fopen(path, "w");
+        ASSERT_NE(F, nullptr);
+        fwrite(data.data(), 1, data.size(), F);
+        fclose(F);
+    }
+
+    std::vector<uint8_t> read_file() {
+        std::vector<uint8_t> data;
+        uint8_t b[4096];
+        size_t n;
+        FILE *F = fopen(path, "r");
+        if (!F) return data;
+        while ((n = fread(b, 1, sizeof(b), F)) > 0) data.insert(data.end(), b, b + n);
+        fclose(F);
+        return data;
+    }
+
+    static void put32(std::vector<uint8_t>& v, uint32_t x) {
+        v.push_back(x >> 24); v.push_back(x >> 16); v.push_back(x >> 8); v.push_back(x);
+    }
+
+    static void add_track(std::vector<uint8_t>& v, const std::vector<uint8_t>& t) {
+        v.insert(v.end(), {'M', 'T', 'r', 'k'});
+        put32(v, t.size());
+        v.insert(v.end(), t.begin(), t.end());
+    }
+
+    static std::vector<uint8_t> header(int format, int ntrk, int division) {
+        std::vector<uint8_t> v = {'M', 'T', 'h', 'd'};
+        put32(v, 6);
+        v.insert(v.end(), {0, (uint8_t) format, 0, (uint8_t) ntrk,
+                           (uint8_t)(division >> 8), (uint8_t) division});
+        return v;
+    }
+
+    static uint32_t le32(const std::vector<uint8_t>& d, int i) {
+        return d[i] | (d[i + 1] << 8) | (d[i + 2] << 16) | ((uint32_t) d[i + 3] << 24);
+    }
+
+    char path[256];
+};
+
+TEST_F(OfflineFilesTest, Format0RunningStatus) {
+    // 480 ticks per quarter at the default 120 bpm, so one tick is
+    // 1/960 s. The second note on uses running status.
+    std::vector<uint8_t> f = header(0, 1, 480);
+    add_track(f, {0x00, 0x90, 60, 100,
+                  0x83, 0x60, 64, 100,          // 480 ticks later
+                  0x00, 0xF0, 0x02, 0x01, 0xF7, // sysex, skipped
+                  0x83, 0x60, 0x80, 60, 0,
+                  0x00, 0xFF, 0x2F, 0x00});
+    write_file(f);
+
+    Midifile M;
+    ASSERT_EQ(M.load(path), 0);
+    ASSERT_EQ(M.nevent(), 3);
+    EXPECT_DOUBLE_EQ(M.event(0)->_time, 0.0);
+    EXPECT_DOUBLE_EQ(M.event(1)->_time, 0.5);
+    EXPECT_EQ(M.event(1)->_data[0], 0x90);
+    EXPECT_EQ(M.event(1)->_data[1], 64);
+    EXPECT_DOUBLE_EQ(M.event(2)->_time, 1.0);
+    EXPECT_EQ(M.event(2)->_data[0], 0x80);
+}
+
+TEST_F(OfflineFilesTest, Format1TempoMapAndMerge) {
+    // Tempo track doubles the tempo after one quarter note.
+    std::vector<uint8_t> f = header(1, 2, 96);
+    add_track(f, {0x60, 0xFF, 0x51, 0x03, 0x03, 0xD0, 0x90, // 250000 us
+                  0x00, 0xFF, 0x2F, 0x00});
+    add_track(f, {0x00, 0xC1, 5,
+                  0x81, 0x40, 0x91, 48, 80,     // tick 192
+                  0x00, 0xFF, 0x2F, 0x00});
+    write_file(f);
+
+    Midifile M;
+    ASSERT_EQ(M.load(path), 0);
+    ASSERT_EQ(M.nevent(), 2);
+    EXPECT_EQ(M.event(0)->_data[0], 0xC1);
+    EXPECT_EQ(M.event(0)->_data[1], 5);
+    EXPECT_DOUBLE_EQ(M.event(1)->_time, 0.75);
+}
+
+TEST_F(OfflineFilesTest, RejectsBadFiles) {
+    write_file({'R', 'I', 'F', 'F', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0});
+    Midifile M;
+    EXPECT_NE(M.load(path), 0);
+    std::vector<uint8_t> f = header(0, 1, 480);
+    add_track(f, {0x00, 64, 100});  // data byte without status
+    write_file(f);
+    EXPECT_NE(M.load(path), 0);
+}
+
+TEST_F(OfflineFilesTest, WavPcm16) {
+    float L[3] = {0.5f, -1.0f, 2.0f};
+    float R[3] = {0.0f, 0.25f, -2.0f};
+    const float *data[2] = {L, R};
+
+    Audiofile A;
+    ASSERT_EQ(A.open_write(path, Audiofile::TYPE_WAV, Audiofile::FORM_16, 2, 44100), 0);
+    ASSERT_EQ(A.write(data, 3), 0);
+    ASSERT_EQ(A.close(), 0);
+
+    std::vector<uint8_t> d = read_file();
+    ASSERT_EQ(d.size(), 44u + 12u);
+    EXPECT_EQ(memcmp(d.data(), "RIFF", 4), 0);
+    EXPECT_EQ(le32(d, 4), d.size() - 8);
+    EXPECT_EQ(d[20], 1);                   // PCM
+    EXPECT_EQ(le32(d, 24), 44100u);
+    EXPECT_EQ(memcmp(d.data() + 36, "data", 4), 0);
+    EXPECT_EQ(le32(d, 40), 12u);
+    EXPECT_EQ((int16_t)(d[44] | (d[45] << 8)), 16383);
+    EXPECT_EQ((int16_t)(d[48] | (d[49] << 8)), -32767);
+    EXPECT_EQ((int16_t)(d[52] | (d[53] << 8)), 32767);   // clipped
+    EXPECT_EQ((int16_t)(d[54] | (d[55] << 8)), -32767);
+}
+
+TEST_F(OfflineFilesTest, WavFloatBformatIsExtensible) {
+    float W[2] = {0.125f, -0.5f};
+    const float *data[4] = {W, W, W, W};
+
+    Audiofile A;
+    ASSERT_EQ(A.open_write(path, Audiofile::TYPE_WAV, Audiofile::FORM_FLOAT, 4, 48000), 0);
+    ASSERT_EQ(A.write(data, 2), 0);
+    ASSERT_EQ(A.close(), 0);
+
+    std::vector<uint8_t> d = read_file();
+    ASSERT_EQ(d.size(), 68u + 32u);
+    EXPECT_EQ(d[20] | (d[21] << 8), 0xFFFE);
+    EXPECT_EQ(d[44], 3);                   // IEEE float subformat
+    EXPECT_EQ(le32(d, 64), 32u);
+    float x;
+    uint32_t u = le32(d, 68);
+    memcpy(&x, &u, 4);
+    EXPECT_EQ(x, 0.125f);
+}
+
+TEST_F(OfflineFilesTest, CafHeader) {
+    float L[4] = {0.0f, 0.1f, 0.2f, 0.3f};
+    const float *data[2] = {L, L};
+
+    Audiofile A;
+    ASSERT_EQ(A.open_write(path, Audiofile::TYPE_CAF, Audiofile::FORM_24, 2, 96000), 0);
+    ASSERT_EQ(A.write(data, 4), 0);
+    ASSERT_EQ(A.close(), 0);
+
+    std::vector<uint8_t> d = read_file();
+    ASSERT_EQ(d.size(), 68u + 24u);
+    EXPECT_EQ(memcmp(d.data(), "caff", 4), 0);
+    EXPECT_EQ(memcmp(d.data() + 8, "desc", 4), 0);
+    EXPECT_EQ(memcmp(d.data() + 28, "lpcm", 4), 0);
+    EXPECT_EQ(d[35], 2);                   // little-endian integer
+    EXPECT_EQ(d[39], 6);                   // bytes per packet
+    EXPECT_EQ(d[51], 24);                  // bits per channel
+    EXPECT_EQ(memcmp(d.data() + 52, "data", 4), 0);
+    EXPECT_EQ(d[63], 28);                  // 4 + sample bytes
+}
+
+TEST_F(OfflineFilesTest, W64HeaderAndPadding) {
+    float L[3] = {0.5f, 0.0f, 0.0f};
+    const float *data[2] = {L, L};
+
+    Audiofile A;
+    ASSERT_EQ(A.open_write(path, Audiofile::TYPE_W64, Audiofile::FORM_16, 2, 48000), 0);
+    ASSERT_EQ(A.write(data, 3), 0);
+    ASSERT_EQ(A.close(), 0);
+
+    // 12 bytes of samples padded to 16.
+    std::vector<uint8_t> d = read_file();
+    ASSERT_EQ(d.size(), 104u + 16u);
+    EXPECT_EQ(memcmp(d.data(), "riff", 4), 0);
+    EXPECT_EQ(le32(d, 16), d.size());
+    EXPECT_EQ(le32(d, 20), 0u);
+    EXPECT_EQ(memcmp(d.data() + 24, "wave", 4), 0);
+    EXPECT_EQ(memcmp(d.data() + 40, "fmt ", 4), 0);
+    EXPECT_EQ(le32(d, 56), 40u);           // 24 + 16
+    EXPECT_EQ(d[64], 1);                   // PCM
+    EXPECT_EQ(memcmp(d.data() + 80, "data", 4), 0);
+    EXPECT_EQ(le32(d, 96), 24u + 12u);
+    EXPECT_EQ((int16_t)(d[104] | (d[105] << 8)), 16383);
+}
+
+TEST_F(OfflineFilesTest, NamesMapToTypes) {
+    EXPECT_EQ(Audiofile::type_from_name("out.wav"), Audiofile::TYPE_WAV);
+    EXPECT_EQ(Audiofile::type_from_name("out.w64"), Audiofile::TYPE_W64);
+    EXPECT_EQ(Audiofile::type_from_name("OUT.CAF"), Audiofile::TYPE_CAF);
+    EXPECT_EQ(Audiofile::type_from_name("out.flac"), Audiofile::TYPE_NONE);
+    EXPECT_EQ(Audiofile::form_from_name("24"), Audiofile::FORM_24);
+    EXPECT_EQ(Audiofile::form_from_name("float"), Audiofile::FORM_FLOAT);
+    EXPECT_EQ(Audiofile::form_from_name("8"), Audiofile::FORM_NONE);
+}
@@ -0,0 +1,135 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "perfstats.h"
+
+class PerfstatsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // 1024 frames at 48 kHz, period is 21333 us.
+        stats.init(48000, 1024);
+    }
+
+    void cycle(int64_t divis_ns, int64_t reverb_ns) {
+        stats.cycle_begin();
+        stats.stage_add(Perfstats::DIVIS, divis_ns);
+        stats.stage_add(Perfstats::REVERB, reverb_ns);
+        stats.cycle_end();
+    }
+
+    Perfstats stats;
+};
+
+TEST_F(PerfstatsTest, EmptyStatsAreZero) {
+    Perfinfo info;
+    stats.get_info(Perfstats::CYCLE, &info);
+    EXPECT_EQ(info._count, 0u);
+    EXPECT_FLOAT_EQ(info._max, 0.0f);
+    EXPECT_EQ(stats.xruns(), 0u);
+    EXPECT_EQ(stats.overruns(), 0u);
+}
+
+TEST_F(PerfstatsTest, PeriodFromInit) {
+    EXPECT_NEAR(stats.period(), 21333.3f, 0.1f);
+}
+
+TEST_F(PerfstatsTest, SetPeriodRestartsStats) {
+    cycle(1000000, 0);
+    stats.set_period(48000, 256);
+    EXPECT_NEAR(stats.period(), 5333.3f, 0.1f);
+    cycle(2000000, 0);
+
+    Perfinfo info;
+    stats.get_info(Perfstats::DIVIS, &info);
+    EXPECT_EQ(info._count, 1u);
+    EXPECT_FLOAT_EQ(info._min, 2000.0f);
+}
+
+TEST_F(PerfstatsTest, StageMinAvgMax) {
+    cycle(1000000, 200000);   // 1000 us, 200 us
+    cycle(3000000, 200000);   // 3000 us, 200 us
+
+    Perfinfo info;
+    stats.get_info(Perfstats::DIVIS, &info);
+    EXPECT_EQ(info._count, 2u);
+    EXPECT_FLOAT_EQ(info._min, 1000.0f);
+    EXPECT_FLOAT_EQ(info._max, 3000.0f);
+    EXPECT_FLOAT_EQ(info._avg, 2000.0f);
+    EXPECT_LE(info._p50, info._max);
+    EXPECT_LE(info._p99, info._max);
+
+    stats.get_info(Perfstats::REVERB, &info);
+    EXPECT_FLOAT_EQ(info._avg, 200.0f);
+
+    // Stages that were not timed still count the cycle.
+    stats.get_info(Perfstats::QUEUE, &info);
+    EXPECT_EQ(info._count, 2u);
+    EXPECT_FLOAT_EQ(info._max, 0.0f);
+}
+
+TEST_F(PerfstatsTest, PercentilesFollowHistogram) {
+    // 99 short cycles and one long one.
+    for (int i = 0; i < 99; i++) cycle(100000, 0);
+    cycle(15000000, 0);
+
+    Perfinfo info;
+    stats.get_info(Perfstats::DIVIS, &info);
+    EXPECT_LT(info._p50, 1000.0f);
+    EXPECT_LT(info._p95, 1000.0f);
+    EXPECT_FLOAT_EQ(info._max, 15000.0f);
+}
+
+TEST_F(PerfstatsTest, XrunsAndReset) {
+    stats.xrun();
+    stats.xrun();
+    cycle(1000, 0);
+    EXPECT_EQ(stats.xruns(), 2u);
+
+    // Reset is requested by a reader and executed by the next cycle.
+    stats.reset();
+    EXPECT_EQ(stats.xruns(), 2u);
+    cycle(1000, 0);
+    EXPECT_EQ(stats.xruns(), 0u);
+
+    Perfinfo info;
+    stats.get_info(Perfstats::DIVIS, &info);
+    EXPECT_EQ(info._count, 1u);
+}
+
+TEST_F(PerfstatsTest, MidiBatches) {
+    // Three batches over 1.5 s, two of them woke the model.
+    const int64_t s = 1000000000;
+    stats.add_midi(40, 1, true, 10 * s);
+    stats.add_midi(1, 1, false, 10 * s + s / 2);
+    EXPECT_EQ(stats.midi_events(), 41u);
+    EXPECT_EQ(stats.midi_reads(), 2u);
+    EXPECT_FLOAT_EQ(stats.midi_wakerate(), 0.0f);
+
+    stats.add_midi(19, 2, true, 11 * s + s / 2);
+    EXPECT_EQ(stats.midi_events(), 60u);
+    EXPECT_EQ(stats.midi_reads(), 4u);
+    EXPECT_NEAR(stats.midi_wakerate(), 2.0f / 1.5f, 1e-4f);
+}
+
+TEST_F(PerfstatsTest, StageNames) {
+    EXPECT_STREQ(Perfstats::stage_name(Perfstats::DIVIS), "divis");
+    EXPECT_STREQ(Perfstats::stage_name(Perfstats::CYCLE), "total");
+    EXPECT_STREQ(Perfstats::stage_name(-1), "?");
+}
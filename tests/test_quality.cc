@@ -0,0 +1,177 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <string.h>
+#include "asection.h"
+#include "perfstats.h"
+#include "reverb.h"
+
+class ReverbLightTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        rev.init(48000.0f);
+        seed = 1;
+    }
+
+    void TearDown() override {
+        rev.fini();
+    }
+
+    // Runs n periods, with noise input while 'in' is set.
+    // Returns the output energy, and the largest step between
+    // two output samples in 'step'.
+    float run(int n, bool in, float *step = 0) {
+        float R[PERIOD], W[PERIOD], X[PERIOD], Y[PERIOD], Z[PERIOD];
+        float e = 0, d = 0;
+        while (n--) {
+            for (int i = 0; i < PERIOD; i++) {
+                seed = seed * 1103515245 + 12345;
+                R[i] = in ? ((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f : 0.0f;
+            }
+            memset(W, 0, sizeof(W));
+            memset(X, 0, sizeof(X));
+            memset(Y, 0, sizeof(Y));
+            memset(Z, 0, sizeof(Z));
+            rev.process(PERIOD, 1.0f, R, W, X, Y, Z);
+            for (int i = 0; i < PERIOD; i++) {
+                e += W[i] * W[i] + X[i] * X[i] + Y[i] * Y[i];
+                d = fmaxf(d, fabsf(W[i] - last));
+                last = W[i];
+            }
+        }
+        if (step) *step = d;
+        return e;
+    }
+
+    Reverb   rev;
+    uint32_t seed;
+    float    last = 0;
+};
+
+TEST_F(ReverbLightTest, DecayIsKept) {
+    // Energy 0.5 s after the input stops, relative to the input.
+    run(750, true);
+    float e0 = run(1, true);
+    run(375, false);
+    float e1 = run(1, false);
+
+    rev.set_light(true);
+    run(750, true);
+    float l0 = run(1, true);
+    run(375, false);
+    float l1 = run(1, false);
+
+    float r = (l1 / l0) / (e1 / e0);
+    EXPECT_GT(r, 0.5f);
+    EXPECT_LT(r, 2.0f);
+    EXPECT_GT(l0 / e0, 0.25f);
+    EXPECT_LT(l0 / e0, 4.0f);
+}
+
+TEST_F(ReverbLightTest, SwitchingIsSmooth) {
+    float d0, d1, d2;
+
+    run(750, true, &d0);
+    rev.set_light(true);
+    run(75, true, &d1);
+    EXPECT_TRUE(rev.light());
+    rev.set_light(false);
+    run(75, true, &d2);
+    EXPECT_LT(d1, 2 * d0);
+    EXPECT_LT(d2, 2 * d0);
+    // Stays stable in light mode.
+    rev.set_light(true);
+    run(3000, true, &d1);
+    EXPECT_TRUE(isfinite(d1));
+    EXPECT_LT(d1, 2 * d0);
+}
+
+TEST(AsectionLight, SwitchingIsSmooth) {
+    Asection A(48000.0f);
+    float W[PERIOD], X[PERIOD], Y[PERIOD], R[PERIOD];
+    float last = 0, d[3] = {};
+
+    A.set_size(0.075f);
+    for (int k = 0; k < 1200; k++) {
+        float *p = A.get_wptr();
+        for (int i = 0; i < PERIOD; i++) p[i] = sinf(0.01f * (k * PERIOD + i));
+        memset(W, 0, sizeof(W));
+        memset(X, 0, sizeof(X));
+        memset(Y, 0, sizeof(Y));
+        memset(R, 0, sizeof(R));
+        if (k == 400) A.set_light(true);
+        if (k == 800) A.set_light(false);
+        A.process(1.0f, W, X, Y, R);
+        for (int i = 0; i < PERIOD; i++) {
+            if (k > 100) d[k / 400] = fmaxf(d[k / 400], fabsf(X[i] - last));
+            last = X[i];
+        }
+    }
+    EXPECT_FALSE(A.light());
+    EXPECT_GT(d[0], 0.0f);
+    EXPECT_LT(d[1], 2 * d[0]);
+    EXPECT_LT(d[2], 2 * d[0]);
+}
+
+class QualityTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        // 1024 frames at 48 kHz, 93 cycles in two seconds.
+        Q.init(48000, 1024);
+        Q.enable(true);
+    }
+
+    int run(int n, float load) {
+        int q = 0;
+        while (n--) q = Q.update(load);
+        return q;
+    }
+
+    Quality Q;
+};
+
+TEST_F(QualityTest, StepsDownOneLevelAtATime) {
+    EXPECT_EQ(run(1, 0.9f), (int) Quality::LIGHT_REVERB);
+    EXPECT_EQ(run(31, 0.9f), (int) Quality::LIGHT_REVERB);
+    EXPECT_EQ(run(1, 0.9f), (int) Quality::LIGHT_ALL);
+    EXPECT_EQ(run(100, 0.9f), (int) Quality::LIGHT_ALL);
+}
+
+TEST_F(QualityTest, StepsUpAfterLowLoad) {
+    run(1, 0.9f);
+    EXPECT_EQ(run(92, 0.3f), (int) Quality::LIGHT_REVERB);
+    EXPECT_EQ(run(1, 0.3f), (int) Quality::FULL);
+}
+
+TEST_F(QualityTest, HysteresisBand) {
+    run(1, 0.9f);
+    run(80, 0.3f);
+    // A single cycle between the marks starts the wait again.
+    run(1, 0.7f);
+    EXPECT_EQ(run(80, 0.3f), (int) Quality::LIGHT_REVERB);
+    EXPECT_EQ(run(500, 0.7f), (int) Quality::LIGHT_REVERB);
+}
+
+TEST_F(QualityTest, DisabledIsFull) {
+    run(1, 0.9f);
+    Q.enable(false);
+    EXPECT_EQ(run(1, 0.9f), (int) Quality::FULL);
+}
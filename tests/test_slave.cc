@@ -0,0 +1,182 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "slave.h"
+#include "scales.h"
+
+// The jobs are queued and taken directly, the Slave thread
+// is not started.
+class SlaveTest : public ::testing::Test {
+protected:
+    SlaveTest() : slave(&stats) {}
+
+    void SetUp() override {
+        synth._n0 = 48;
+        synth._n1 = 60;
+        for (int i = 0; i < N_NOTE; i++) synth._h_lev.setv(1, i, -10.0f);
+        ITC_ctrl::connect(&slave, TO_AUDIO, &audio, 0);
+        ITC_ctrl::connect(&slave, TO_MODEL, &model, 0);
+    }
+
+    void TearDown() override {
+        ITC_mesg *M;
+        while ((M = next())) M->recover();
+        drain(&audio);
+        drain(&model);
+    }
+
+    void drain(ITC_ctrl *C) {
+        while (C->get_event_nowait() != EV_TIME) {
+            ITC_mesg *M = C->get_message();
+            if (M) M->recover();
+        }
+    }
+
+    M_def_rank *job(int type, int rank, int gen = 1, Division *target = 0) {
+        M_def_rank *M = new M_def_rank(type);
+        M->_gen = gen;
+        M->_divis = 0;
+        M->_rank = rank;
+        M->_group = 0;
+        M->_ifelm = rank;
+        M->_fsamp = 48000.0f;
+        M->_fbase = 440.0f;
+        M->_scale = scales[5]._data;
+        M->_synth = &synth;
+        M->_rwave = 0;
+        M->_path = "/tmp";
+        M->_target = target;
+        return M;
+    }
+
+    // Access to the private parts of Slave.
+    void queue(ITC_mesg *M) { slave.queue(M); }
+    ITC_mesg *next() { return slave.next(); }
+    bool make_waves(M_def_rank *X) { return slave.make_waves(X); }
+    bool share_rank(M_def_rank *X) { return slave.share_rank(X); }
+    int  njob() const { return slave._njob; }
+    int  nshare() const { return slave._nshare; }
+
+    Perfstats  stats;
+    Slave      slave;
+    ITC_ctrl   audio;
+    ITC_ctrl   model;
+    Addsynth   synth;
+};
+
+TEST_F(SlaveTest, NewerJobReplacesWaiting) {
+    M_def_rank *A = job(MT_CALC_RANK, 0, 1);
+    M_def_rank *B = job(MT_CALC_RANK, 0, 2);
+    M_def_rank *C = job(MT_LOAD_RANK, 0, 2);
+    queue(A);
+    queue(B);
+    EXPECT_EQ(njob(), 1);
+    EXPECT_EQ(stats.jobs_merged(), 1u);
+    // A different job for the same rank replaces it as well.
+    queue(C);
+    EXPECT_EQ(njob(), 1);
+    EXPECT_EQ(stats.jobs_cancelled(), 1u);
+    EXPECT_EQ(stats.jobs_queued(), 1u);
+    EXPECT_EQ(next(), C);
+    EXPECT_EQ(next(), nullptr);
+    EXPECT_EQ(njob(), 0);
+    C->recover();
+}
+
+TEST_F(SlaveTest, OtherRanksAndTargetsAreKept) {
+    Division    D(0, 48000.0f);
+    M_def_rank *A = job(MT_CALC_RANK, 0, 1);
+    M_def_rank *B = job(MT_CALC_RANK, 1, 1);
+    M_def_rank *C = job(MT_LOAD_RANK, 0, 2, &D);
+    M_def_rank *E = job(MT_LOAD_RANK, 1, 0);
+    queue(A);
+    queue(B);
+    // For the next instrument, not the one playing.
+    queue(C);
+    // Older than the waiting job.
+    queue(E);
+    EXPECT_EQ(njob(), 4);
+    EXPECT_EQ(stats.jobs_merged() + stats.jobs_cancelled(), 0u);
+    EXPECT_EQ(next(), A);
+    EXPECT_EQ(next(), B);
+    EXPECT_EQ(next(), C);
+    EXPECT_EQ(next(), E);
+    EXPECT_EQ(njob(), 0);
+    A->recover();
+    B->recover();
+    C->recover();
+    E->recover();
+}
+
+TEST_F(SlaveTest, SyncIsNeverDroppedOrMoved) {
+    M_def_rank  *A = job(MT_CALC_RANK, 0, 1);
+    ITC_mesg    *S1 = new M_pooled(MT_AUDIO_SYNC);
+    M_def_rank  *B = job(MT_CALC_RANK, 0, 2);
+    M_new_instr *N = new M_new_instr;
+    M_def_rank  *C = job(MT_DROP_RANK, 0, 3);
+    ITC_mesg    *S2 = new M_pooled(MT_AUDIO_SYNC);
+    queue(A);
+    queue(S1);
+    queue(B);
+    queue(N);
+    queue(C);
+    queue(S2);
+    // Only the last job for rank 0 is left, after both earlier batches.
+    EXPECT_EQ(njob(), 4);
+    EXPECT_EQ(next(), S1);
+    EXPECT_EQ(next(), N);
+    EXPECT_EQ(next(), C);
+    EXPECT_EQ(next(), S2);
+    EXPECT_EQ(next(), nullptr);
+    EXPECT_EQ(njob(), 0);
+    S1->recover();
+    N->recover();
+    C->recover();
+    S2->recover();
+}
+
+TEST_F(SlaveTest, AbortRemovesSharedRank) {
+    M_def_rank *A = job(MT_CALC_RANK, 0, 1);
+    M_def_rank *B = job(MT_CALC_RANK, 0, 2);
+    queue(A);
+    EXPECT_EQ(next(), A);
+
+    // A is being made when B arrives.
+    A->_rwave = new Rankwave(synth._n0, synth._n1);
+    EXPECT_FALSE(share_rank(A));
+    EXPECT_EQ(nshare(), 1);
+    slave.put_event(FM_MODEL, B);
+    EXPECT_FALSE(make_waves(A));
+    EXPECT_EQ(A->_rwave, nullptr);
+    EXPECT_EQ(nshare(), 0);
+    EXPECT_EQ(stats.jobs_aborted(), 1u);
+    EXPECT_EQ(njob(), 1);
+    EXPECT_EQ(next(), B);
+    A->recover();
+
+    // B is made in full, and offered for sharing.
+    B->_rwave = new Rankwave(synth._n0, synth._n1);
+    EXPECT_FALSE(share_rank(B));
+    EXPECT_TRUE(make_waves(B));
+    EXPECT_EQ(nshare(), 1);
+    EXPECT_GT(B->_rwave->size(), (size_t) 0);
+    delete B->_rwave;
+    B->recover();
+}
@@ -0,0 +1,126 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include "startup.h"
+
+class StartupTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        snprintf(path, sizeof(path), "/tmp/aeolus-test-startup-%d.json", getpid());
+        Startup::reset();
+    }
+
+    void TearDown() override {
+        Startup::enable(0);
+        Startup::reset();
+        unlink(path);
+    }
+
+    std::string read_report() {
+        std::string s;
+        char b[4096];
+        size_t n;
+        FILE *F = fopen(path, "r");
+        if (!F) return s;
+        while ((n = fread(b, 1, sizeof(b), F)) > 0) s.append(b, n);
+        fclose(F);
+        return s;
+    }
+
+    // Two phases and a rank of each kind, from two threads.
+    void record() {
+        Startup::begin("config");
+        Startup::end("config");
+        std::thread T([] {
+            Startup::begin("load_rank", "principal8");
+            Startup::end("load_rank", Startup::LOADED);
+            Startup::begin("load_rank", "gedackt8");
+            Startup::end("load_rank", Startup::GENERATED);
+            Startup::begin("load_rank", "quint\"3");
+            Startup::end("load_rank", Startup::SHARED);
+        });
+        T.join();
+        Startup::begin("ranks");
+    }
+
+    char path[256];
+};
+
+TEST_F(StartupTest, JsonReportOnFirstReady) {
+    Startup::enable(path);
+    record();
+    Startup::end("ranks");
+    Startup::ready();
+    EXPECT_EQ(Startup::state(), Startup::DONE);
+
+    std::string s = read_report();
+    EXPECT_NE(s.find("\"ready_ms\""), std::string::npos);
+    EXPECT_NE(s.find("{ \"name\": \"config\""), std::string::npos);
+    EXPECT_NE(s.find("{ \"name\": \"ranks\""), std::string::npos);
+    EXPECT_NE(s.find("\"name\": \"principal8\", \"phase\": \"load_rank\""), std::string::npos);
+    EXPECT_NE(s.find("\"how\": \"generated\", \"cache\": \"miss\""), std::string::npos);
+    EXPECT_NE(s.find("quint\\\"3"), std::string::npos);
+    EXPECT_NE(s.find("\"cache_hits\": 2"), std::string::npos);
+    EXPECT_NE(s.find("\"cache_misses\": 1"), std::string::npos);
+
+    // Nothing is recorded or written after that.
+    unlink(path);
+    Startup::begin("late");
+    Startup::end("late");
+    Startup::ready();
+    EXPECT_EQ(read_report(), "");
+}
+
+TEST_F(StartupTest, OpenPhaseHasNoDuration) {
+    Startup::enable(path);
+    record();
+    Startup::ready();
+    std::string s = read_report();
+    EXPECT_NE(s.find("\"ranks\", \"start_ms\""), std::string::npos);
+    EXPECT_NE(s.find("\"ms\": null"), std::string::npos);
+}
+
+TEST_F(StartupTest, SummaryCountsCacheHits) {
+    char *buf = 0;
+    size_t len = 0;
+    FILE *F = open_memstream(&buf, &len);
+
+    record();
+    Startup::end("ranks");
+    Startup::summary(F);
+    fclose(F);
+    std::string s(buf, len);
+    free(buf);
+    EXPECT_NE(s.find("3 ranks, 2 cache hits, 1 misses"), std::string::npos);
+    EXPECT_NE(s.find("slowest"), std::string::npos);
+    EXPECT_NE(s.find("config"), std::string::npos);
+}
+
+TEST_F(StartupTest, NotEnabledWritesNothing) {
+    record();
+    Startup::ready();
+    EXPECT_EQ(Startup::state(), Startup::DONE);
+    EXPECT_EQ(read_report(), "");
+}
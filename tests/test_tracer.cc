@@ -0,0 +1,132 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include "tracer.h"
+
+class TracerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        snprintf(path, sizeof(path), "/tmp/aeolus-test-trace-%d.json", getpid());
+    }
+
+    void TearDown() override {
+        Tracer::enable(false, false);
+        unlink(path);
+    }
+
+    std::string read_dump() {
+        std::string s;
+        char b[4096];
+        size_t n;
+        FILE *F = fopen(path, "r");
+        if (!F) return s;
+        while ((n = fread(b, 1, sizeof(b), F)) > 0) s.append(b, n);
+        fclose(F);
+        return s;
+    }
+
+    char path[256];
+};
+
+TEST_F(TracerTest, DisabledRecordsNothing) {
+    Tracer::enable(false, false);
+    std::thread T([] {
+        Tracer::thread("test_off");
+        Tracer::begin("not_recorded");
+        Tracer::end("not_recorded");
+    });
+    T.join();
+    ASSERT_EQ(Tracer::dump(path), 0);
+    std::string s = read_dump();
+    EXPECT_NE(s.find("\"traceEvents\""), std::string::npos);
+    EXPECT_EQ(s.find("not_recorded"), std::string::npos);
+}
+
+TEST_F(TracerTest, DumpContainsThreadsAndEvents) {
+    Tracer::enable(true, false);
+    std::thread A([] {
+        Tracer::thread("test_a");
+        Tracer::begin("stage_a", 3);
+        Tracer::end("stage_a", 3);
+    });
+    std::thread B([] {
+        Tracer::thread("test_b");
+        Tracer::begin("stage_b");
+        Tracer::end("stage_b");
+    });
+    A.join();
+    B.join();
+
+    char name[1024];
+    ASSERT_EQ(Tracer::dump(path, name), 0);
+    EXPECT_STREQ(name, path);
+    std::string s = read_dump();
+    EXPECT_NE(s.find("\"name\":\"test_a\""), std::string::npos);
+    EXPECT_NE(s.find("\"name\":\"test_b\""), std::string::npos);
+    EXPECT_NE(s.find("{\"ph\":\"B\",\"name\":\"stage_a\""), std::string::npos);
+    EXPECT_NE(s.find("{\"ph\":\"E\",\"name\":\"stage_b\""), std::string::npos);
+    EXPECT_NE(s.find("\"args\":{\"arg\":3}"), std::string::npos);
+    // Recording resumes after a dump.
+    EXPECT_EQ(Tracer::state(), Tracer::ON);
+}
+
+TEST_F(TracerTest, TriggerFreezesUntilDump) {
+    // Without autodump an xrun does nothing.
+    Tracer::enable(true, false);
+    Tracer::trigger();
+    EXPECT_EQ(Tracer::state(), Tracer::ON);
+    EXPECT_FALSE(Tracer::pending());
+
+    Tracer::enable(true, true);
+    Tracer::trigger();
+    EXPECT_EQ(Tracer::state(), Tracer::FROZEN);
+    EXPECT_TRUE(Tracer::pending());
+
+    std::thread T([] {
+        Tracer::thread("test_frozen");
+        Tracer::begin("after_xrun");
+        Tracer::end("after_xrun");
+    });
+    T.join();
+
+    ASSERT_EQ(Tracer::dump(path), 0);
+    EXPECT_EQ(read_dump().find("after_xrun"), std::string::npos);
+    EXPECT_FALSE(Tracer::pending());
+    EXPECT_EQ(Tracer::state(), Tracer::ON);
+}
+
+TEST_F(TracerTest, UnmatchedEndIsSkipped) {
+    Tracer::enable(true, false);
+    std::thread T([] {
+        Tracer::thread("test_unmatched");
+        Tracer::end("orphan_end");
+        Tracer::begin("matched");
+        Tracer::end("matched");
+    });
+    T.join();
+    ASSERT_EQ(Tracer::dump(path), 0);
+    std::string s = read_dump();
+    EXPECT_EQ(s.find("orphan_end"), std::string::npos);
+    EXPECT_NE(s.find("\"name\":\"matched\""), std::string::npos);
+}
@@ -0,0 +1,152 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <string.h>
+#include "asection.h"
+#include "division.h"
+#include "rank_fixture.h"
+
+class UnitRankTest : public RankFixture {
+protected:
+    void SetUp() override {
+        RankFixture::SetUp();
+        unit = make_rank();
+    }
+
+    void TearDown() override {
+        delete unit;
+    }
+
+    Rankwave *unit;
+};
+
+TEST_F(UnitRankTest, KeyRangeFollowsOffset) {
+    Rankwave E(0, -1);
+
+    E.set_unit(unit, 12);
+    EXPECT_EQ(E.n0(), 36);
+    EXPECT_EQ(E.n1(), 60);
+    E.set_unit(unit, -12);
+    EXPECT_EQ(E.n0(), 60);
+    EXPECT_EQ(E.n1(), 84);
+    // Keys beyond the keyboard are dropped.
+    E.set_unit(unit, -36);
+    EXPECT_EQ(E.n0(), 84);
+    EXPECT_EQ(E.n1(), 96);
+}
+
+TEST_F(UnitRankTest, ExtensionPlaysTransposedPipe) {
+    float out1[4 * PERIOD];
+    float out2[4 * PERIOD];
+    Rankwave E(0, -1);
+
+    E.set_user(1);
+    E.set_unit(unit, 12);
+
+    Rankwave::seed(1);
+    unit->note_on(60);
+    run(unit, 4);
+    memcpy(out1, buf, sizeof(buf));
+    unit->note_off(60);
+    run(unit, 2000);
+    ASSERT_EQ(run(unit, 4), 0.0f);
+
+    Rankwave::seed(1);
+    E.note_on(48);
+    run(unit, 4);
+    memcpy(out2, buf, sizeof(buf));
+    // The extension has no pipes to play.
+    E.play(1);
+    EXPECT_EQ(memcmp(out1, out2, sizeof(out1)), 0);
+}
+
+TEST_F(UnitRankTest, PipeSoundsWhileAnyStopHoldsIt) {
+    Rankwave E(0, -1);
+
+    unit->set_user(0);
+    E.set_user(1);
+    E.set_unit(unit, -12);
+
+    // Both sound pipe 60.
+    unit->note_on(60);
+    E.note_on(72);
+    run(unit, 8);
+    unit->note_off(60);
+    run(unit, 200);
+    EXPECT_GT(run(unit, 4), 1e-6f);
+
+    // Turning the stop off releases it.
+    E.all_off();
+    run(unit, 2000);
+    EXPECT_EQ(run(unit, 4), 0.0f);
+}
+
+TEST_F(UnitRankTest, DivisionRelinksExtension) {
+    Asection A(48000.0f);
+    Division D(&A, 48000.0f);
+    uint16_t keys[NNOTES] = {};
+    Rankwave *E = new Rankwave(0, -1);
+    Rankwave *R = make_rank();
+
+    D.set_rank(0, unit, 'C', 0);
+    D.set_unit(1, E, 0, 12);
+    D.set_rank_mask(1, 0);
+    keys[48 - 36] = 1;
+    D.update(keys);
+    // Listen to the rank instead of the division.
+    unit->set_param(buf, 0, 'C');
+    EXPECT_GT(run(unit, 4), 0.0f);
+
+    // Replacing the extended rank keeps the extension playing.
+    D.set_rank(0, R, 'C', 0);
+    unit = 0;
+    EXPECT_EQ(E->unit(), R);
+    D.update(keys);
+    R->set_param(buf, 0, 'C');
+    EXPECT_GT(run(R, 4), 0.0f);
+    delete E;
+    delete R;
+}
+
+TEST_F(UnitRankTest, ReplacedRankReleasesItsPipes) {
+    Asection A(48000.0f);
+    Division D(&A, 48000.0f);
+    uint16_t keys[NNOTES] = {};
+    Rankwave *R = make_rank();
+
+    D.set_rank(0, unit, 'C', 0);
+    D.set_rank_mask(0, 0);
+    keys[60 - 36] = 1;
+    D.update(keys);
+    for (int k = 0; k < 8; k++) EXPECT_EQ(D.process(), 1);
+
+    // The old pipe releases while the new one starts.
+    D.set_rank(0, R, 'C', 0);
+    unit = 0;
+    D.update(keys);
+    EXPECT_EQ(D.process(), 2);
+    int k = 0;
+    while ((D.process() == 2) && (k < 2000)) k++;
+    EXPECT_GT(k, 0);
+    EXPECT_LT(k, 2000);
+    EXPECT_EQ(D.process(), 1);
+    delete R;
+}
@@ -0,0 +1,79 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include "rank_fixture.h"
+
+class VoicebudgetTest : public RankFixture {
+protected:
+    void SetUp() override {
+        RankFixture::SetUp();
+        synth._n_att.reset(0.01f);
+        synth._n_dct.reset(1.0f);
+        R = make_rank();
+    }
+
+    void TearDown() override {
+        delete R;
+    }
+
+    int run(int n) { return count(R, n); }
+
+    Rankwave   *R;
+    Voicebudget B;
+};
+
+TEST_F(VoicebudgetTest, CullsMiddleOfCompassFirst) {
+    for (int n = 48; n <= 72; n++) R->note_on(n);
+    EXPECT_EQ(run(2), 25);
+
+    B.set_limit(20);
+    B.begin(25 - B.limit());
+    R->offer(&B, 1.0f);
+    EXPECT_EQ(B.cull(), 5);
+    // Culled pipes are no longer counted while they fade out.
+    EXPECT_EQ(run(1), 20);
+    EXPECT_EQ(run(10), 20);
+
+    // Only pipes that have stopped can start again.
+    for (int n = 64; n <= 68; n++) R->note_on(n);
+    EXPECT_EQ(run(1), 25);
+}
+
+TEST_F(VoicebudgetTest, ReleasedPipesGoFirst) {
+    for (int n = 48; n <= 72; n++) R->note_on(n);
+    run(20);
+    R->note_off(48);
+    EXPECT_EQ(run(300), 25);
+
+    B.begin(1);
+    R->offer(&B, 1.0f);
+    EXPECT_EQ(B.cull(), 1);
+    EXPECT_EQ(run(10), 24);
+    R->note_on(48);
+    EXPECT_EQ(run(1), 25);
+}
+
+TEST_F(VoicebudgetTest, NoMoreThanNcullPerPeriod) {
+    for (int n = 48; n <= 72; n++) R->note_on(n);
+    run(2);
+    B.begin(25);
+    R->offer(&B, 1.0f);
+    EXPECT_EQ(B.cull(), (int) Voicebudget::NCULL);
+}
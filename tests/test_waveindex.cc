@@ -0,0 +1,153 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include "rank_fixture.h"
+#include "waveindex.h"
+
+class WaveindexTest : public RankFixture {
+protected:
+    void SetUp() override {
+        RankFixture::SetUp();
+        snprintf(dir, sizeof(dir), "/tmp/aeolus-test-waves-%d", getpid());
+        ASSERT_EQ(system((std::string("mkdir -p ") + dir).c_str()), 0);
+        snprintf(file, sizeof(file), "%s/test.ae1", dir);
+        strcpy(synth._filename, "test.ae0");
+        synth._n1 = 60;
+        Waveindex::reset();
+    }
+
+    void TearDown() override {
+        Waveindex::reset();
+        ASSERT_EQ(system((std::string("rm -rf ") + dir).c_str()), 0);
+    }
+
+    // As another process would, without the index knowing.
+    void replace(float fbase) {
+        strcpy(synth._filename, "other.ae0");
+        save(fbase);
+        strcpy(synth._filename, "test.ae0");
+        usleep(10000);
+        ASSERT_EQ(rename((std::string(dir) + "/other.ae1").c_str(), file), 0);
+    }
+
+    void save(float fbase) {
+        std::unique_ptr<Rankwave> R(make_rank(fbase));
+        ASSERT_EQ(R->save(dir, &synth, 48000.0f, fbase, scales[5]._data), 0);
+    }
+
+    int load(float fbase) {
+        Rankwave R(synth._n0, synth._n1);
+        return R.load(dir, &synth, 48000.0f, fbase, scales[5]._data);
+    }
+
+    char     dir[256];
+    char     file[300];
+};
+
+TEST_F(WaveindexTest, SaveUpdatesIndex) {
+    Waveindex::Entry E;
+
+    save(440.0f);
+    EXPECT_EQ(access((std::string(dir) + "/waves.index").c_str(), F_OK), 0);
+
+    // Read back from the file.
+    Waveindex::reset();
+    ASSERT_EQ(Waveindex::find(dir, "test.ae1", &E), Waveindex::KNOWN);
+    EXPECT_EQ(E._n0, 48);
+    EXPECT_EQ(E._n1, 60);
+    EXPECT_EQ(E._fbase, 440.0f);
+    EXPECT_EQ(load(440.0f), 0);
+    EXPECT_NE(load(442.0f), 0);
+}
+
+TEST_F(WaveindexTest, MissingFileIsNotOpened) {
+    Waveindex::Entry E;
+
+    EXPECT_EQ(Waveindex::find(dir, "test.ae1", &E), Waveindex::MISSING);
+    EXPECT_NE(load(440.0f), 0);
+}
+
+TEST_F(WaveindexTest, FileWithoutEntryIsIndexedOnLoad) {
+    Waveindex::Entry E;
+
+    save(440.0f);
+    unlink((std::string(dir) + "/waves.index").c_str());
+    Waveindex::reset();
+    EXPECT_EQ(Waveindex::find(dir, "test.ae1", &E), Waveindex::UNKNOWN);
+    EXPECT_EQ(load(440.0f), 0);
+    EXPECT_EQ(Waveindex::find(dir, "test.ae1", &E), Waveindex::KNOWN);
+    Waveindex::flush();
+    EXPECT_EQ(access((std::string(dir) + "/waves.index").c_str(), F_OK), 0);
+}
+
+TEST_F(WaveindexTest, ChangedFileIsChecked) {
+    float f = 441.0f;
+
+    save(440.0f);
+    // Change the tuning in the header behind the index's back.
+    usleep(10000);
+    FILE *F = fopen(file, "r+b");
+    ASSERT_NE(F, nullptr);
+    fseek(F, 16 + 12, SEEK_SET);
+    fwrite(&f, sizeof(f), 1, F);
+    fclose(F);
+
+    Waveindex::reset();
+    // The entry still matches, but the file has changed.
+    EXPECT_NE(load(440.0f), 0);
+    EXPECT_EQ(load(441.0f), 0);
+}
+
+TEST_F(WaveindexTest, FileMadeAfterListingIsFound) {
+    Waveindex::Entry E;
+
+    EXPECT_EQ(Waveindex::find(dir, "test.ae1", &E), Waveindex::MISSING);
+    replace(440.0f);
+    EXPECT_EQ(Waveindex::find(dir, "test.ae1", &E), Waveindex::UNKNOWN);
+    EXPECT_EQ(load(440.0f), 0);
+}
+
+TEST_F(WaveindexTest, OtherParametersAreCheckedOnDisk) {
+    save(440.0f);
+    // Made again for another tuning, the entry is out of date.
+    replace(442.0f);
+    EXPECT_EQ(load(442.0f), 0);
+    EXPECT_NE(load(440.0f), 0);
+}
+
+TEST_F(WaveindexTest, LongNamesAreNotIndexed) {
+    Waveindex::Entry E;
+    // Without an extension, ".ae1" is added to the stop's file name.
+    std::string name(62, 'x');
+
+    strcpy(synth._filename, name.c_str());
+    save(440.0f);
+    Waveindex::reset();
+    EXPECT_EQ(Waveindex::find(dir, (name + ".ae1").c_str(), &E), Waveindex::UNKNOWN);
+    EXPECT_EQ(load(440.0f), 0);
+    EXPECT_NE(load(442.0f), 0);
+    EXPECT_EQ(Waveindex::find(dir, (name + ".ae1").c_str(), &E), Waveindex::UNKNOWN);
+}
@@ -0,0 +1,121 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <math.h>
+#include <string.h>
+#include "asection.h"
+#include "division.h"
+#include "rank_fixture.h"
+
+class WavememTest : public RankFixture {};
+
+TEST_F(WavememTest, SizeCountsWaveData) {
+    Rankwave *R = make_rank();
+    Rankwave  E(0, -1);
+    Rankwave  F(synth._n0, synth._n1);
+
+    EXPECT_GT(R->size(), (size_t) 0);
+    EXPECT_EQ(R->size() % sizeof(float), (size_t) 0);
+    // Empty ranks and ranks without waves have none.
+    EXPECT_EQ(E.size(), (size_t) 0);
+    EXPECT_EQ(F.size(), (size_t) 0);
+    delete R;
+}
+
+TEST_F(WavememTest, HeldNotesStartWhenWavesReturn) {
+    Asection  A(48000.0f);
+    Division  D(&A, 48000.0f);
+    uint16_t  keys[NNOTES] = {};
+    Rankwave *R = make_rank();
+    Rankwave *E = new Rankwave(0, -1);
+
+    D.set_rank(0, R, 'C', 0);
+    D.set_rank_mask(0, 0);
+    keys[60 - 36] = 1;
+    D.update(keys);
+    EXPECT_GT(run(R, 4), 0.0f);
+
+    // Evicted, the stop stays drawn but once the old pipe
+    // has released there is nothing to play.
+    D.set_rank(0, E, 'C', 0);
+    D.update(keys);
+    int k = 0;
+    while (D.process() && (k < 1000)) k++;
+    EXPECT_LT(k, 1000);
+    EXPECT_EQ(D.process(), 0);
+
+    // Back again, the held note starts with its attack.
+    R = make_rank();
+    D.set_rank(0, R, 'C', 0);
+    D.update(keys);
+    float e1 = run(R, 2);
+    float e2 = run(R, 20);
+    EXPECT_GT(e1, 0.0f);
+    EXPECT_GT(e2 / 20, e1 / 2);
+}
+
+TEST_F(WavememTest, ReplacedRanksArePassedOn) {
+    Asection  A(48000.0f);
+    Division  D(&A, 48000.0f);
+    Lfq_ptr   Q(16);
+    uint16_t  keys[NNOTES] = {};
+    Rankwave *R = make_rank();
+    Rankwave *S = make_rank();
+    Rankwave *T = make_rank();
+    int       k;
+
+    D.set_dead(&Q);
+    D.set_rank(0, R, 'C', 0);
+    D.set_rank_mask(0, 0);
+    keys[60 - 36] = 1;
+    D.update(keys);
+    D.process();
+
+    // Replaced while sounding, R is passed on after its release.
+    D.set_rank(0, S, 'C', 0);
+    D.update(keys);
+    EXPECT_EQ(Q.read_avail(), 0);
+    for (k = 0; (Q.read_avail() == 0) && (k < 1000); k++) D.process();
+    ASSERT_EQ(Q.read_avail(), 1);
+    EXPECT_EQ(Q.read(0), R);
+    Q.read_commit(1);
+    delete R;
+
+    // Silent, S is passed on at once and never deleted here.
+    D.update(60 - 36, 0);
+    for (k = 0; D.process() && (k < 1000); k++);
+    D.set_rank(0, T, 'C', 0);
+    ASSERT_EQ(Q.read_avail(), 1);
+    EXPECT_EQ(Q.read(0), S);
+    Q.read_commit(1);
+    delete S;
+    D.clear();
+}
+
+TEST_F(WavememTest, TouchReadsOnlyWaves) {
+    Rankwave *R = make_rank();
+    Rankwave  E(0, -1);
+    Rankwave  F(synth._n0, synth._n1);
+
+    EXPECT_TRUE(isfinite(R->touch()));
+    EXPECT_EQ(E.touch(), 0.0f);
+    EXPECT_EQ(F.touch(), 0.0f);
+    delete R;
+}
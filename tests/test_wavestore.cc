@@ -0,0 +1,178 @@
+// ----------------------------------------------------------------------------
+//
+//  Copyright (C) 2003-2022 Fons Adriaensen <fons@linuxaudio.org>
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// ----------------------------------------------------------------------------
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "rankwave.h"
+#include "scales.h"
+
+class WavestoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Wavestore::enable(true);
+        // Different tests and test runs must not share segments.
+        key = Wavestore::hash(getpid(), test_name(), strlen(test_name()));
+        fbase = 440.0f + (getpid() % 1000) * 1e-3f;
+        synth._n0 = 48;
+        synth._n1 = 60;
+        synth._n_att.reset(0.05f);
+        for (int i = 0; i < N_NOTE; i++) synth._h_lev.setv(1, i, -10.0f);
+    }
+
+    void TearDown() override {
+        Wavestore::enable(false);
+    }
+
+    static const char *test_name() {
+        return ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    }
+
+    bool exists(uint64_t k) {
+        char name[32];
+        snprintf(name, sizeof(name), "/aeolus-%016llx", (unsigned long long) k);
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) return false;
+        close(fd);
+        return true;
+    }
+
+    // Play note 54 for a few periods.
+    static void play(Rankwave *R, float *out) {
+        float buf[4 * PERIOD];
+        R->set_param(buf, 0, 'C');
+        R->note_on(54);
+        for (int k = 0; k < 8; k++) {
+            memset(buf, 0, sizeof(buf));
+            R->play(1);
+            memcpy(out + k * 4 * PERIOD, buf, sizeof(buf));
+        }
+    }
+
+    uint64_t key;
+    float    fbase;
+    Addsynth synth;
+};
+
+TEST_F(WavestoreTest, SecondUserAttaches) {
+    Wavestore A, B;
+
+    ASSERT_EQ(A.acquire(key), Wavestore::CREATED);
+    float *p = (float *) A.create(16 * sizeof(float));
+    ASSERT_NE(p, nullptr);
+    for (int i = 0; i < 16; i++) p[i] = i;
+    A.commit();
+    EXPECT_EQ(A.state(), Wavestore::ATTACHED);
+
+    ASSERT_EQ(B.acquire(key), Wavestore::ATTACHED);
+    ASSERT_EQ(B.size(), 16 * sizeof(float));
+    EXPECT_EQ(((const float *) B.data())[15], 15.0f);
+
+    // The segment is removed with its last user.
+    A.release();
+    EXPECT_TRUE(exists(key));
+    B.release();
+    EXPECT_FALSE(exists(key));
+}
+
+TEST_F(WavestoreTest, AbandonedSegmentIsRemoved) {
+    Wavestore A, B;
+
+    ASSERT_EQ(A.acquire(key), Wavestore::CREATED);
+    A.release();
+    EXPECT_FALSE(exists(key));
+    EXPECT_EQ(B.acquire(key), Wavestore::CREATED);
+}
+
+TEST_F(WavestoreTest, DisabledStoreIsNotUsed) {
+    Wavestore A;
+
+    Wavestore::enable(false);
+    EXPECT_EQ(A.acquire(key), Wavestore::NONE);
+    EXPECT_FALSE(exists(key));
+}
+
+TEST_F(WavestoreTest, RanksShareWaves) {
+    float *scale = scales[5]._data;
+    float out1[32 * PERIOD];
+    float out2[32 * PERIOD];
+
+    Rankwave *R1 = new Rankwave(synth._n0, synth._n1);
+    ASSERT_NE(R1->attach(&synth, 48000.0f, fbase, scale), 0);
+    R1->gen_waves(&synth, 48000.0f, fbase, scale);
+    R1->publish();
+
+    // Same parameters, no waves generated.
+    Rankwave *R2 = new Rankwave(synth._n0, synth._n1);
+    ASSERT_EQ(R2->attach(&synth, 48000.0f, fbase, scale), 0);
+
+    // Different parameters, a different segment.
+    Rankwave *R3 = new Rankwave(synth._n0, synth._n1);
+    EXPECT_NE(R3->attach(&synth, 44100.0f, fbase, scale), 0);
+    delete R3;
+
+    play(R1, out1);
+    play(R2, out2);
+    EXPECT_EQ(memcmp(out1, out2, sizeof(out1)), 0);
+    float peak = 0;
+    for (float v : out1) peak = fmaxf(peak, fabsf(v));
+    EXPECT_GT(peak, 0.0f);
+
+    delete R1;
+    delete R2;
+}
+
+TEST_F(WavestoreTest, SharedRankOutlivesOriginal) {
+    float *scale = scales[5]._data;
+    float out1[32 * PERIOD];
+    float out2[32 * PERIOD];
+
+    Wavestore::enable(false);
+    Rankwave *R1 = new Rankwave(synth._n0, synth._n1);
+    R1->gen_waves(&synth, 48000.0f, fbase, scale);
+    Rankwave *R2 = new Rankwave(synth._n0, synth._n1);
+    R2->share(R1);
+    EXPECT_TRUE(R2->shares(R1));
+    EXPECT_TRUE(R2->modif());
+
+    // Each has its own playing state.
+    play(R1, out1);
+    R1->note_off(54);
+    delete R1;
+    play(R2, out2);
+    EXPECT_EQ(memcmp(out1, out2, sizeof(out1)), 0);
+    delete R2;
+}
+
+TEST_F(WavestoreTest, KeyFollowsWaveParameters) {
+    float *scale = scales[5]._data;
+    uint64_t k = Rankwave::key(&synth, 48000.0f, 440.0f, scale);
+
+    // Pan and delay don't change the waves.
+    synth._pan = 'L';
+    synth._del = 10;
+    EXPECT_EQ(Rankwave::key(&synth, 48000.0f, 440.0f, scale), k);
+    EXPECT_NE(Rankwave::key(&synth, 48000.0f, 441.0f, scale), k);
+    EXPECT_NE(Rankwave::key(&synth, 48000.0f, 440.0f, scales[0]._data), k);
+    synth._n_vol.reset(-3.0f);
+    EXPECT_NE(Rankwave::key(&synth, 48000.0f, 440.0f, scale), k);
+}